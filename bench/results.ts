@@ -0,0 +1,39 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+import { testapi } from '../test/testapi';
+
+// Measures how many results per second reach a JS callback, building
+// them with property names created per result versus cached ones.
+
+const events = Number(process.argv[2] ?? 1_000_000);
+const rounds = 5;
+
+function measure(cached: boolean): number {
+	let received = 0;
+	const start = process.hrtime.bigint();
+	testapi.benchmarkResults(events, cached, () => received++);
+	const elapsed = Number(process.hrtime.bigint() - start) / 1e9;
+
+	if (received !== events) {
+		throw new Error(`Expected ${events} results, got ${received}`);
+	}
+
+	return events / elapsed;
+}
+
+// Warm up both paths before measuring
+measure(false);
+measure(true);
+
+for (const cached of [false, true]) {
+	const rates: number[] = [];
+	for (let i = 0; i < rounds; i++) {
+		rates.push(measure(cached));
+	}
+	rates.sort((a, b) => a - b);
+
+	console.log(`${cached ? 'cached keys' : 'per result keys'}: ${Math.round(rates[Math.floor(rounds / 2)]).toLocaleString()} events/s (median of ${rounds})`);
+}
@@ -0,0 +1,334 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+import * as fs from 'fs';
+import * as path from 'path';
+import {
+	createAudioHub, createSynthesizer, createTranscriber, getLatencyHistograms, ILatencySummary, KeywordRecognitionStatusCode,
+	recognize, resetLatencyHistograms, SynthesizerStatusCode, transcribeFiles, TranscriptionStatusCode
+} from '../index';
+
+// Benchmarks transcription, synthesis and keyword recognition against
+// recorded fixtures and local models, without a microphone or speaker,
+// and prints the results as JSON.
+//
+// Sections run when their model is configured through the environment:
+//
+//   NODE_SPEECH_MODEL_PATH, NODE_SPEECH_MODEL_NAME, NODE_SPEECH_MODEL_KEY
+//     transcription of <fixtures>/transcription/*.wav
+//   NODE_SPEECH_VOICE_PATH, NODE_SPEECH_VOICE_NAME, NODE_SPEECH_VOICE_KEY
+//     synthesis of a fixed corpus to memory
+//   NODE_SPEECH_KEYWORD_MODEL_PATH
+//     keyword recognition on <fixtures>/keyword/*.wav
+//
+// Fixtures are 16 kHz 16 bit mono PCM WAV files in the directory given by
+// NODE_SPEECH_BENCH_FIXTURES, defaulting to bench/fixtures.
+//
+// Usage: node bench/speech.js [--fast]
+//   --fast pushes audio as fast as it is taken instead of in real time,
+//   which measures throughput but not realistic latencies.
+
+const fixtures = process.env['NODE_SPEECH_BENCH_FIXTURES'] ?? path.join(__dirname, 'fixtures');
+const fast = process.argv.includes('--fast');
+
+const corpus = [
+	'The quick brown fox jumps over the lazy dog.',
+	'Please open the settings and enable the experimental features.',
+	'It was the best of times, it was the worst of times.',
+	'Run the tests again after the build has finished.',
+	'How much wood would a woodchuck chuck if a woodchuck could chuck wood?'
+];
+
+// Bytes per second of the default synthesis output format, 24 kHz 16 bit mono
+const synthesisBytesPerSecond = 48000;
+
+interface IWav {
+	readonly samplesPerSecond: number;
+	readonly bitsPerSample: number;
+	readonly channels: number;
+	readonly data: Buffer;
+	readonly durationMs: number;
+}
+
+function readWav(file: string): IWav {
+	const buffer = fs.readFileSync(file);
+	if (buffer.toString('ascii', 0, 4) !== 'RIFF' || buffer.toString('ascii', 8, 12) !== 'WAVE') {
+		throw new Error(`${file} is not a WAV file`);
+	}
+
+	let format: { samplesPerSecond: number; bitsPerSample: number; channels: number } | undefined;
+	for (let offset = 12; offset + 8 <= buffer.length;) {
+		const id = buffer.toString('ascii', offset, offset + 4);
+		const size = buffer.readUInt32LE(offset + 4);
+		if (id === 'fmt ') {
+			format = {
+				channels: buffer.readUInt16LE(offset + 10),
+				samplesPerSecond: buffer.readUInt32LE(offset + 12),
+				bitsPerSample: buffer.readUInt16LE(offset + 22)
+			};
+		} else if (id === 'data' && format) {
+			const data = buffer.subarray(offset + 8, offset + 8 + size);
+			const bytesPerSecond = format.samplesPerSecond * format.channels * format.bitsPerSample / 8;
+			return { ...format, data, durationMs: data.length / bytesPerSecond * 1000 };
+		}
+		offset += 8 + size + (size & 1);
+	}
+
+	throw new Error(`${file} has no PCM data`);
+}
+
+function listWavs(directory: string): string[] {
+	if (!fs.existsSync(directory)) {
+		return [];
+	}
+	return fs.readdirSync(directory).filter(file => file.endsWith('.wav')).sort().map(file => path.join(directory, file));
+}
+
+function summarize(values: number[]): ILatencySummary | undefined {
+	if (values.length === 0) {
+		return undefined;
+	}
+	const sorted = [...values].sort((a, b) => a - b);
+	const percentile = (p: number) => sorted[Math.min(sorted.length - 1, Math.floor(p * sorted.length))];
+	return { count: sorted.length, p50: percentile(0.5), p95: percentile(0.95), p99: percentile(0.99), max: sorted[sorted.length - 1] };
+}
+
+const delay = (ms: number) => new Promise(resolve => setTimeout(resolve, ms));
+
+// Streams one fixture through a transcriber, followed by silence so that
+// the last utterance is finalized.
+async function transcribeFixture(file: string, options: { modelPath: string; modelName: string; modelKey: string }) {
+	const wav = readWav(file);
+	const bytesPerSecond = wav.samplesPerSecond * wav.channels * wav.bitsPerSample / 8;
+	const chunkBytes = bytesPerSecond / 10;
+	const silence = Buffer.alloc(bytesPerSecond * 2);
+
+	let events = 0;
+	let firstPartial: number | undefined;
+	let lastFinal: number | undefined;
+	let resolveStarted: () => void;
+	let resolveStopped: () => void;
+	const started = new Promise<void>(resolve => resolveStarted = resolve);
+	const stopped = new Promise<void>(resolve => resolveStopped = resolve);
+
+	const { samplesPerSecond, bitsPerSample, channels } = wav;
+	const transcriber = createTranscriber({ ...options, audioStream: { samplesPerSecond, bitsPerSample, channels } }, (error, result) => {
+		if (error) {
+			throw error;
+		}
+		events++;
+		switch (result.status) {
+			case TranscriptionStatusCode.STARTED: resolveStarted(); break;
+			case TranscriptionStatusCode.RECOGNIZING: firstPartial ??= performance.now(); break;
+			case TranscriptionStatusCode.RECOGNIZED: lastFinal = performance.now(); break;
+			case TranscriptionStatusCode.STOPPED: resolveStopped(); break;
+		}
+	});
+	await started;
+
+	const start = performance.now();
+	for (const audio of [wav.data, silence]) {
+		for (let offset = 0; offset < audio.length; offset += chunkBytes) {
+			const chunk = audio.subarray(offset, offset + chunkBytes);
+			while (!transcriber.pushAudio(chunk)) {
+				await delay(10);
+			}
+			if (!fast) {
+				await delay(100);
+			}
+		}
+	}
+
+	// Give the recognizer time to finalize what it was given
+	const pushed = performance.now();
+	while (performance.now() - Math.max(pushed, lastFinal ?? 0) < 1000) {
+		await delay(100);
+	}
+
+	transcriber.stop();
+	await stopped;
+	const end = performance.now();
+	transcriber.dispose();
+
+	return {
+		audioDurationMs: wav.durationMs,
+		elapsedMs: (lastFinal ?? end) - start,
+		timeToFirstPartialMs: firstPartial !== undefined ? firstPartial - start : undefined,
+		events,
+		eventsElapsedMs: end - start
+	};
+}
+
+async function benchmarkTranscription() {
+	const modelPath = process.env['NODE_SPEECH_MODEL_PATH'];
+	const modelName = process.env['NODE_SPEECH_MODEL_NAME'];
+	const modelKey = process.env['NODE_SPEECH_MODEL_KEY'];
+	const files = listWavs(path.join(fixtures, 'transcription'));
+	if (!modelPath || !modelName || !modelKey || files.length === 0) {
+		return undefined;
+	}
+	const options = { modelPath, modelName, modelKey };
+
+	resetLatencyHistograms();
+	const runs = [];
+	for (const file of files) {
+		runs.push(await transcribeFixture(file, options));
+	}
+	const histograms = getLatencyHistograms();
+
+	const audioDurationMs = runs.reduce((sum, run) => sum + run.audioDurationMs, 0);
+	const events = runs.reduce((sum, run) => sum + run.events, 0);
+	const eventsElapsedMs = runs.reduce((sum, run) => sum + run.eventsElapsedMs, 0);
+
+	// Throughput without pacing, all files at once
+	const batch = await transcribeFiles(files, options);
+
+	return {
+		files: files.length,
+		audioDurationMs,
+		realTimeFactor: fast ? runs.reduce((sum, run) => sum + run.elapsedMs, 0) / audioDurationMs : undefined,
+		timeToFirstPartialMs: summarize(runs.flatMap(run => run.timeToFirstPartialMs !== undefined ? [run.timeToFirstPartialMs] : [])),
+		firstPartialAfterSpeechStartMs: histograms['transcription.firstPartial'],
+		speechEndToFinalMs: histograms['transcription.speechEndToFinal'],
+		deliveryMs: histograms['transcription.delivery'],
+		eventsPerSecond: events / (eventsElapsedMs / 1000),
+		batch
+	};
+}
+
+async function benchmarkSynthesis() {
+	const modelPath = process.env['NODE_SPEECH_VOICE_PATH'];
+	const modelName = process.env['NODE_SPEECH_VOICE_NAME'];
+	const modelKey = process.env['NODE_SPEECH_VOICE_KEY'];
+	if (!modelPath || !modelName || !modelKey) {
+		return undefined;
+	}
+
+	let resolveDone: () => void = () => { };
+	let firstAudio: number | undefined;
+	let bytes = 0;
+	const synthesizer = createSynthesizer({ modelPath, modelName, modelKey, output: 'stream' }, (error, result) => {
+		if (error) {
+			throw error;
+		}
+		if (result.status === SynthesizerStatusCode.SYNTHESIZING && result.audio) {
+			firstAudio ??= performance.now();
+			bytes += result.audio.byteLength;
+		} else if (result.status === SynthesizerStatusCode.STOPPED || result.status === SynthesizerStatusCode.ERROR) {
+			resolveDone();
+		}
+	});
+
+	const timeToFirstAudio: number[] = [];
+	const totals: number[] = [];
+	const start = performance.now();
+	for (const text of corpus) {
+		firstAudio = undefined;
+		const done = new Promise<void>(resolve => resolveDone = resolve);
+		const utteranceStart = performance.now();
+		synthesizer.synthesize(text);
+		await done;
+		if (firstAudio !== undefined) {
+			timeToFirstAudio.push(firstAudio - utteranceStart);
+		}
+		totals.push(performance.now() - utteranceStart);
+	}
+	const elapsedMs = performance.now() - start;
+	synthesizer.dispose();
+
+	const audioDurationMs = bytes / synthesisBytesPerSecond * 1000;
+	return {
+		utterances: corpus.length,
+		audioDurationMs,
+		elapsedMs,
+		realTimeFactor: audioDurationMs > 0 ? elapsedMs / audioDurationMs : undefined,
+		timeToFirstAudioMs: summarize(timeToFirstAudio),
+		utteranceMs: summarize(totals)
+	};
+}
+
+// Streams one keyword clip through an audio hub, between a second of
+// silence on either side, and returns how long after the end of the
+// keyword in the audio it was detected. When paced, audio is pushed as it
+// would be captured, so the end of the keyword was pushed at its offset
+// into the audio plus its duration.
+async function recognizeKeywordFixture(file: string, modelPath: string) {
+	const wav = readWav(file);
+	const bytesPerSecond = wav.samplesPerSecond * wav.channels * wav.bitsPerSample / 8;
+	const chunkBytes = bytesPerSecond / 10;
+	const silence = Buffer.alloc(bytesPerSecond);
+	const audio = Buffer.concat([silence, wav.data, silence]);
+
+	// Holds all of the audio, so that no reader lag drops any of it and
+	// offsets into the audio stay those into the pushed audio
+	const { samplesPerSecond, bitsPerSample, channels } = wav;
+	const hub = createAudioHub({ samplesPerSecond, bitsPerSample, channels, capacityMs: audio.length / bytesPerSecond * 1000 });
+	const recognition = recognize({ modelPath, audioHub: hub, signal: new AbortController().signal });
+
+	const start = Date.now();
+	for (let offset = 0; offset < audio.length; offset += chunkBytes) {
+		if (!fast) {
+			const pushAt = start + (offset + chunkBytes) / bytesPerSecond * 1000;
+			await delay(Math.max(0, pushAt - Date.now()));
+		}
+		hub.push(audio.subarray(offset, offset + chunkBytes));
+	}
+	hub.dispose();
+
+	const result = await recognition;
+	if (result.status !== KeywordRecognitionStatusCode.RECOGNIZED) {
+		return { detected: false };
+	}
+	const keywordEnd = start + result.offset! + result.duration!;
+	return { detected: true, detectionMs: fast ? undefined : result.timestamp! - keywordEnd };
+}
+
+async function benchmarkKeyword() {
+	const modelPath = process.env['NODE_SPEECH_KEYWORD_MODEL_PATH'];
+	const files = listWavs(path.join(fixtures, 'keyword'));
+	if (!modelPath || files.length === 0) {
+		return undefined;
+	}
+
+	let detected = 0;
+	const latencies: number[] = [];
+	for (const file of files) {
+		const result = await recognizeKeywordFixture(file, modelPath);
+		if (result.detected) {
+			detected++;
+		}
+		if (result.detectionMs !== undefined) {
+			latencies.push(result.detectionMs);
+		}
+	}
+
+	return {
+		clips: files.length,
+		detected,
+
+		// From the end of the keyword to its detection, only when paced
+		detectionMs: summarize(latencies)
+	};
+}
+
+async function main() {
+	const report = {
+		version: require('../package.json').version,
+		node: process.version,
+		platform: `${process.platform}-${process.arch}`,
+		paced: !fast,
+		transcription: await benchmarkTranscription(),
+		synthesis: await benchmarkSynthesis(),
+		keyword: await benchmarkKeyword(),
+		peakRssBytes: process.resourceUsage().maxRSS * 1024
+	};
+
+	console.log(JSON.stringify(report, undefined, 2));
+}
+
+main().catch(error => {
+	console.error(error);
+	process.exit(1);
+});
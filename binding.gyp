@@ -1,117 +1,12 @@
 {
+  'variables': {
+    # `node-gyp rebuild --test_hooks=true` also builds the test binding
+    'test_hooks%': 'false',
+  },
   'targets': [
     {
       'target_name': 'speechapi',
-      'sources': [ 'src/main.cc' ],
-      'include_dirs': [
-        '<!@(node -p "require(\'node-addon-api\').include")',
-        '.cache/SpeechSDK/build/native/include/c_api',
-        '.cache/SpeechSDK/build/native/include/cxx_api',
-      ],
-      'cflags!': [ '-fno-exceptions' ],
-      'cflags_cc!': [ '-fno-exceptions' ],
-      'cflags': ['-std=c++17' ],
-      'cflags_cc': ['-std=c++17' ],
-      'defines': [ 'NAPI_CPP_EXCEPTIONS' ],
-      'conditions': [
-        ['OS=="mac"', {
-          'link_settings': {
-            'libraries': [
-              '-Wl,-rpath,@loader_path',
-              '-lMicrosoft.CognitiveServices.Speech.core',
-              '-lMicrosoft.CognitiveServices.Speech.extension.embedded.tts',
-              '-lMicrosoft.CognitiveServices.Speech.extension.embedded.sr',
-              '-lMicrosoft.CognitiveServices.Speech.extension.embedded.sr.runtime',
-              '-lMicrosoft.CognitiveServices.Speech.extension.onnxruntime',
-            ],
-          },
-          'xcode_settings': {
-            'GCC_ENABLE_CPP_EXCEPTIONS': 'YES'
-          }
-        }],
-        ["OS=='win'", {
-          "defines": [
-              "WINDOWS",
-              "_HAS_EXCEPTIONS=1"
-          ],
-          "msvs_configuration_attributes": {
-              "SpectreMitigation": "Spectre"
-          },
-          "msvs_settings": {
-              "VCCLCompilerTool": {
-                  "ExceptionHandling": 1,
-                  'AdditionalOptions': [
-                      '/guard:cf',
-                      '-std:c++17',
-                      '/we4244',
-                      '/we4267',
-                      '/ZH:SHA_256'
-                  ],
-              },
-              'VCLinkerTool': {
-                  'AdditionalOptions': [
-                      '/guard:cf'
-                  ]
-              }
-          },
-        }],
-        ['OS=="win" and target_arch=="arm64"', {
-          'link_settings': {
-            'libraries': [
-              '<(module_root_dir)\\.cache\\SpeechSDK\\build\\native\\ARM64\\Release\\Microsoft.CognitiveServices.Speech.core.lib',
-              '<(module_root_dir)\\.cache\\SpeechSDK\\build\\native\\ARM64\\Release\\Microsoft.CognitiveServices.Speech.extension.embedded.tts.lib',
-              '<(module_root_dir)\\.cache\\SpeechSDK\\build\\native\\ARM64\\Release\\Microsoft.CognitiveServices.Speech.extension.embedded.sr.lib',
-              '<(module_root_dir)\\.cache\\SpeechSDK\\build\\native\\ARM64\\Release\\Microsoft.CognitiveServices.Speech.extension.onnxruntime.lib',
-            ],
-          },
-        }],
-        ['OS=="win" and target_arch=="x64"', {
-          'link_settings': {
-            'libraries': [
-              '<(module_root_dir)\\.cache\\SpeechSDK\\build\\native\\x64\\Release\\Microsoft.CognitiveServices.Speech.core.lib',
-              '<(module_root_dir)\\.cache\\SpeechSDK\\build\\native\\x64\\Release\\Microsoft.CognitiveServices.Speech.extension.embedded.tts.lib',
-              '<(module_root_dir)\\.cache\\SpeechSDK\\build\\native\\x64\\Release\\Microsoft.CognitiveServices.Speech.extension.embedded.sr.lib',
-              '<(module_root_dir)\\.cache\\SpeechSDK\\build\\native\\x64\\Release\\Microsoft.CognitiveServices.Speech.extension.onnxruntime.lib',
-            ],
-          },
-        }],
-        ['OS=="win" and target_arch=="ia32"', {
-          'link_settings': {
-            'libraries': [
-              '<(module_root_dir)\\.cache\\SpeechSDK\\build\\native\\Win32\\Release\\Microsoft.CognitiveServices.Speech.core.lib',
-              '<(module_root_dir)\\.cache\\SpeechSDK\\build\\native\\Win32\\Release\\Microsoft.CognitiveServices.Speech.extension.embedded.tts.lib',
-              '<(module_root_dir)\\.cache\\SpeechSDK\\build\\native\\Win32\\Release\\Microsoft.CognitiveServices.Speech.extension.embedded.sr.lib',
-              '<(module_root_dir)\\.cache\\SpeechSDK\\build\\native\\Win32\\Release\\Microsoft.CognitiveServices.Speech.extension.onnxruntime.lib',
-            ],
-          },
-        }],
-        ['OS=="linux"', {
-          "libraries": [
-            "-Wl,-rpath,'$$ORIGIN'",
-            '-lMicrosoft.CognitiveServices.Speech.core',
-            '-lMicrosoft.CognitiveServices.Speech.extension.embedded.tts',
-            '-lMicrosoft.CognitiveServices.Speech.extension.embedded.tts.runtime',
-            '-lMicrosoft.CognitiveServices.Speech.extension.embedded.sr',
-            '-lMicrosoft.CognitiveServices.Speech.extension.embedded.sr.runtime',
-            '-lMicrosoft.CognitiveServices.Speech.extension.onnxruntime',
-          ],
-        }],
-        ['OS=="linux" and target_arch=="x64"', {
-          "ldflags": [
-            "-L<(module_root_dir)/.cache/SpeechSDK/runtimes/linux-x64/native"
-          ]
-        }],
-        ['OS=="linux" and target_arch=="arm64"', {
-          "ldflags": [
-            "-L<(module_root_dir)/.cache/SpeechSDK/runtimes/linux-arm64/native"
-          ]
-        }],
-        ['OS=="linux" and target_arch=="armhf"', {
-          "ldflags": [
-            "-L<(module_root_dir)/.cache/SpeechSDK/runtimes/linux-arm/native"
-          ]
-        }],
-      ]
+      'includes': [ 'speechapi.gypi' ],
     },
     {
       "target_name": "action_before_build",
@@ -236,5 +131,18 @@
         }]
       ]
     }
-  ]
-}
\ No newline at end of file
+  ],
+  'conditions': [
+    ['test_hooks=="true"', {
+      'targets': [
+        {
+          # The addon with the hooks that tests and benchmarks drive, which
+          # the release binding doesn't export
+          'target_name': 'speechapi_test',
+          'includes': [ 'speechapi.gypi' ],
+          'defines': [ 'NODE_SPEECH_TEST_HOOKS' ],
+        },
+      ],
+    }],
+  ],
+}
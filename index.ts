@@ -8,20 +8,52 @@ export const speechapi = require('bindings')('speechapi.node') as SpeechLib;
 interface SpeechLib {
 
   // Transcription
-  createTranscriber: (modelPath: string, modelName: string, modelKey: string, logsPath: string | undefined, phrases: string[], callback: (error: Error | undefined, result: ITranscriptionResult) => void) => number,
+  createTranscriber: (modelPath: string, modelName: string, modelKey: string, logsPath: string | undefined, phrases: string[], options: { audioStream?: IAudioStreamOptions, audioHub?: number, batch?: boolean, detailed?: boolean, maxPending?: number }, callback: (error: Error | undefined, result: any, coalesced?: number) => void) => number,
   startTranscriber: (id: number) => void,
   stopTranscriber: (id: number) => void,
   disposeTranscriber: (id: number) => void,
+  pushAudio: (id: number, audio: ArrayBuffer | ArrayBufferView) => boolean,
+  getAudioGateStats: (id: number) => IAudioGateStats | undefined,
+  acknowledgeResults: (id: number, count: number) => void,
+  updatePhrases: (id: number, add: string[], remove: string[], clear: boolean) => boolean,
+  createMultiModelTranscriber: (models: ITranscriptionModel[], logsPath: string | undefined, phrases: string[], options: { audioHub?: number, detailed?: boolean, maxPending?: number }, callback: (error: Error | undefined, result: any) => void) => number,
+
+  // Audio Hubs
+  createAudioHub: (samplesPerSecond: number, bitsPerSample: number, channels: number, capacityBytes: number) => number,
+  pushAudioHub: (id: number, audio: ArrayBuffer | ArrayBufferView) => boolean,
+  getAudioHubStats: (id: number) => IAudioHubStats | undefined,
+  disposeAudioHub: (id: number) => void,
+  transcribeFiles: (modelPath: string, modelName: string, modelKey: string, logsPath: string | undefined, phrases: string[], paths: string[], options: { concurrency?: number }, callback: (error: Error | undefined, result: any) => void) => number,
+  cancelFileTranscription: (id: number) => void,
+  prewarmTranscriber: (modelPath: string, modelName: string, modelKey: string, logsPath: string | undefined, options: { audioStream?: IAudioStreamOptions, detailed?: boolean }, callback: (error: Error | undefined) => void) => void,
 
   // Synthesis
-  createSynthesizer: (modelPath: string, modelName: string, modelKey: string, logsPath: string | undefined, callback: (error: Error | undefined, result: ISynthesizerResult) => void) => number,
+  createSynthesizer: (modelPath: string, modelName: string, modelKey: string, logsPath: string | undefined, options: { output?: 'speaker' | 'stream', outputFormat?: string }, callback: (error: Error | undefined, result: ISynthesizerResult) => void) => number,
   stopSynthesizer: (id: number) => void,
   disposeSynthesizer: (id: number) => void,
-  synthesize: (id: number, text: string) => void,
+  synthesize: (id: number, text: string, options?: ISynthesizeOptions) => number,
+  appendText: (id: number, chunk: string, flush?: boolean) => void,
+  prewarmSynthesizer: (modelPath: string, modelName: string, modelKey: string, logsPath: string | undefined, options: { output?: 'speaker' | 'stream', outputFormat?: string }, callback: (error: Error | undefined) => void) => void,
 
   // Keyword Recognition
-  recognize: (modelPath: string, callback: (error: Error | undefined, result: IKeywordRecognitionResult) => void) => number,
-  unrecognize: (id: number) => void
+  recognize: (modelPath: string, options: { continuous?: boolean, audioFile?: string, audioHub?: number }, callback: (error: Error | undefined, result: IKeywordRecognitionResult) => void) => number,
+  unrecognize: (id: number) => void,
+  createKeywordTranscriber: (keywordModelPath: string, modelPath: string, modelName: string, modelKey: string, logsPath: string | undefined, phrases: string[], callback: (error: Error | undefined, result: ITranscriptionResult) => void) => number,
+
+  // Sessions
+  setSessionThreadCount: (count: number) => void,
+  getSessionThreadCount: () => number,
+
+  // Metrics
+  getSessionMetrics: (kind: 'transcription' | 'synthesis' | 'keyword', id: number) => ISessionMetrics | undefined,
+  getLatencyHistograms: () => Record<string, ILatencySummary>,
+  resetLatencyHistograms: () => void,
+
+  // Caches
+  getSpeechConfigCacheStats: () => ISpeechConfigCacheStats,
+  setSpeechConfigCacheIdleTimeout: (idleTimeoutMs: number) => void,
+  getSynthesisCacheStats: () => ISynthesisCacheStats,
+  configureSynthesisCache: (maxBytes: number, directory: string | undefined) => void
 }
 
 export interface IBaseOptions {
@@ -37,6 +69,84 @@ export interface IBaseOptions {
   readonly logsPath?: string;
 }
 
+export interface IAudioStreamOptions {
+  /**
+   * PCM sample rate of the audio, defaults to 16000.
+   */
+  readonly samplesPerSecond?: number;
+
+  /**
+   * Bits per PCM sample, defaults to 16.
+   */
+  readonly bitsPerSample?: number;
+
+  /**
+   * Number of interleaved channels, defaults to 1.
+   */
+  readonly channels?: number;
+
+  /**
+   * How many bytes of pushed audio may wait to be read before further
+   * pushes are rejected, defaults to 1 MiB.
+   */
+  readonly maxQueuedBytes?: number;
+
+  /**
+   * Holds pushed 16 bit audio back from the recognizer while nothing is
+   * said, so that it does not run on silence. `true` uses the defaults.
+   * Since held back silence is never seen by the recognizer, silence
+   * timeouts are only reported for the silence that is passed on.
+   */
+  readonly vad?: boolean | IAudioGateOptions;
+}
+
+export interface IAudioGateOptions {
+  /**
+   * Level above which audio counts as speech, in dBFS, defaults to -45.
+   */
+  readonly thresholdDb?: number;
+
+  /**
+   * Audio before speech that is passed on, so that the start of speech
+   * is not cut off, defaults to 300 ms.
+   */
+  readonly preRollMs?: number;
+
+  /**
+   * Audio after speech that is passed on, so that the recognizer can end
+   * the utterance, defaults to 1000 ms.
+   */
+  readonly hangoverMs?: number;
+}
+
+export interface IAudioGateStats {
+  /**
+   * Whether audio is currently passed on.
+   */
+  readonly open: boolean;
+
+  /**
+   * Duration of all pushed audio.
+   */
+  readonly audioMs: number;
+
+  /**
+   * Duration of the audio that was held back from the recognizer.
+   */
+  readonly gatedMs: number;
+
+  /**
+   * Share of the pushed audio the recognizer did not have to process,
+   * between 0 and 1.
+   */
+  readonly savedFraction: number;
+
+  /**
+   * Number of times speech started.
+   */
+  readonly openings: number;
+}
+
 //#region Transcription
 
 export enum TranscriptionStatusCode {
@@ -53,15 +163,64 @@ export enum TranscriptionStatusCode {
   ERROR = 11
 }
 
+/**
+ * Timings are in milliseconds from the start of the audio.
+ */
+export interface ITranscriptionDetails {
+  readonly offset: number;
+  readonly duration: number;
+
+  /**
+   * Words of the best alternative, with their timings at the same index
+   * in `wordOffsets` and `wordDurations`.
+   */
+  readonly words: string[];
+  readonly wordOffsets: Float64Array;
+  readonly wordDurations: Float64Array;
+
+  /**
+   * N-best alternatives, best first, with their confidence between 0 and 1
+   * at the same index in `confidences`.
+   */
+  readonly alternatives: string[];
+  readonly confidences: Float64Array;
+}
+
 export interface ITranscriptionResult {
   readonly status: TranscriptionStatusCode;
   readonly data?: string;
+
+  /**
+   * Set for `RECOGNIZED` results when created with `detailed`.
+   */
+  readonly details?: ITranscriptionDetails;
+
+  /**
+   * For transcribers with several models, the name of the model that
+   * recognized the utterance, or failed for `ERROR` results.
+   */
+  readonly model?: string;
+
+  /**
+   * For `RECOGNIZED` results of transcribers with several models, the
+   * confidence of the winning model between 0 and 1.
+   */
+  readonly confidence?: number;
 }
 
 export interface ITranscriptionCallback {
   (error: Error | undefined, result: ITranscriptionResult): void;
 }
 
+/**
+ * @param results All results since the previous call, in order.
+ * @param coalesced How many `RECOGNIZING` results were dropped because a
+ * later one in `results` superseded them.
+ */
+export interface ITranscriptionBatchCallback {
+  (error: Error | undefined, results: ITranscriptionResult[], coalesced: number): void;
+}
+
 export interface ITranscriptionOptions extends IBaseOptions {
   /**
    * A phrase list is a list of words or phrases provided ahead of time to help 
@@ -71,24 +230,361 @@ export interface ITranscriptionOptions extends IBaseOptions {
    * @see https://learn.microsoft.com/en-us/azure/ai-services/speech-service/improve-accuracy-phrase-list
    */
   readonly phrases?: string[];
+
+  /**
+   * Transcribe PCM audio passed to `ITranscriber.pushAudio` instead of
+   * the default microphone.
+   */
+  readonly audioStream?: IAudioStreamOptions;
+
+  /**
+   * Transcribe audio pushed to an audio hub, which other sessions can
+   * read as well. Takes precedence over `audioStream`.
+   */
+  readonly audioHub?: IAudioHub;
+
+  /**
+   * Adds offsets, word timings and N-best confidences to `RECOGNIZED`
+   * results. Detailed transcribers load their own copy of the model.
+   */
+  readonly detailed?: boolean;
 }
 
 export interface ITranscriber {
   start(): void;
   stop(): void;
   dispose(): void;
+
+  /**
+   * Queues PCM audio when created with `audioStream`. The memory is used
+   * without copying, so it must not be modified until it was read.
+   *
+   * @returns `false` if the audio was not queued because too much audio
+   * is waiting to be read, or the transcriber does not take audio.
+   */
+  pushAudio(audio: ArrayBuffer | ArrayBufferView): boolean;
+
+  /**
+   * Timestamps of points in this session, `undefined` once disposed.
+   */
+  getMetrics(): ISessionMetrics | undefined;
+
+  /**
+   * How much audio was held back from the recognizer, `undefined` unless
+   * created with `audioStream.vad`.
+   */
+  getAudioGateStats(): IAudioGateStats | undefined;
+
+  /**
+   * Changes the phrase list without recreating the recognizer. Changes
+   * made during an utterance apply once it ended. Phrases are compared
+   * ignoring case and surrounding whitespace, duplicates are dropped.
+   *
+   * @returns `false` if the transcriber was disposed or has several models.
+   */
+  updatePhrases(update: IPhraseListUpdate): boolean;
+}
+
+export interface IPhraseListUpdate {
+  /**
+   * Removes all phrases, before `remove` and `add` are applied.
+   */
+  readonly clear?: boolean;
+  readonly remove?: string[];
+  readonly add?: string[];
+}
+
+export function createTranscriber({ modelPath, modelName, modelKey, phrases, logsPath, audioStream, audioHub, detailed }: ITranscriptionOptions, callback: ITranscriptionCallback): ITranscriber {
+  const id = speechapi.createTranscriber(modelPath, modelName, modelKey, logsPath ?? undefined, phrases ?? [], { audioStream, audioHub: audioHub?.id, detailed }, callback);
+
+  return {
+    start: () => speechapi.startTranscriber(id),
+    stop: () => speechapi.stopTranscriber(id),
+    dispose: () => speechapi.disposeTranscriber(id),
+    pushAudio: (audio) => speechapi.pushAudio(id, audio),
+    getMetrics: () => speechapi.getSessionMetrics('transcription', id),
+    getAudioGateStats: () => speechapi.getAudioGateStats(id),
+    updatePhrases: ({ add, remove, clear }) => speechapi.updatePhrases(id, add ?? [], remove ?? [], clear ?? false)
+  };
 }
 
-export function createTranscriber({ modelPath, modelName, modelKey, phrases, logsPath }: ITranscriptionOptions, callback: ITranscriptionCallback): ITranscriber {
-  const id = speechapi.createTranscriber(modelPath, modelName, modelKey, logsPath ?? undefined, phrases ?? [], callback);
+/**
+ * Like `createTranscriber`, but results produced while the JS thread is
+ * busy are delivered together in one callback, and only the latest of
+ * consecutive `RECOGNIZING` results is kept. Use this when partial
+ * results arrive faster than they can be handled one by one.
+ */
+export function createBatchedTranscriber({ modelPath, modelName, modelKey, phrases, logsPath, audioStream, audioHub, detailed }: ITranscriptionOptions, callback: ITranscriptionBatchCallback): ITranscriber {
+  const id = speechapi.createTranscriber(modelPath, modelName, modelKey, logsPath ?? undefined, phrases ?? [], { audioStream, audioHub: audioHub?.id, detailed, batch: true }, (error, results, coalesced) => callback(error, results, coalesced ?? 0));
 
   return {
     start: () => speechapi.startTranscriber(id),
     stop: () => speechapi.stopTranscriber(id),
-    dispose: () => speechapi.disposeTranscriber(id)
+    dispose: () => speechapi.disposeTranscriber(id),
+    pushAudio: (audio) => speechapi.pushAudio(id, audio),
+    getMetrics: () => speechapi.getSessionMetrics('transcription', id),
+    getAudioGateStats: () => speechapi.getAudioGateStats(id),
+    updatePhrases: ({ add, remove, clear }) => speechapi.updatePhrases(id, add ?? [], remove ?? [], clear ?? false)
   };
 }
 
+/**
+ * Loads the model ahead of time. With an `audioStream`, this builds a
+ * recognizer and runs it over silence, and the next `createTranscriber`
+ * call with the same options adopts it and starts without paying for the
+ * model load. A recognizer of the microphone would listen while warming
+ * up, so for the microphone only the page cache is warmed: the session
+ * still builds its own recognizer, but reads the model from memory.
+ */
+export function prewarmTranscriber({ modelPath, modelName, modelKey, logsPath, audioStream, detailed }: ITranscriptionOptions): Promise<void> {
+  return new Promise<void>((resolve, reject) => {
+    speechapi.prewarmTranscriber(modelPath, modelName, modelKey, logsPath ?? undefined, { audioStream, detailed }, error => error ? reject(error) : resolve());
+  });
+}
+
+export type ITranscriptionModel = Pick<IBaseOptions, 'modelPath' | 'modelName' | 'modelKey'>;
+
+export interface IMultiModelTranscriptionOptions {
+  /**
+   * The models to transcribe with, e.g. one per language.
+   */
+  readonly models: ITranscriptionModel[];
+  readonly logsPath?: string;
+  readonly phrases?: string[];
+
+  /**
+   * Transcribe audio pushed to an audio hub. Without one, the audio is
+   * passed to `ITranscriber.pushAudio` in this format, as the microphone
+   * can't be shared between models.
+   */
+  readonly audioStream?: Omit<IAudioStreamOptions, 'maxQueuedBytes' | 'vad'>;
+  readonly audioHub?: IAudioHub;
+  readonly detailed?: boolean;
+}
+
+/**
+ * Transcribes one audio stream with several models at once, e.g. for
+ * users speaking more than one language, without capturing and setting
+ * up a transcriber per model. The models run in parallel and every
+ * utterance is reported once, from the model most confident about it,
+ * which is named in `model`. Partial results and speech events come from
+ * the model that won the last utterance.
+ */
+export function createMultiModelTranscriber({ models, logsPath, phrases, audioStream, audioHub, detailed }: IMultiModelTranscriptionOptions, callback: ITranscriptionCallback): ITranscriber {
+  const ownHub = audioHub ? undefined : createAudioHub(audioStream);
+  const hub = audioHub ?? ownHub!;
+  let id: number;
+  try {
+    id = speechapi.createMultiModelTranscriber(models, logsPath ?? undefined, phrases ?? [], { audioHub: hub.id, detailed }, callback);
+  } catch (error) {
+    ownHub?.dispose();
+    throw error;
+  }
+
+  return {
+    start: () => speechapi.startTranscriber(id),
+    stop: () => speechapi.stopTranscriber(id),
+    dispose: () => {
+      speechapi.disposeTranscriber(id);
+      ownHub?.dispose();
+    },
+    pushAudio: (audio) => ownHub ? ownHub.push(audio) : false,
+    getMetrics: () => speechapi.getSessionMetrics('transcription', id),
+    getAudioGateStats: () => undefined,
+    updatePhrases: () => false
+  };
+}
+
+export interface ITranscriptionStreamOptions extends ITranscriptionOptions {
+  /**
+   * How many results may be delivered but not consumed yet. Once reached,
+   * `RECOGNIZING` results are dropped and the recognizer waits for the
+   * consumer to catch up, so `pushAudio` returns `false` until it did.
+   * Defaults to 16.
+   */
+  readonly maxPending?: number;
+}
+
+/**
+ * A transcriber whose results are consumed with `for await`. Iteration
+ * ends once the transcriber is disposed, and leaving the loop early
+ * disposes it.
+ */
+export interface ITranscriptionStream extends ITranscriber, AsyncIterableIterator<ITranscriptionResult> { }
+
+export function createTranscriptionStream({ modelPath, modelName, modelKey, phrases, logsPath, audioStream, audioHub, detailed, maxPending }: ITranscriptionStreamOptions): ITranscriptionStream {
+  const results: ITranscriptionResult[] = [];
+  let failure: Error | undefined;
+  let done = false;
+
+  // Every pending `next` call waits, in the order they were made
+  const waiters: (() => void)[] = [];
+  const wakeAll = () => waiters.splice(0).forEach(wake => wake());
+
+  const id = speechapi.createTranscriber(modelPath, modelName, modelKey, logsPath ?? undefined, phrases ?? [], { audioStream, audioHub: audioHub?.id, detailed, maxPending: maxPending ?? 16 }, (error, result: ITranscriptionResult) => {
+    if (error) {
+      failure = error;
+    } else if (result.status === TranscriptionStatusCode.DISPOSED) {
+      done = true;
+    } else {
+      results.push(result);
+    }
+    wakeAll();
+  });
+
+  const dispose = () => speechapi.disposeTranscriber(id);
+
+  return {
+    start: () => speechapi.startTranscriber(id),
+    stop: () => speechapi.stopTranscriber(id),
+    dispose,
+    pushAudio: (audio) => speechapi.pushAudio(id, audio),
+    getMetrics: () => speechapi.getSessionMetrics('transcription', id),
+    getAudioGateStats: () => speechapi.getAudioGateStats(id),
+    updatePhrases: ({ add, remove, clear }) => speechapi.updatePhrases(id, add ?? [], remove ?? [], clear ?? false),
+
+    async next(): Promise<IteratorResult<ITranscriptionResult>> {
+      while (results.length === 0 && !done && !failure) {
+        await new Promise<void>(resolve => waiters.push(resolve));
+      }
+
+      const result = results.shift();
+      if (result) {
+        speechapi.acknowledgeResults(id, 1);
+        return { value: result, done: false };
+      }
+      if (failure) {
+        const error = failure;
+        failure = undefined;
+        done = true;
+        throw error;
+      }
+      return { value: undefined, done: true };
+    },
+
+    async return(): Promise<IteratorResult<ITranscriptionResult>> {
+      if (!done) {
+        done = true;
+        results.length = 0;
+        dispose();
+        wakeAll();
+      }
+      return { value: undefined, done: true };
+    },
+
+    [Symbol.asyncIterator]() {
+      return this;
+    }
+  };
+}
+
+export interface IFileTranscriptionResult {
+  readonly path: string;
+
+  /**
+   * The recognized text of the whole file, when transcription succeeded.
+   */
+  readonly text?: string;
+  readonly error?: string;
+
+  /**
+   * Duration of the audio in the file in milliseconds, read from its
+   * WAV header.
+   */
+  readonly audioDuration: number;
+
+  /**
+   * Time in milliseconds from starting the file to its result.
+   */
+  readonly processingDuration: number;
+}
+
+export interface IFileTranscriptionStats {
+  /**
+   * Number of files transcribed successfully.
+   */
+  readonly files: number;
+  readonly failed: number;
+
+  /**
+   * Number of recognizers built, each of which loaded the model once.
+   * At most `concurrency`, unless files of different audio formats, or
+   * files after a failed one, needed recognizers of their own.
+   */
+  readonly recognizers: number;
+
+  /**
+   * Total audio duration of the transcribed files in milliseconds.
+   */
+  readonly audioDuration: number;
+
+  /**
+   * Wall clock time of the whole batch in milliseconds.
+   */
+  readonly elapsed: number;
+
+  /**
+   * `elapsed` divided by `audioDuration`, values below 1 are faster
+   * than real time.
+   */
+  readonly realTimeFactor: number;
+  readonly filesPerSecond: number;
+}
+
+export interface IFileTranscriptionOptions extends IBaseOptions {
+  readonly phrases?: string[];
+
+  /**
+   * How many files are transcribed at the same time. Each of them gets a
+   * recognizer that loads the model once and then takes file after file.
+   * Defaults to the number of CPU cores.
+   */
+  readonly concurrency?: number;
+
+  /**
+   * Called for every file as soon as it is done, in completion order.
+   */
+  readonly onResult?: (result: IFileTranscriptionResult) => void;
+
+  /**
+   * Stops the batch. Files that did not complete are not reported, and
+   * the stats only cover the ones that did.
+   */
+  readonly signal?: AbortSignal;
+}
+
+/**
+ * Transcribes PCM WAV files, resolving with throughput stats
+ * once all of them are done.
+ */
+export function transcribeFiles(paths: string[], { modelPath, modelName, modelKey, logsPath, phrases, concurrency, onResult, signal }: IFileTranscriptionOptions): Promise<IFileTranscriptionStats> {
+  return new Promise<IFileTranscriptionStats>((resolve, reject) => {
+    const onAbort = () => speechapi.cancelFileTranscription(id);
+
+    const id = speechapi.transcribeFiles(modelPath, modelName, modelKey, logsPath ?? undefined, phrases ?? [], paths, { concurrency }, (error, result) => {
+      if (error) {
+        signal?.removeEventListener('abort', onAbort);
+        reject(error);
+      } else if (result.status === TranscriptionStatusCode.STOPPED) {
+        signal?.removeEventListener('abort', onAbort);
+        const { files, failed, recognizers, audioDuration, elapsed, realTimeFactor, filesPerSecond } = result;
+        resolve({ files, failed, recognizers, audioDuration, elapsed, realTimeFactor, filesPerSecond });
+      } else {
+        const { path, data, audioDuration, processingDuration } = result;
+        onResult?.(result.status === TranscriptionStatusCode.ERROR
+          ? { path, error: data, audioDuration, processingDuration }
+          : { path, text: data ?? '', audioDuration, processingDuration });
+      }
+    });
+
+    if (signal?.aborted) {
+      onAbort();
+    } else {
+      signal?.addEventListener('abort', onAbort);
+    }
+  });
+}
+
 //#endregion
 
 //#region Synthesis
@@ -97,36 +593,182 @@ export enum SynthesizerStatusCode {
   STARTED = 1,
   STOPPED = 9,
   DISPOSED = 10,
-  ERROR = 11
+  ERROR = 11,
+  SYNTHESIZING = 12,
+
+  /**
+   * An utterance was interrupted or dropped from the queue.
+   */
+  CANCELED = 14
 }
 
 export interface ISynthesizerResult {
   readonly status: SynthesizerStatusCode;
   readonly data?: string;
+
+  /**
+   * A chunk of synthesized audio in `outputFormat`, set for
+   * `SYNTHESIZING` results when the output is `stream`.
+   */
+  readonly audio?: ArrayBuffer;
+
+  /**
+   * For `STOPPED`, `CANCELED` and `ERROR` results, the utterance queued
+   * by `synthesize` they are about. Not set for streamed text.
+   */
+  readonly utterance?: number;
 }
 
 export interface ISynthesizerCallback {
   (error: Error | undefined, result: ISynthesizerResult): void;
 }
 
-export interface ISynthesizerOptions extends IBaseOptions { }
+export interface ISynthesizerOptions extends IBaseOptions {
+  /**
+   * Where synthesized audio goes: `speaker` plays it on the default
+   * speaker, `stream` reports it as `SYNTHESIZING` results instead.
+   * Defaults to `speaker`.
+   */
+  readonly output?: 'speaker' | 'stream';
+
+  /**
+   * The audio format, e.g. `raw-16khz-16bit-mono-pcm`. Defaults to
+   * `riff-24khz-16bit-mono-pcm` for the speaker and
+   * `raw-24khz-16bit-mono-pcm` for streams.
+   *
+   * @see https://learn.microsoft.com/en-us/azure/ai-services/speech-service/rest-text-to-speech#audio-outputs
+   */
+  readonly outputFormat?: string;
+}
+
+export interface ISynthesizeOptions {
+  /**
+   * Queued text with a higher priority is spoken first, text with the
+   * same priority in order. Defaults to 0, the priority of streamed text.
+   */
+  readonly priority?: number;
+
+  /**
+   * Stops the utterance that is playing. Utterances that did not start
+   * yet stay queued unless `flush` is set.
+   */
+  readonly interrupt?: boolean;
+
+  /**
+   * Drops all queued text, including streamed text that was not spoken
+   * yet, before queueing this text.
+   */
+  readonly flush?: boolean;
+
+  /**
+   * The text is SSML, which must have a `<speak>` root. Malformed SSML
+   * throws when queued.
+   */
+  readonly ssml?: boolean;
+
+  /**
+   * Multiplier of the default speaking rate for plain text, between 0.5
+   * and 2. The voice speaks faster or slower, so synthesis and playback
+   * get shorter or longer accordingly.
+   */
+  readonly rate?: number;
+
+  /**
+   * Semitones to raise or lower the pitch of plain text by, between -12
+   * and 12.
+   */
+  readonly pitch?: number;
+
+  /**
+   * Pause after plain text, in milliseconds, at most 5000.
+   */
+  readonly breakMs?: number;
+}
 
 export interface ISynthesizer {
-  synthesize(text: string): void;
+  /**
+   * Queues text to speak. The promise resolves with `true` once it was
+   * spoken, or all of its audio was delivered for the `stream` output,
+   * and with `false` if it was interrupted, dropped or failed, or there
+   * was no text.
+   */
+  synthesize(text: string, options?: ISynthesizeOptions): Promise<boolean>;
+
+  /**
+   * Same as `synthesize` with `ssml` set.
+   */
+  synthesizeSsml(ssml: string, options?: ISynthesizeOptions): Promise<boolean>;
+
+  /**
+   * Adds a chunk of streamed text, e.g. from a language model. Chunks
+   * are collected and each sentence is synthesized as soon as it is
+   * complete, while later chunks keep arriving. Long sentences are cut
+   * at clause boundaries.
+   */
+  appendText(chunk: string): void;
+
+  /**
+   * Synthesizes the text appended since the last complete sentence,
+   * call it at the end of the stream.
+   */
+  flushText(): void;
+
+  /**
+   * Stops speaking and drops all queued text. Text synthesized
+   * afterwards is spoken as usual.
+   */
   stop(): void;
   dispose(): void;
+
+  /**
+   * Timestamps of points in this session, `undefined` once disposed.
+   */
+  getMetrics(): ISessionMetrics | undefined;
 }
 
-export function createSynthesizer({ modelPath, modelName, modelKey, logsPath }: ISynthesizerOptions, callback: ISynthesizerCallback): ISynthesizer {
-  const id = speechapi.createSynthesizer(modelPath, modelName, modelKey, logsPath ?? undefined, callback);
+export function createSynthesizer({ modelPath, modelName, modelKey, logsPath, output, outputFormat }: ISynthesizerOptions, callback: ISynthesizerCallback): ISynthesizer {
+  const utterances = new Map<number, (spoken: boolean) => void>();
+  const id = speechapi.createSynthesizer(modelPath, modelName, modelKey, logsPath ?? undefined, { output, outputFormat }, (error, result) => {
+    if (result?.utterance) {
+      utterances.get(result.utterance)?.(result.status === SynthesizerStatusCode.STOPPED);
+      utterances.delete(result.utterance);
+    } else if (error || result?.status === SynthesizerStatusCode.DISPOSED) {
+      utterances.forEach(resolve => resolve(false));
+      utterances.clear();
+    }
+    callback(error, result);
+  });
+
+  const queue = (text: string, options?: ISynthesizeOptions) => {
+    const utterance = speechapi.synthesize(id, text, options);
+    return utterance ? new Promise<boolean>(resolve => utterances.set(utterance, resolve)) : Promise.resolve(false);
+  };
 
   return {
-    synthesize: (text) => speechapi.synthesize(id, text),
+    synthesize: (text, options) => queue(text, options),
+    synthesizeSsml: (ssml, options) => queue(ssml, { ...options, ssml: true }),
+    appendText: (chunk) => speechapi.appendText(id, chunk),
+    flushText: () => speechapi.appendText(id, '', true),
     stop: () => speechapi.stopSynthesizer(id),
-    dispose: () => speechapi.disposeSynthesizer(id)
+    dispose: () => speechapi.disposeSynthesizer(id),
+    getMetrics: () => speechapi.getSessionMetrics('synthesis', id)
   };
 }
 
+/**
+ * Loads the voice ahead of time. With `output: 'stream'`, this builds a
+ * synthesizer and runs a synthesis on it, and the next `createSynthesizer`
+ * call with the same options adopts it and starts without paying for the
+ * voice load. A synthesizer of the speaker would play the warm-up, so for
+ * the speaker only the page cache is warmed: the session still builds its
+ * own synthesizer, but reads the voice from memory.
+ */
+export function prewarmSynthesizer({ modelPath, modelName, modelKey, logsPath, output, outputFormat }: ISynthesizerOptions): Promise<void> {
+  return new Promise<void>((resolve, reject) => {
+    speechapi.prewarmSynthesizer(modelPath, modelName, modelKey, logsPath ?? undefined, { output, outputFormat }, error => error ? reject(error) : resolve());
+  });
+}
+
 //#endregion
 
 //#region Keyword Recognition
@@ -140,17 +782,50 @@ export enum KeywordRecognitionStatusCode {
 export interface IKeywordRecognitionResult {
   readonly status: KeywordRecognitionStatusCode;
   readonly data?: string;
+
+  /**
+   * For `RECOGNIZED` results, milliseconds from the start of the audio to
+   * the keyword.
+   */
+  readonly offset?: number;
+
+  /**
+   * For `RECOGNIZED` results, how long the keyword took in milliseconds,
+   * so that it ended at `offset + duration`.
+   */
+  readonly duration?: number;
+
+  /**
+   * For `RECOGNIZED` results, when the keyword was detected in
+   * milliseconds since the epoch, like `Date.now()`.
+   */
+  readonly timestamp?: number;
 }
 
 export interface IKeywordRecognitionOptions {
   readonly modelPath: string;
 
+  /**
+   * Listen to a WAV file instead of the default microphone. Recognition
+   * stops at the end of the file.
+   */
+  readonly audioFile?: string;
+
+  /**
+   * Listen to audio pushed to an audio hub instead of the default
+   * microphone.
+   */
+  readonly audioHub?: IAudioHub;
+
   readonly signal: AbortSignal;
 }
 
-export function recognize({ modelPath, signal }: IKeywordRecognitionOptions): Promise<IKeywordRecognitionResult> {
+export function recognize({ modelPath, audioFile, audioHub, signal }: IKeywordRecognitionOptions): Promise<IKeywordRecognitionResult> {
   return new Promise<IKeywordRecognitionResult>((resolve, reject) => {
-    const id = speechapi.recognize(modelPath, (error, result) => {
+    const onAbort = () => speechapi.unrecognize(id);
+
+    const id = speechapi.recognize(modelPath, { audioFile, audioHub: audioHub?.id }, (error, result) => {
+      signal.removeEventListener('abort', onAbort);
       if (error) {
         reject(error);
       } else {
@@ -158,13 +833,330 @@ export function recognize({ modelPath, signal }: IKeywordRecognitionOptions): Pr
       }
     });
 
-    const onAbort = () => {
-      speechapi.unrecognize(id);
+    if (signal.aborted) {
+      onAbort();
+    } else {
+      signal.addEventListener('abort', onAbort);
+    }
+  });
+}
+
+/**
+ * Keeps one keyword recognizer and model armed, calling `onKeyword` for
+ * every detection until `signal` is aborted. Resolves once recognition
+ * stopped, rejects if it failed.
+ */
+export function recognizeContinuously({ modelPath, audioFile, audioHub, signal }: IKeywordRecognitionOptions, onKeyword: (result: IKeywordRecognitionResult) => void): Promise<void> {
+  return new Promise<void>((resolve, reject) => {
+    let failure: Error | undefined;
+    const onAbort = () => speechapi.unrecognize(id);
+
+    const id = speechapi.recognize(modelPath, { continuous: true, audioFile, audioHub: audioHub?.id }, (error, result) => {
+      if (error) {
+        failure = error;
+      } else if (result.status === KeywordRecognitionStatusCode.RECOGNIZED) {
+        onKeyword(result);
+        return;
+      } else if (result.status === KeywordRecognitionStatusCode.ERROR) {
+        failure = new Error(result.data);
+        return;
+      }
+
       signal.removeEventListener('abort', onAbort);
-    };
+      failure ? reject(failure) : resolve();
+    });
 
-    signal.addEventListener('abort', onAbort);
+    if (signal.aborted) {
+      onAbort();
+    } else {
+      signal.addEventListener('abort', onAbort);
+    }
   });
 }
 
+export interface IKeywordTranscriptionOptions extends IBaseOptions {
+  readonly keywordModelPath: string;
+  readonly phrases?: string[];
+}
+
+export interface IKeywordTranscriber {
+  dispose(): void;
+
+  /**
+   * Timestamps of points in this session, `undefined` once disposed.
+   * `keyword.handOff` in the latency histograms is the time from the
+   * keyword to transcribing the utterance after it.
+   */
+  getMetrics(): ISessionMetrics | undefined;
+}
+
+/**
+ * Listens for the keyword on the microphone and transcribes the utterance
+ * following it, then listens for the keyword again. The recognizer is
+ * loaded up front and fed the audio of the keyword recognition from the
+ * end of the keyword on, so speech right after the keyword is not lost
+ * and the keyword itself is not transcribed.
+ */
+export function createKeywordTranscriber({ keywordModelPath, modelPath, modelName, modelKey, logsPath, phrases }: IKeywordTranscriptionOptions, callback: ITranscriptionCallback): IKeywordTranscriber {
+  const id = speechapi.createKeywordTranscriber(keywordModelPath, modelPath, modelName, modelKey, logsPath ?? undefined, phrases ?? [], callback);
+
+  return {
+    dispose: () => speechapi.unrecognize(id),
+    getMetrics: () => speechapi.getSessionMetrics('keyword', id)
+  };
+}
+
+//#endregion
+
+//#region Sessions
+
+/**
+ * Transcribers, synthesizers and keyword recognizers are driven by a fixed
+ * pool of native threads that only run a session while it has work to do,
+ * so idle sessions do not occupy a thread. Defaults to the number of CPU
+ * cores, but at least 4.
+ */
+export function setSessionThreadCount(count: number): void {
+  speechapi.setSessionThreadCount(count);
+}
+
+export function getSessionThreadCount(): number {
+  return speechapi.getSessionThreadCount();
+}
+
+//#endregion
+
+//#region Metrics
+
+/**
+ * Milliseconds since the session was created, by point, for example
+ * `configCreated`, `started`, `firstRecognizing`, `recognized`,
+ * `lastSend` and `lastDelivery`. Later occurrences of a point replace
+ * earlier ones.
+ */
+export interface ISessionMetrics {
+  readonly [point: string]: number;
+}
+
+/**
+ * Percentiles in milliseconds over the most recent samples.
+ */
+export interface ILatencySummary {
+  readonly count: number;
+  readonly p50: number;
+  readonly p95: number;
+  readonly p99: number;
+  readonly max: number;
+}
+
+/**
+ * Latencies of all sessions by `<kind>.<metric>`, for example
+ * `transcription.firstPartial`, `transcription.speechEndToFinal`,
+ * `synthesis.firstAudio`, `keyword.rearm` or `transcription.delivery`,
+ * which is the time from sending a result to handling it in JS.
+ */
+export function getLatencyHistograms(): Record<string, ILatencySummary> {
+  return speechapi.getLatencyHistograms();
+}
+
+export function resetLatencyHistograms(): void {
+  speechapi.resetLatencyHistograms();
+}
+
+//#endregion
+
+//#region Audio Hubs
+
+export interface IAudioHubOptions {
+  readonly samplesPerSecond?: number;
+  readonly bitsPerSample?: number;
+  readonly channels?: number;
+
+  /**
+   * How much audio is kept for readers that fall behind, defaults to
+   * 2000 ms. Readers further behind skip ahead and drop audio.
+   */
+  readonly capacityMs?: number;
+}
+
+export interface IAudioHubReaderStats {
+  /**
+   * The kind of session reading, `transcription` or `keyword`.
+   */
+  readonly name: string;
+
+  /**
+   * Duration of the audio pushed but not read yet.
+   */
+  readonly lagMs: number;
+
+  /**
+   * Duration of the audio skipped because the reader fell too far behind.
+   */
+  readonly droppedMs: number;
+}
+
+export interface IAudioHubStats {
+  readonly pushedMs: number;
+  readonly capacityMs: number;
+  readonly readers: IAudioHubReaderStats[];
+}
+
+export interface IAudioHub {
+  readonly id: number;
+
+  /**
+   * Passes PCM audio on to every session reading from the hub. The audio
+   * is copied, so the memory can be reused right away.
+   *
+   * @returns `false` once the hub was disposed.
+   */
+  push(audio: ArrayBuffer | ArrayBufferView): boolean;
+
+  getStats(): IAudioHubStats | undefined;
+
+  /**
+   * Ends the audio of all sessions reading from the hub once they read
+   * what was pushed.
+   */
+  dispose(): void;
+}
+
+/**
+ * Shares one capture, e.g. from the microphone, between transcribers and
+ * keyword recognizers, which then read it through the `audioHub` option
+ * instead of each opening the microphone.
+ */
+export function createAudioHub({ samplesPerSecond, bitsPerSample, channels, capacityMs }: IAudioHubOptions = {}): IAudioHub {
+  samplesPerSecond ??= 16000;
+  bitsPerSample ??= 16;
+  channels ??= 1;
+  // Whole sample frames, like the addon converts durations
+  const frameSize = bitsPerSample / 8 * channels;
+  const id = speechapi.createAudioHub(samplesPerSecond, bitsPerSample, channels, Math.ceil((capacityMs ?? 2000) * samplesPerSecond / 1000) * frameSize);
+
+  return {
+    id,
+    push: (audio) => speechapi.pushAudioHub(id, audio),
+    getStats: () => speechapi.getAudioHubStats(id),
+    dispose: () => speechapi.disposeAudioHub(id)
+  };
+}
+
+//#endregion
+
+//#region Speech Config Cache
+
+export interface ISpeechConfigCacheStats {
+  /**
+   * Number of sessions that reused a recognizer or synthesizer with its
+   * model loaded, built by prewarming or left by a disposed session.
+   */
+  readonly hits: number;
+
+  /**
+   * Number of sessions that had to build a recognizer or synthesizer,
+   * loading the model.
+   */
+  readonly misses: number;
+
+  /**
+   * Number of speech configs, recognizers and synthesizers dropped after
+   * being idle.
+   */
+  readonly evictions: number;
+
+  /**
+   * Number of speech configs currently cached.
+   */
+  readonly entries: number;
+
+  /**
+   * Number of idle recognizers and synthesizers currently kept.
+   */
+  readonly instances: number;
+}
+
+/**
+ * Transcribers and synthesizers created with the same model options share
+ * one speech config. A disposed session leaves its recognizer or
+ * synthesizer behind, with the model loaded, and the next session with the
+ * same options reuses it. Recognizers and synthesizers are kept for a while
+ * after they were left, and configs for a while after their last session
+ * or kept instance. Sessions reading from an audio hub, and sessions that
+ * failed, always build their own. Use `prewarmTranscriber` or
+ * `prewarmSynthesizer` to load a model ahead of the first session.
+ */
+export function getSpeechConfigCacheStats(): ISpeechConfigCacheStats {
+  return speechapi.getSpeechConfigCacheStats();
+}
+
+/**
+ * How long a speech config, recognizer or synthesizer is kept once it is
+ * no longer used. Defaults to 5 minutes, 0 drops them immediately.
+ */
+export function setSpeechConfigCacheIdleTimeout(idleTimeoutMs: number): void {
+  speechapi.setSpeechConfigCacheIdleTimeout(idleTimeoutMs);
+}
+
+//#endregion
+
+//#region Synthesis Cache
+
+export interface ISynthesisCacheOptions {
+  /**
+   * How many bytes of audio are kept in memory, least recently used
+   * audio is dropped first. 0 disables the cache, which is the default.
+   */
+  readonly maxBytes: number;
+
+  /**
+   * A directory to also write audio to, which is read back when audio is
+   * not in memory, e.g. after a restart. It must exist and is not
+   * limited by `maxBytes`.
+   */
+  readonly directory?: string;
+}
+
+export interface ISynthesisCacheStats {
+  /**
+   * Number of utterances served from memory.
+   */
+  readonly hits: number;
+
+  /**
+   * Number of utterances served from `directory`.
+   */
+  readonly diskHits: number;
+
+  /**
+   * Number of utterances that had to be synthesized.
+   */
+  readonly misses: number;
+
+  /**
+   * Share of utterances served from the cache, between 0 and 1.
+   */
+  readonly hitRate: number;
+
+  readonly evictions: number;
+  readonly entries: number;
+  readonly bytes: number;
+  readonly maxBytes: number;
+}
+
+/**
+ * Caches the audio of synthesizers with `output: 'stream'` by voice,
+ * output format and text, so that repeated phrases are returned right away
+ * without being synthesized again. Cached audio arrives in one
+ * SYNTHESIZING result.
+ */
+export function configureSynthesisCache({ maxBytes, directory }: ISynthesisCacheOptions): void {
+  speechapi.configureSynthesisCache(maxBytes, directory ?? undefined);
+}
+
+export function getSynthesisCacheStats(): ISynthesisCacheStats {
+  return speechapi.getSynthesisCacheStats();
+}
+
 //#endregion
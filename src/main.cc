@@ -6,10 +6,37 @@
 #include <napi.h>
 #include <speechapi_cxx.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
 #include <queue>
 #include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace Microsoft::CognitiveServices::Speech;
 using namespace Microsoft::CognitiveServices::Speech::Audio;
@@ -26,7 +53,10 @@ enum StatusCode
   SPEECH_END_DETECTED = 8,
   STOPPED = 9,
   DISPOSED = 10,
-  ERROR = 11
+  ERROR = 11,
+  SYNTHESIZING = 12,
+  KEYWORD_RECOGNIZED = 13,
+  CANCELED = 14
 };
 
 enum RuntimeStatus
@@ -36,235 +66,7062 @@ enum RuntimeStatus
   DISPOSE = 3
 };
 
-#pragma region Transcription
+// Command channel between the JS thread and a worker. Commands wake the
+// worker immediately instead of being picked up by polling. Polling never
+// takes a lock: the latest status is stored before the command is
+// counted, so a poll that sees a command also sees its status.
+class WorkerControl
+{
+public:
+  virtual ~WorkerControl() = default;
 
-static int transcriptionWorkerIds = 0;
-static std::unordered_map<int, RuntimeStatus> transcriptionWorkers;
-static std::mutex transcriptionWorkersMutex;
+  void Post(RuntimeStatus status)
+  {
+    this->status.store(status);
+    this->commands.fetch_add(1);
 
-void UpdateTranscriptionWorkerStatus(int workerId, RuntimeStatus status)
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->Wake();
+  }
+
+  // Returns the latest status if a command newer than `seen` was posted.
+  // Commands posted in between are coalesced, and a status posted during
+  // the poll may be returned again by the next one.
+  bool Poll(uint64_t &seen, RuntimeStatus &status) const
+  {
+    auto commands = this->commands.load();
+    if (commands == seen)
+    {
+      return false;
+    }
+    seen = commands;
+    status = this->status.load();
+    return true;
+  }
+
+  RuntimeStatus Status() const
+  {
+    return this->status.load();
+  }
+
+  // `wake` is called whenever the worker has something to do, until it
+  // is detached.
+  void Attach(const std::function<void()> &wake)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->wake = wake;
+  }
+
+  void Detach()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->wake = nullptr;
+  }
+
+protected:
+  // Guards `wake`, and the state of derived controls
+  std::mutex mutex;
+
+  // Must be called with `mutex` held.
+  void Wake()
+  {
+    if (this->wake)
+    {
+      this->wake();
+    }
+  }
+
+private:
+  std::atomic<uint64_t> commands{0};
+  std::atomic<RuntimeStatus> status{RuntimeStatus::START};
+  std::function<void()> wake;
+};
+
+#pragma region AddonData
+
+// Property names used for every result delivered to JS, created once per
+// environment instead of once per result. Results are always built through
+// CreateResult so that they share one property order, and thereby one
+// object shape.
+class AddonData
+{
+public:
+  explicit AddonData(Napi::Env env)
+      : statusKey(Napi::Persistent(Napi::String::New(env, "status"))),
+        dataKey(Napi::Persistent(Napi::String::New(env, "data"))),
+        audioKey(Napi::Persistent(Napi::String::New(env, "audio"))),
+        utteranceKey(Napi::Persistent(Napi::String::New(env, "utterance")))
+  {
+  }
+
+  static AddonData &Get(Napi::Env env)
+  {
+    return *env.GetInstanceData<AddonData>();
+  }
+
+  Napi::Object CreateResult(Napi::Env env, StatusCode status, const std::string &data = "") const
+  {
+    auto jsResult = Napi::Object::New(env);
+    jsResult.Set(this->statusKey.Value(), Napi::Number::New(env, status));
+    if (!data.empty())
+    {
+      jsResult.Set(this->dataKey.Value(), Napi::String::New(env, data));
+    }
+
+    return jsResult;
+  }
+
+  void SetAudio(Napi::Object jsResult, Napi::Value audio) const
+  {
+    jsResult.Set(this->audioKey.Value(), audio);
+  }
+
+  void SetUtterance(Napi::Env env, Napi::Object jsResult, uint32_t utterance) const
+  {
+    jsResult.Set(this->utteranceKey.Value(), Napi::Number::New(env, utterance));
+  }
+
+private:
+  Napi::Reference<Napi::String> statusKey;
+  Napi::Reference<Napi::String> dataKey;
+  Napi::Reference<Napi::String> audioKey;
+  Napi::Reference<Napi::String> utteranceKey;
+};
+
+#ifdef NODE_SPEECH_TEST_HOOKS
+
+// Builds results the way it was done before property names were cached,
+// or through AddonData, and hands them to `callback` one by one, so that
+// the difference can be measured without a model.
+Napi::Value BenchmarkResults(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 3)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber() || !info[2].IsFunction())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto count = info[0].As<Napi::Number>().Uint32Value();
+  bool cached = info[1].ToBoolean();
+  auto callback = info[2].As<Napi::Function>();
+  const auto &addonData = AddonData::Get(env);
+  const std::string data = "the quick brown fox";
+
+  for (uint32_t i = 0; i < count; i++)
+  {
+    Napi::HandleScope scope(env);
+
+    Napi::Object jsResult;
+    if (cached)
+    {
+      jsResult = addonData.CreateResult(env, StatusCode::RECOGNIZING, data);
+    }
+    else
+    {
+      jsResult = Napi::Object::New(env);
+      jsResult.Set("status", Napi::Number::New(env, StatusCode::RECOGNIZING));
+      jsResult.Set("data", Napi::String::New(env, data));
+    }
+
+    callback.Call({env.Undefined(), jsResult});
+  }
+
+  return env.Undefined();
+}
+
+#endif
+
+#pragma endregion
+
+#pragma region Metrics
+
+// Recent latency samples per metric across all sessions, to report
+// percentiles from.
+class LatencyHistograms
+{
+public:
+  struct Summary
+  {
+    uint64_t count;
+    double p50;
+    double p95;
+    double p99;
+    double max;
+  };
+
+  static LatencyHistograms &Instance()
+  {
+    static LatencyHistograms instance;
+    return instance;
+  }
+
+  void Record(const std::string &name, double ms)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto &samples = this->metrics[name];
+    samples.count++;
+    if (samples.recent.size() < MaxSamples)
+    {
+      samples.recent.push_back(ms);
+    }
+    else
+    {
+      samples.recent[(samples.count - 1) % MaxSamples] = ms;
+    }
+  }
+
+  std::vector<std::pair<std::string, Summary>> Summarize()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::vector<std::pair<std::string, Summary>> summaries;
+    for (const auto &metric : this->metrics)
+    {
+      auto sorted = metric.second.recent;
+      std::sort(sorted.begin(), sorted.end());
+      auto percentile = [&sorted](double p)
+      {
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+      };
+      summaries.emplace_back(metric.first, Summary{metric.second.count, percentile(0.5), percentile(0.95), percentile(0.99), sorted.back()});
+    }
+    return summaries;
+  }
+
+  void Reset()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->metrics.clear();
+  }
+
+private:
+  // Percentiles are taken over the most recent samples only
+  static const size_t MaxSamples = 2048;
+
+  struct Samples
+  {
+    uint64_t count = 0;
+    std::vector<double> recent;
+  };
+
+  std::mutex mutex;
+  std::map<std::string, Samples> metrics;
+};
+
+// Monotonic timestamps of points in one session, in milliseconds since the
+// session was created. Durations between points are recorded as samples
+// of `<kind>.<name>` in the global histograms.
+class SessionMetrics
+{
+public:
+  explicit SessionMetrics(const std::string &kind) : kind(kind), created(std::chrono::steady_clock::now())
+  {
+    this->Mark("created");
+  }
+
+  void Mark(const std::string &point)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->points[point] = this->Elapsed(std::chrono::steady_clock::now());
+  }
+
+  // Returns whether the point was not marked before
+  bool MarkFirst(const std::string &point)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->points.emplace(point, this->Elapsed(std::chrono::steady_clock::now())).second;
+  }
+
+  void Clear(const std::string &point)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->points.erase(point);
+  }
+
+  // Records the time from `from` until now, if `from` was marked
+  void Measure(const std::string &name, const std::string &from)
+  {
+    double duration;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      auto point = this->points.find(from);
+      if (point == this->points.end())
+      {
+        return;
+      }
+      duration = this->Elapsed(std::chrono::steady_clock::now()) - point->second;
+    }
+    LatencyHistograms::Instance().Record(this->kind + "." + name, duration);
+  }
+
+  // Progress sent at `sent` reached JS
+  void Delivered(std::chrono::steady_clock::time_point sent)
+  {
+    auto now = std::chrono::steady_clock::now();
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->points["lastDelivery"] = this->Elapsed(now);
+    }
+    LatencyHistograms::Instance().Record(this->kind + ".delivery", std::chrono::duration<double, std::milli>(now - sent).count());
+  }
+
+  std::vector<std::pair<std::string, double>> Snapshot()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return std::vector<std::pair<std::string, double>>(this->points.begin(), this->points.end());
+  }
+
+private:
+  const std::string kind;
+  const std::chrono::steady_clock::time_point created;
+  std::mutex mutex;
+  std::map<std::string, double> points;
+
+  double Elapsed(std::chrono::steady_clock::time_point time) const
+  {
+    return std::chrono::duration<double, std::milli>(time - this->created).count();
+  }
+};
+
+// Metrics of live sessions by kind and id, ids are only unique per kind.
+static std::map<std::pair<std::string, int>, std::shared_ptr<SessionMetrics>> sessionMetrics;
+static std::mutex sessionMetricsMutex;
+
+std::shared_ptr<SessionMetrics> AddSessionMetrics(const std::string &kind, int id)
 {
-  std::lock_guard<std::mutex> lock(transcriptionWorkersMutex);
-  transcriptionWorkers[workerId] = status;
+  std::lock_guard<std::mutex> lock(sessionMetricsMutex);
+  auto metrics = std::make_shared<SessionMetrics>(kind);
+  sessionMetrics[{kind, id}] = metrics;
+  return metrics;
 }
 
-void RemoveTranscriptionWorkerStatus(int workerId)
+void RemoveSessionMetrics(const std::string &kind, int id)
 {
-  std::lock_guard<std::mutex> lock(transcriptionWorkersMutex);
-  transcriptionWorkers.erase(workerId);
+  std::lock_guard<std::mutex> lock(sessionMetricsMutex);
+  sessionMetrics.erase({kind, id});
 }
 
-RuntimeStatus GetTranscriptionWorkerStatus(int workerId)
+Napi::Value GetSessionMetrics(const Napi::CallbackInfo &info)
 {
-  std::lock_guard<std::mutex> lock(transcriptionWorkersMutex);
-  auto it = transcriptionWorkers.find(workerId);
-  if (it != transcriptionWorkers.end())
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 2)
   {
-    return it->second;
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
   }
-  else
+  else if (!info[0].IsString() || !info[1].IsNumber())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  std::shared_ptr<SessionMetrics> metrics;
+  {
+    std::lock_guard<std::mutex> lock(sessionMetricsMutex);
+    auto it = sessionMetrics.find({info[0].As<Napi::String>().Utf8Value(), info[1].As<Napi::Number>().Int32Value()});
+    if (it == sessionMetrics.end())
+    {
+      return env.Undefined();
+    }
+    metrics = it->second;
+  }
+
+  auto jsMetrics = Napi::Object::New(env);
+  for (const auto &point : metrics->Snapshot())
   {
-    return RuntimeStatus::DISPOSE;
+    jsMetrics.Set(point.first, Napi::Number::New(env, point.second));
   }
+
+  return jsMetrics;
 }
 
-struct TranscriptionWorkerCallbackResult
+Napi::Value GetLatencyHistograms(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  auto jsHistograms = Napi::Object::New(env);
+  for (const auto &metric : LatencyHistograms::Instance().Summarize())
+  {
+    auto jsSummary = Napi::Object::New(env);
+    jsSummary.Set("count", Napi::Number::New(env, static_cast<double>(metric.second.count)));
+    jsSummary.Set("p50", Napi::Number::New(env, metric.second.p50));
+    jsSummary.Set("p95", Napi::Number::New(env, metric.second.p95));
+    jsSummary.Set("p99", Napi::Number::New(env, metric.second.p99));
+    jsSummary.Set("max", Napi::Number::New(env, metric.second.max));
+    jsHistograms.Set(metric.first, jsSummary);
+  }
+
+  return jsHistograms;
+}
+
+Napi::Value ResetLatencyHistograms(const Napi::CallbackInfo &info)
+{
+  LatencyHistograms::Instance().Reset();
+
+  return info.Env().Undefined();
+}
+
+#pragma endregion
+
+#pragma region Sessions
+
+// Controls of all running sessions, reached by handle. A handle names a
+// slot and the generation of the session in it, so looking a session up
+// is an index and a compare, and handles of disposed sessions never reach
+// the session that reuses their slot. Handles only have room for 15 bits
+// of generation, so a slot is retired instead of reused once they run out,
+// which leaves room for 2^31 sessions. Adding, looking up and removing
+// sessions take no lock, so commands for one session never wait for
+// another one being created or disposed.
+class SessionRegistry
+{
+public:
+  static SessionRegistry &Instance()
+  {
+    // Leaked as detached threads may still reference it during shutdown
+    static auto *instance = new SessionRegistry();
+    return *instance;
+  }
+
+  int Add(std::shared_ptr<WorkerControl> control)
+  {
+    auto index = this->Allocate();
+    auto &slot = this->At(index);
+    slot.control = std::move(control);
+    auto generation = slot.generation.load() + 1;
+    slot.generation.store(generation);
+    this->size++;
+    return static_cast<int>((generation >> 1) << IndexBits | index);
+  }
+
+  // Returns the control of the session, or null if it was removed or is
+  // of another kind.
+  template <typename T = WorkerControl>
+  std::shared_ptr<T> Get(int handle)
+  {
+    auto *slot = this->Find(handle);
+    if (!slot)
+    {
+      return nullptr;
+    }
+
+    std::shared_ptr<WorkerControl> control;
+    slot->readers++;
+    if (Matches(slot->generation.load(), handle))
+    {
+      control = slot->control;
+    }
+    slot->readers--;
+    return std::dynamic_pointer_cast<T>(control);
+  }
+
+  // Removes the session and returns its control, or null if it was
+  // already removed or is of another kind.
+  template <typename T = WorkerControl>
+  std::shared_ptr<T> Remove(int handle)
+  {
+    auto control = this->Get<T>(handle);
+    if (!control)
+    {
+      return nullptr;
+    }
+
+    auto *slot = this->Find(handle);
+    auto generation = slot->generation.load();
+    if (!Matches(generation, handle) || !slot->generation.compare_exchange_strong(generation, generation + 1))
+    {
+      return nullptr;
+    }
+
+    // Lookups that saw the old generation are copying the control
+    while (slot->readers.load() != 0)
+    {
+      std::this_thread::yield();
+    }
+    slot->control.reset();
+    this->size--;
+    if ((generation >> 1) < MaxGeneration)
+    {
+      this->Free(static_cast<uint32_t>(handle) & IndexMask);
+    }
+    return control;
+  }
+
+  size_t Size() const
+  {
+    return this->size.load();
+  }
+
+private:
+  static constexpr uint32_t IndexBits = 16;
+  static constexpr uint32_t IndexMask = (1u << IndexBits) - 1;
+  static constexpr uint32_t MaxGeneration = 0x7FFF;
+  static constexpr uint32_t SegmentBits = 10;
+  static constexpr uint32_t SegmentSize = 1u << SegmentBits;
+  static constexpr uint32_t Segments = (IndexMask + 1) / SegmentSize;
+
+  struct Slot
+  {
+    // Odd while a session occupies the slot
+    std::atomic<uint32_t> generation{0};
+    std::atomic<uint32_t> readers{0};
+    // Next free slot plus one, 0 at the end of the free list
+    std::atomic<uint32_t> next{0};
+    std::shared_ptr<WorkerControl> control;
+  };
+
+  SessionRegistry() = default;
+
+  Slot &At(uint32_t index)
+  {
+    return this->segments[index >> SegmentBits].load()[index & (SegmentSize - 1)];
+  }
+
+  Slot *Find(int handle)
+  {
+    if (handle < 0)
+    {
+      return nullptr;
+    }
+    auto index = static_cast<uint32_t>(handle) & IndexMask;
+    if (index >= this->allocated.load())
+    {
+      return nullptr;
+    }
+    auto *segment = this->segments[index >> SegmentBits].load();
+    return segment ? &segment[index & (SegmentSize - 1)] : nullptr;
+  }
+
+  // Whether a slot of `generation` is occupied by the session of `handle`.
+  static bool Matches(uint32_t generation, int handle)
+  {
+    return (generation & 1) && (generation >> 1) == static_cast<uint32_t>(handle) >> IndexBits;
+  }
+
+  uint32_t Allocate()
+  {
+    // The tag in the upper half of the head guards against ABA
+    auto head = this->freeList.load();
+    while ((head & 0xFFFFFFFF) != 0)
+    {
+      auto index = static_cast<uint32_t>(head & 0xFFFFFFFF) - 1;
+      auto next = this->At(index).next.load();
+      if (this->freeList.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | next))
+      {
+        return index;
+      }
+    }
+
+    auto index = this->allocated.load();
+    do
+    {
+      if (index > IndexMask)
+      {
+        throw std::runtime_error("Too many sessions");
+      }
+    } while (!this->allocated.compare_exchange_weak(index, index + 1));
+
+    auto &segment = this->segments[index >> SegmentBits];
+    if (!segment.load())
+    {
+      auto *slots = new Slot[SegmentSize];
+      Slot *expected = nullptr;
+      if (!segment.compare_exchange_strong(expected, slots))
+      {
+        delete[] slots;
+      }
+    }
+    return index;
+  }
+
+  void Free(uint32_t index)
+  {
+    auto &slot = this->At(index);
+    auto head = this->freeList.load();
+    do
+    {
+      slot.next.store(static_cast<uint32_t>(head & 0xFFFFFFFF));
+    } while (!this->freeList.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | (index + 1)));
+  }
+
+  std::atomic<Slot *> segments[Segments] = {};
+  std::atomic<uint32_t> allocated{0};
+  std::atomic<uint64_t> freeList{0};
+  std::atomic<size_t> size{0};
+};
+
+#ifdef NODE_SPEECH_TEST_HOOKS
+
+// Adds, looks up and removes `sessionsPerThread` sessions on each of
+// `threads` threads at once, each thread keeping a few of its sessions
+// alive while others are added, and reports lookups that went wrong. The
+// first handle each thread removes is looked up again after every removal,
+// so that it is caught if it ever reaches a session that reused its slot.
+Napi::Value StressSessionRegistry(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 2)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber() || !info[1].IsNumber())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto threadCount = std::max<uint32_t>(1, info[0].As<Napi::Number>().Uint32Value());
+  auto sessionsPerThread = info[1].As<Napi::Number>().Uint32Value();
+  const size_t window = 16;
+
+  auto &registry = SessionRegistry::Instance();
+  auto before = registry.Size();
+  std::atomic<uint64_t> created{0};
+  std::atomic<uint64_t> removed{0};
+  std::atomic<uint64_t> failedLookups{0};
+  std::atomic<uint64_t> staleLookups{0};
+  std::atomic<uint64_t> errors{0};
+  std::atomic<int> shared{-1};
+
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < threadCount; t++)
+  {
+    threads.emplace_back([&]
+                         {
+      std::deque<std::pair<int, std::shared_ptr<WorkerControl>>> live;
+      auto firstRemoved = -1;
+      auto remove = [&]
+      {
+        auto session = live.front();
+        live.pop_front();
+        if (registry.Remove(session.first) == session.second)
+        {
+          removed++;
+        }
+        else
+        {
+          failedLookups++;
+        }
+        if (firstRemoved < 0)
+        {
+          firstRemoved = session.first;
+        }
+        if (registry.Get(session.first) || registry.Get(firstRemoved))
+        {
+          staleLookups++;
+        }
+      };
+
+      try
+      {
+        for (uint32_t i = 0; i < sessionsPerThread; i++)
+        {
+          auto control = std::make_shared<WorkerControl>();
+          auto handle = registry.Add(control);
+          created++;
+          if (registry.Get(handle) != control)
+          {
+            failedLookups++;
+          }
+
+          // Race lookups and commands against sessions of other threads
+          auto other = shared.exchange(handle);
+          if (auto otherControl = registry.Get(other))
+          {
+            otherControl->Post(RuntimeStatus::START);
+          }
+
+          live.emplace_back(handle, control);
+          if (live.size() > window)
+          {
+            remove();
+          }
+        }
+      }
+      catch (const std::exception &)
+      {
+        errors++;
+      }
+      while (!live.empty())
+      {
+        remove();
+      } });
+  }
+  for (auto &thread : threads)
+  {
+    thread.join();
+  }
+
+  auto stats = Napi::Object::New(env);
+  stats.Set("created", Napi::Number::New(env, static_cast<double>(created.load())));
+  stats.Set("removed", Napi::Number::New(env, static_cast<double>(removed.load())));
+  stats.Set("failedLookups", Napi::Number::New(env, static_cast<double>(failedLookups.load())));
+  stats.Set("staleLookups", Napi::Number::New(env, static_cast<double>(staleLookups.load())));
+  stats.Set("errors", Napi::Number::New(env, static_cast<double>(errors.load())));
+  stats.Set("remaining", Napi::Number::New(env, static_cast<double>(registry.Size()) - static_cast<double>(before)));
+  return stats;
+}
+
+#endif
+
+// Fixed size pool of native threads that run the workers of long-lived
+// sessions. Workers are only scheduled when they have something to do, so
+// idle sessions don't hold a thread, and sessions don't take threads away
+// from the libuv threadpool.
+class SessionExecutor
+{
+public:
+  static SessionExecutor &Instance()
+  {
+    // Leaked as detached threads may still reference it during shutdown
+    static auto *instance = new SessionExecutor(std::max<size_t>(4, std::thread::hardware_concurrency()));
+    return *instance;
+  }
+
+  void Post(std::function<void()> task)
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->tasks.push(std::move(task));
+    }
+    this->available.notify_one();
+  }
+
+  size_t GetSize()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->size;
+  }
+
+  // Threads beyond `size` exit once they finished their current task.
+  void SetSize(size_t size)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->size = std::max<size_t>(size, 1);
+    while (this->threads < this->size)
+    {
+      this->threads++;
+      std::thread([this]
+                  { this->Work(); })
+          .detach();
+    }
+    this->available.notify_all();
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable available;
+  std::queue<std::function<void()>> tasks;
+  size_t size = 0;
+  size_t threads = 0;
+
+  explicit SessionExecutor(size_t size)
+  {
+    this->SetSize(size);
+  }
+
+  void Work()
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true)
+    {
+      this->available.wait(lock, [this]
+                           { return !this->tasks.empty() || this->threads > this->size; });
+      if (this->threads > this->size)
+      {
+        this->threads--;
+        return;
+      }
+
+      auto task = std::move(this->tasks.front());
+      this->tasks.pop();
+      lock.unlock();
+      task();
+      lock.lock();
+    }
+  }
+};
+
+// What happens to a result sent while JS holds as many unacknowledged
+// results as it allows.
+enum class Backpressure
+{
+  // Sent anyway
+  SEND,
+  // The sending thread waits until JS acknowledged results
+  WAIT,
+  // Dropped, a later result covers it
+  DROP
+};
+
+// Bounds the results of a session that were sent to JS but not consumed
+// yet, including the ones JS buffered itself. Results are consumed when
+// JS acknowledges them, so a slow consumer makes the threads sending
+// results wait, instead of results queueing up without limit.
+class ResultCredits
+{
+public:
+  explicit ResultCredits(size_t maxPending) : maxPending(std::max<size_t>(maxPending, 1))
+  {
+  }
+
+  // Returns false if the results must be dropped.
+  bool Acquire(size_t count, Backpressure backpressure)
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if (backpressure == Backpressure::WAIT)
+    {
+      this->condition.wait(lock, [this]
+                           { return !this->blocking || this->pending < this->maxPending; });
+    }
+    else if (backpressure == Backpressure::DROP && this->pending >= this->maxPending)
+    {
+      this->dropped += count;
+      return false;
+    }
+    this->pending += count;
+    return true;
+  }
+
+  void Release(size_t count)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->pending -= std::min(count, this->pending);
+    this->condition.notify_all();
+  }
+
+  // While not blocking, e.g. when the session is stopping, results that
+  // would wait are sent right away.
+  void SetBlocking(bool blocking)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->blocking = blocking;
+    this->condition.notify_all();
+  }
+
+  size_t Dropped()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->dropped;
+  }
+
+private:
+  const size_t maxPending;
+  std::mutex mutex;
+  std::condition_variable condition;
+  size_t pending = 0;
+  size_t dropped = 0;
+  bool blocking = true;
+};
+
+// Base for the workers of long-lived sessions, with the same shape as
+// Napi::AsyncProgressQueueWorker. Instead of running Execute once on a
+// libuv thread for the whole session, Execute runs on the SessionExecutor
+// every time the worker is scheduled and returns whether the session is
+// still running. Progress reaches the JS thread through a thread-safe
+// function, followed by OnOK (or OnError) once the session is done, after
+// which the worker deletes itself.
+template <class T>
+class SessionWorker
+{
+public:
+  class ExecutionProgress
+  {
+  public:
+    explicit ExecutionProgress(SessionWorker *worker) : worker(worker) {}
+
+    void Send(const T *data, size_t count) const
+    {
+      this->worker->SendProgress(data, count);
+    }
+
+  private:
+    SessionWorker *worker;
+  };
+
+  virtual ~SessionWorker() {}
+
+  void Queue()
+  {
+    this->tsfn = Napi::ThreadSafeFunction::New(this->env, this->callback.Value(), this->name, 0, 1);
+    this->Schedule();
+  }
+
+  // Progress sent until the next turn of the JS loop is delivered through
+  // one OnBatch call instead of one call per result, with results
+  // superseded by a later one dropped. Must be set before Queue.
+  void SetBatched(bool batched)
+  {
+    this->batched = batched;
+  }
+
+  // Progress then waits for, or is dropped when JS fell behind, see
+  // `GetBackpressure`. Does not apply to batched progress.
+  void SetCredits(const std::shared_ptr<ResultCredits> &credits)
+  {
+    this->credits = credits;
+  }
+
+  // Progress delivered to JS is then timed from being sent
+  void SetMetrics(const std::shared_ptr<SessionMetrics> &metrics)
+  {
+    this->deliveryMetrics = metrics;
+  }
+
+  // Runs Execute on the executor. Runs of one worker never overlap, and a
+  // schedule during a run makes it run again.
+  void Schedule()
+  {
+    this->pending = true;
+    if (!this->scheduled.exchange(true))
+    {
+      SessionExecutor::Instance().Post([this]
+                                       { this->Run(); });
+    }
+  }
+
+protected:
+  explicit SessionWorker(const Napi::Function &callback, const char *name)
+      : env(callback.Env()), callback(Napi::Persistent(callback)), name(name), progress(this)
+  {
+  }
+
+  // Must not schedule the worker anymore once it returned false.
+  virtual bool Execute(const ExecutionProgress &progress) = 0;
+  virtual void OnProgress(const T *data, size_t count) = 0;
+  virtual void OnOK() = 0;
+  virtual void OnError(const Napi::Error &e) = 0;
+
+  // Whether `next` makes `previous` obsolete when both wait in one batch
+  virtual bool Supersedes(const T & /* next */, const T & /* previous */) const
+  {
+    return false;
+  }
+
+  // How `result` is sent when JS fell behind. Only results sent from SDK
+  // threads may wait, so that commands keep being handled.
+  virtual Backpressure GetBackpressure(const T & /* result */) const
+  {
+    return Backpressure::SEND;
+  }
+
+  // `coalesced` counts the results dropped from this batch
+  virtual void OnBatch(const T *data, size_t count, size_t /* coalesced */)
+  {
+    this->OnProgress(data, count);
+  }
+
+  Napi::Env Env() const
+  {
+    return this->env;
+  }
+
+  Napi::FunctionReference &Callback()
+  {
+    return this->callback;
+  }
+
+  void SetError(const std::string &error)
+  {
+    this->error = error;
+  }
+
+private:
+  Napi::Env env;
+  Napi::FunctionReference callback;
+  const char *name;
+  const ExecutionProgress progress;
+  Napi::ThreadSafeFunction tsfn;
+  std::atomic<bool> scheduled{false};
+  std::atomic<bool> pending{false};
+  std::string error;
+  bool batched = false;
+  std::mutex batchMutex;
+  std::vector<T> batch;
+  size_t batchCoalesced = 0;
+  bool batchQueued = false;
+  std::chrono::steady_clock::time_point batchSent;
+  std::shared_ptr<SessionMetrics> deliveryMetrics;
+  std::shared_ptr<ResultCredits> credits;
+
+  void Run()
+  {
+    bool running;
+    do
+    {
+      this->pending = false;
+      running = this->Execute(this->progress);
+    } while (running && this->pending);
+
+    if (!running)
+    {
+      this->Finish();
+      return;
+    }
+
+    // A schedule racing with this saw `scheduled` still set
+    this->scheduled = false;
+    if (this->pending && !this->scheduled.exchange(true))
+    {
+      SessionExecutor::Instance().Post([this]
+                                       { this->Run(); });
+    }
+  }
+
+  void SendProgress(const T *data, size_t count)
+  {
+    if (this->deliveryMetrics)
+    {
+      this->deliveryMetrics->Mark("lastSend");
+    }
+
+    if (this->batched)
+    {
+      this->SendBatchedProgress(data, count);
+      return;
+    }
+    if (this->credits && !this->credits->Acquire(count, this->GetBackpressure(data[0])))
+    {
+      return;
+    }
+
+    auto *results = new std::vector<T>(data, data + count);
+    auto sent = std::chrono::steady_clock::now();
+    auto status = this->tsfn.NonBlockingCall(results, [this, sent](Napi::Env /* env */, Napi::Function /* callback */, std::vector<T> *results)
+                                             {
+      if (this->deliveryMetrics)
+      {
+        this->deliveryMetrics->Delivered(sent);
+      }
+      this->OnProgress(results->data(), results->size());
+      delete results; });
+    if (status != napi_ok)
+    {
+      delete results;
+    }
+  }
+
+  void SendBatchedProgress(const T *data, size_t count)
+  {
+    std::lock_guard<std::mutex> lock(this->batchMutex);
+    if (this->batch.empty())
+    {
+      this->batchSent = std::chrono::steady_clock::now();
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+      if (!this->batch.empty() && this->Supersedes(data[i], this->batch.back()))
+      {
+        this->batch.back() = data[i];
+        this->batchCoalesced++;
+      }
+      else
+      {
+        this->batch.push_back(data[i]);
+      }
+    }
+
+    // The queued call picks up everything added until it runs
+    if (this->batchQueued)
+    {
+      return;
+    }
+    auto status = this->tsfn.NonBlockingCall(this, [](Napi::Env /* env */, Napi::Function /* callback */, SessionWorker *worker)
+                                             { worker->FlushBatch(); });
+    this->batchQueued = status == napi_ok;
+  }
+
+  void FlushBatch()
+  {
+    std::vector<T> results;
+    size_t coalesced;
+    std::chrono::steady_clock::time_point sent;
+    {
+      std::lock_guard<std::mutex> lock(this->batchMutex);
+      results.swap(this->batch);
+      coalesced = this->batchCoalesced;
+      sent = this->batchSent;
+      this->batchCoalesced = 0;
+      this->batchQueued = false;
+    }
+
+    if (!results.empty())
+    {
+      if (this->deliveryMetrics)
+      {
+        this->deliveryMetrics->Delivered(sent);
+      }
+      this->OnBatch(results.data(), results.size(), coalesced);
+    }
+  }
+
+  // The worker is deleted on the JS thread, after all progress was delivered.
+  void Finish()
+  {
+    auto tsfn = this->tsfn;
+    tsfn.NonBlockingCall(this, [](Napi::Env env, Napi::Function /* callback */, SessionWorker *worker)
+                         {
+      if (worker->error.empty())
+      {
+        worker->OnOK();
+      }
+      else
+      {
+        worker->OnError(Napi::Error::New(env, worker->error));
+      }
+      delete worker; });
+    tsfn.Release();
+  }
+};
+
+Napi::Value SetSessionThreadCount(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() < 1)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  SessionExecutor::Instance().SetSize(info[0].As<Napi::Number>().Uint32Value());
+
+  return env.Undefined();
+}
+
+Napi::Value GetSessionThreadCount(const Napi::CallbackInfo &info)
+{
+  return Napi::Number::New(info.Env(), static_cast<double>(SessionExecutor::Instance().GetSize()));
+}
+
+#pragma endregion
+
+#pragma region AudioInput
+
+// Bytes of `ms` of PCM audio, rounded up to whole sample frames, since
+// rates like 44.1 kHz have no whole number of bytes per millisecond.
+// createAudioHub in index.ts sizes hubs the same way.
+uint64_t PcmBytes(uint32_t samplesPerSecond, uint32_t bitsPerSample, uint32_t channels, double ms)
+{
+  auto frameSize = static_cast<uint64_t>(bitsPerSample / 8 * channels);
+  return static_cast<uint64_t>(std::ceil(samplesPerSecond * ms / 1000)) * frameSize;
+}
+
+// Milliseconds of `bytes` of PCM audio.
+double PcmMs(uint32_t samplesPerSecond, uint32_t bitsPerSample, uint32_t channels, uint64_t bytes)
+{
+  auto bytesPerSecond = static_cast<double>(samplesPerSecond) * (bitsPerSample / 8 * channels);
+  return bytesPerSecond > 0 ? bytes * 1000 / bytesPerSecond : 0;
+}
+
+// Energy based voice activity detection for pushed audio. While nothing is
+// said, audio is held back from the recognizer, which then has nothing to
+// run inference on.
+struct AudioGateOptions
+{
+  bool enabled = false;
+
+  // Level a 10 ms frame must exceed to count as speech, in dBFS
+  double thresholdDb = -45;
+
+  // Audio before speech that is still passed on, so that onsets are not
+  // clipped
+  uint32_t preRollMs = 300;
+
+  // Audio after speech that is still passed on, so that the recognizer
+  // sees the silence that ends an utterance
+  uint32_t hangoverMs = 1000;
+};
+
+struct AudioGateStats
+{
+  uint64_t pushedBytes;
+  uint64_t gatedBytes;
+  uint64_t openings;
+  bool open;
+};
+
+// Audio pushed from JS for a worker, read by the SDK through a pull stream.
+// Chunks keep a reference to the JS buffer instead of copying it, and the
+// SDK copies straight out of it when it reads. Read chunks must release
+// their reference on the JS thread, so they are parked until the next
+// push or progress callback.
+class AudioInputQueue
+{
+public:
+  const uint32_t samplesPerSecond;
+  const uint8_t bitsPerSample;
+  const uint8_t channels;
+
+  AudioInputQueue(uint32_t samplesPerSecond, uint8_t bitsPerSample, uint8_t channels, size_t capacity, const AudioGateOptions &gate = AudioGateOptions())
+      : samplesPerSecond(samplesPerSecond), bitsPerSample(bitsPerSample), channels(channels), capacity(capacity), gate(gate)
+  {
+    // Only 16 bit PCM is inspected
+    this->gate.enabled = gate.enabled && bitsPerSample == 16 && channels > 0;
+  }
+
+  // Returns false without queuing when `capacity` bytes are already
+  // waiting to be read. The buffer must not be modified or transferred
+  // until it was read.
+  bool Push(const Napi::Object &buffer, const uint8_t *data, size_t size)
+  {
+    this->ReleaseDrained();
+
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (this->closed || (this->queued > 0 && this->queued + size > this->capacity))
+      {
+        return false;
+      }
+      this->chunks.push_back(AudioChunk{Napi::Persistent(buffer), data, size});
+      this->queued += size;
+      this->pushedBytes += size;
+    }
+    this->available.notify_one();
+    return true;
+  }
+
+  // Called by the SDK. Blocks until audio is available and returns 0 (end
+  // of stream) once closed and drained.
+  int Read(uint8_t *buffer, uint32_t size)
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true)
+    {
+      this->available.wait(lock, [this]
+                           { return this->closed || this->interrupted || this->priming > 0 || !this->chunks.empty(); });
+      if (this->gate.enabled)
+      {
+        this->Gate();
+      }
+      if (this->closed || this->interrupted || this->priming > 0 || !this->chunks.empty())
+      {
+        break;
+      }
+    }
+
+    // Silence of a warm-up goes before any pushed audio
+    if (this->priming > 0)
+    {
+      auto count = std::min<size_t>(size, this->priming);
+      std::memset(buffer, 0, count);
+      this->priming -= count;
+      if (this->priming == 0)
+      {
+        this->primed.notify_all();
+      }
+      return static_cast<int>(count);
+    }
+
+    // Hand out silence so that a pending read does not hold up stopping
+    // the recognizer.
+    if (this->interrupted && this->chunks.empty() && !this->closed)
+    {
+      this->interrupted = false;
+      std::memset(buffer, 0, size);
+      return static_cast<int>(size);
+    }
+    this->interrupted = false;
+
+    size_t read = 0;
+    while (read < size && !this->chunks.empty())
+    {
+      auto &chunk = this->chunks.front();
+      auto count = std::min<size_t>(size - read, chunk.size - this->offset);
+      std::memcpy(buffer + read, chunk.data + this->offset, count);
+      read += count;
+      this->offset += count;
+      this->queued -= count;
+
+      if (this->offset == chunk.size)
+      {
+        this->drained.push_back(std::move(chunk));
+        this->chunks.pop_front();
+        this->offset = 0;
+
+        // A read can span chunks, each of which must pass the gate
+        if (this->gate.enabled)
+        {
+          this->Gate();
+        }
+      }
+    }
+    return static_cast<int>(read);
+  }
+
+  // Wakes up a pending read before the recognizer is stopped.
+  void Interrupt()
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->interrupted = true;
+    }
+    this->available.notify_all();
+  }
+
+  void Close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->closed = true;
+    }
+    this->available.notify_all();
+    this->primed.notify_all();
+  }
+
+  // Hands `bytes` of silence to the next reads, so that a recognizer can
+  // warm up on the stream before any audio is pushed.
+  void Prime(size_t bytes)
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->priming = bytes;
+    }
+    this->available.notify_all();
+  }
+
+  // Waits until the silence handed to Prime was read.
+  void WaitPrimed(std::chrono::milliseconds timeout)
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->primed.wait_for(lock, timeout, [this]
+                          { return this->closed || this->priming == 0; });
+  }
+
+  // Must be called on the JS thread.
+  void ReleaseDrained()
+  {
+    std::vector<AudioChunk> released;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      released.swap(this->drained);
+    }
+  }
+
+  // Must be called on the JS thread, after the SDK stopped reading.
+  void ReleaseAll()
+  {
+    std::vector<AudioChunk> released;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      released.swap(this->drained);
+      for (auto &chunk : this->chunks)
+      {
+        released.push_back(std::move(chunk));
+      }
+      for (auto &chunk : this->preRoll)
+      {
+        released.push_back(std::move(chunk));
+      }
+      this->chunks.clear();
+      this->preRoll.clear();
+      this->preRollSize = 0;
+      this->queued = 0;
+      this->offset = 0;
+    }
+  }
+
+  // Must be called on the JS thread, after ReleaseAll. Readies the stream
+  // of a recognizer that is kept for another session.
+  void Reset()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->interrupted = false;
+    this->priming = 0;
+    this->open = false;
+    this->hangover = 0;
+    this->pushedBytes = 0;
+    this->gatedBytes = 0;
+    this->openings = 0;
+  }
+
+  // Identifies the stream options, for matching prewarmed recognizers.
+  std::string Describe() const
+  {
+    auto description = std::to_string(this->samplesPerSecond) + "/" + std::to_string(this->bitsPerSample) + "/" + std::to_string(this->channels) + "/" + std::to_string(this->capacity);
+    if (this->gate.enabled)
+    {
+      description += "/gate:" + std::to_string(this->gate.thresholdDb) + "/" + std::to_string(this->gate.preRollMs) + "/" + std::to_string(this->gate.hangoverMs);
+    }
+    return description;
+  }
+
+  bool IsGated() const
+  {
+    return this->gate.enabled;
+  }
+
+  AudioGateStats GetGateStats()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return AudioGateStats{this->pushedBytes, this->gatedBytes, this->openings, this->open};
+  }
+
+  std::shared_ptr<AudioConfig> CreateAudioConfig(const std::shared_ptr<AudioInputQueue> &self)
+  {
+    auto format = AudioStreamFormat::GetWaveFormatPCM(this->samplesPerSecond, this->bitsPerSample, this->channels);
+    auto stream = AudioInputStream::CreatePullStream(format, [self](uint8_t *buffer, uint32_t size)
+                                                     { return self->Read(buffer, size); });
+    return AudioConfig::FromStreamInput(stream);
+  }
+
+private:
+  struct AudioChunk
+  {
+    Napi::ObjectReference buffer;
+    const uint8_t *data;
+    size_t size;
+
+    // Set by the gate, -1 until the chunk was inspected
+    int8_t voiced = -1;
+  };
+
+  const size_t capacity;
+  AudioGateOptions gate;
+  std::deque<AudioChunk> preRoll;
+  size_t preRollSize = 0;
+  size_t hangover = 0;
+  bool open = false;
+  uint64_t pushedBytes = 0;
+  uint64_t gatedBytes = 0;
+  uint64_t openings = 0;
+  std::mutex mutex;
+  std::condition_variable available;
+  std::condition_variable primed;
+  std::deque<AudioChunk> chunks;
+  std::vector<AudioChunk> drained;
+  size_t queued = 0;
+  size_t offset = 0;
+  size_t priming = 0;
+  bool interrupted = false;
+  bool closed = false;
+
+  // Must be called with `mutex` held. Inspects chunks as they reach the
+  // front of the queue and, while the gate is closed, moves silent ones to
+  // the pre-roll, where the oldest are dropped.
+  void Gate()
+  {
+    while (!this->chunks.empty() && this->offset == 0 && this->chunks.front().voiced < 0)
+    {
+      auto &chunk = this->chunks.front();
+      chunk.voiced = this->IsVoiced(chunk.data, chunk.size) ? 1 : 0;
+      if (chunk.voiced)
+      {
+        this->hangover = static_cast<size_t>(PcmBytes(this->samplesPerSecond, this->bitsPerSample, this->channels, this->gate.hangoverMs));
+        if (!this->open)
+        {
+          this->open = true;
+          this->openings++;
+          while (!this->preRoll.empty())
+          {
+            this->gatedBytes -= this->preRoll.back().size;
+            this->queued += this->preRoll.back().size;
+            this->chunks.push_front(std::move(this->preRoll.back()));
+            this->preRoll.pop_back();
+          }
+          this->preRollSize = 0;
+        }
+        return;
+      }
+
+      if (this->open)
+      {
+        // The last chunk of the hangover still goes through
+        this->hangover -= std::min(this->hangover, chunk.size);
+        this->open = this->hangover > 0;
+        return;
+      }
+
+      this->queued -= chunk.size;
+      this->gatedBytes += chunk.size;
+      this->preRollSize += chunk.size;
+      this->preRoll.push_back(std::move(chunk));
+      this->chunks.pop_front();
+
+      auto preRollLimit = static_cast<size_t>(PcmBytes(this->samplesPerSecond, this->bitsPerSample, this->channels, this->gate.preRollMs));
+      while (!this->preRoll.empty() && this->preRollSize - this->preRoll.front().size >= preRollLimit)
+      {
+        this->preRollSize -= this->preRoll.front().size;
+        this->drained.push_back(std::move(this->preRoll.front()));
+        this->preRoll.pop_front();
+      }
+    }
+  }
+
+  // Whether any 10 ms frame of 16 bit PCM is louder than the threshold.
+  bool IsVoiced(const uint8_t *data, size_t size) const
+  {
+    auto threshold = 32768.0 * std::pow(10.0, this->gate.thresholdDb / 20);
+    auto frameSamples = std::max<size_t>(this->samplesPerSecond / 100 * this->channels, 1);
+    auto samples = size / 2;
+    for (size_t start = 0; start < samples; start += frameSamples)
+    {
+      auto end = std::min(start + frameSamples, samples);
+      double energy = 0;
+      for (size_t i = start; i < end; i++)
+      {
+        // Pushed buffers are not necessarily aligned
+        auto sample = static_cast<int16_t>(data[2 * i] | (data[2 * i + 1] << 8));
+        energy += static_cast<double>(sample) * sample;
+      }
+      if (energy / (end - start) > threshold * threshold)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+// Parses the `audioStream` option shared by the create bindings. Returns
+// nullptr when audio should come from the default microphone.
+std::shared_ptr<AudioInputQueue> CreateAudioInputQueue(const Napi::Object &options)
+{
+  auto value = options.Get("audioStream");
+  if (value.IsUndefined() || value.IsNull())
+  {
+    return nullptr;
+  }
+
+  auto audioStream = value.As<Napi::Object>();
+  auto samplesPerSecond = audioStream.Get("samplesPerSecond");
+  auto bitsPerSample = audioStream.Get("bitsPerSample");
+  auto channels = audioStream.Get("channels");
+  auto maxQueuedBytes = audioStream.Get("maxQueuedBytes");
+
+  // `vad` is either true or an object with the gate options
+  AudioGateOptions gate;
+  auto vad = audioStream.Get("vad");
+  if (vad.IsObject())
+  {
+    auto vadOptions = vad.As<Napi::Object>();
+    gate.enabled = true;
+    if (vadOptions.Get("thresholdDb").IsNumber())
+    {
+      gate.thresholdDb = vadOptions.Get("thresholdDb").As<Napi::Number>().DoubleValue();
+    }
+    if (vadOptions.Get("preRollMs").IsNumber())
+    {
+      gate.preRollMs = vadOptions.Get("preRollMs").As<Napi::Number>().Uint32Value();
+    }
+    if (vadOptions.Get("hangoverMs").IsNumber())
+    {
+      gate.hangoverMs = vadOptions.Get("hangoverMs").As<Napi::Number>().Uint32Value();
+    }
+  }
+  else
+  {
+    gate.enabled = vad.ToBoolean();
+  }
+
+  return std::make_shared<AudioInputQueue>(
+      samplesPerSecond.IsNumber() ? samplesPerSecond.As<Napi::Number>().Uint32Value() : 16000,
+      static_cast<uint8_t>(bitsPerSample.IsNumber() ? bitsPerSample.As<Napi::Number>().Uint32Value() : 16),
+      static_cast<uint8_t>(channels.IsNumber() ? channels.As<Napi::Number>().Uint32Value() : 1),
+      maxQueuedBytes.IsNumber() ? static_cast<size_t>(maxQueuedBytes.As<Napi::Number>().Int64Value()) : 1024 * 1024,
+      gate);
+}
+
+#ifdef NODE_SPEECH_TEST_HOOKS
+
+// Pushes `buffers` into a stream with `audioStream` options, reads them
+// back `readSize` bytes at a time as the SDK would, and returns the gate
+// stats with the samples that were passed on, one per run of equal
+// samples.
+Napi::Value TestAudioGate(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 3)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsObject() || !info[1].IsArray() || !info[2].IsNumber())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto options = Napi::Object::New(env);
+  options.Set("audioStream", info[0]);
+  auto buffers = info[1].As<Napi::Array>();
+  auto readSize = std::max<uint32_t>(info[2].As<Napi::Number>().Uint32Value(), 2);
+  auto audioInput = CreateAudioInputQueue(options);
+
+  for (uint32_t i = 0; i < buffers.Length(); i++)
+  {
+    auto value = buffers.Get(i);
+    if (!value.IsBuffer())
+    {
+      audioInput->ReleaseAll();
+      Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    auto buffer = value.As<Napi::Buffer<uint8_t>>();
+    audioInput->Push(buffer, buffer.Data(), buffer.Length());
+  }
+  audioInput->Close();
+
+  std::vector<uint8_t> audio;
+  std::vector<uint8_t> chunk(readSize);
+  int read;
+  while ((read = audioInput->Read(chunk.data(), readSize)) > 0)
+  {
+    audio.insert(audio.end(), chunk.begin(), chunk.begin() + read);
+  }
+  audioInput->ReleaseAll();
+
+  auto samples = Napi::Array::New(env);
+  for (size_t i = 0; i + 1 < audio.size(); i += 2)
+  {
+    auto sample = static_cast<int16_t>(audio[i] | (audio[i + 1] << 8));
+    if (i == 0 || sample != static_cast<int16_t>(audio[i - 2] | (audio[i - 1] << 8)))
+    {
+      samples.Set(samples.Length(), Napi::Number::New(env, sample));
+    }
+  }
+
+  auto stats = audioInput->GetGateStats();
+  auto jsResult = Napi::Object::New(env);
+  jsResult.Set("samples", samples);
+  jsResult.Set("readBytes", Napi::Number::New(env, static_cast<double>(audio.size())));
+  jsResult.Set("pushedBytes", Napi::Number::New(env, static_cast<double>(stats.pushedBytes)));
+  jsResult.Set("gatedBytes", Napi::Number::New(env, static_cast<double>(stats.gatedBytes)));
+  jsResult.Set("openings", Napi::Number::New(env, static_cast<double>(stats.openings)));
+  jsResult.Set("open", Napi::Boolean::New(env, stats.open));
+  return jsResult;
+}
+
+#endif
+
+#pragma endregion
+
+#pragma region AudioHub
+
+// PCM audio pushed from JS once and read by any number of recognizers,
+// e.g. a transcriber and a keyword recognizer sharing one microphone
+// capture. Audio is copied into a ring buffer that the producer never
+// waits on. Readers that fall more than the ring behind skip ahead, and
+// the skipped audio is counted as dropped.
+class AudioHub
+{
+public:
+  const uint32_t samplesPerSecond;
+  const uint8_t bitsPerSample;
+  const uint8_t channels;
+  const size_t capacity;
+
+  AudioHub(uint32_t samplesPerSecond, uint8_t bitsPerSample, uint8_t channels, size_t capacity)
+      : samplesPerSecond(samplesPerSecond), bitsPerSample(bitsPerSample), channels(channels), capacity(std::max<size_t>(capacity, 1)), ring(this->capacity)
+  {
+  }
+
+  // Must only be called from one thread at a time.
+  void Push(const uint8_t *data, size_t size)
+  {
+    auto position = this->written.load(std::memory_order_relaxed);
+    auto end = position + size;
+
+    // Only the last `capacity` bytes can be kept
+    if (size > this->capacity)
+    {
+      data += size - this->capacity;
+      position = end - this->capacity;
+      size = this->capacity;
+    }
+
+    // Readers check `reserved` after copying, to detect that what they
+    // copied was overwritten meanwhile.
+    this->reserved.store(end, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    auto offset = static_cast<size_t>(position % this->capacity);
+    auto first = std::min(size, this->capacity - offset);
+    std::memcpy(this->ring.data() + offset, data, first);
+    std::memcpy(this->ring.data(), data + first, size - first);
+    this->written.store(end, std::memory_order_release);
+
+    this->Notify();
+  }
+
+  uint64_t Written() const
+  {
+    return this->written.load(std::memory_order_acquire);
+  }
+
+  // Copies `size` bytes from `position`, returns false if they were
+  // overwritten while being copied.
+  bool Copy(uint64_t position, uint8_t *buffer, size_t size) const
+  {
+    auto offset = static_cast<size_t>(position % this->capacity);
+    auto first = std::min(size, this->capacity - offset);
+    std::memcpy(buffer, this->ring.data() + offset, first);
+    std::memcpy(buffer + first, this->ring.data(), size - first);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return this->reserved.load(std::memory_order_relaxed) - position <= this->capacity;
+  }
+
+  // Blocks until more than `seen` bytes were written, the hub was closed
+  // or `stop` returns true.
+  void Wait(uint64_t seen, const std::function<bool()> &stop)
+  {
+    std::unique_lock<std::mutex> lock(this->waitMutex);
+    this->available.wait(lock, [&]
+                         { return this->Written() != seen || this->closed || stop(); });
+  }
+
+  // Wakes up waiting readers, e.g. after they were interrupted.
+  void Notify()
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->waitMutex);
+    }
+    this->available.notify_all();
+  }
+
+  void Close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->waitMutex);
+      this->closed = true;
+    }
+    this->available.notify_all();
+  }
+
+  bool IsClosed()
+  {
+    std::lock_guard<std::mutex> lock(this->waitMutex);
+    return this->closed;
+  }
+
+private:
+  std::vector<uint8_t> ring;
+  std::atomic<uint64_t> written{0};
+  std::atomic<uint64_t> reserved{0};
+  std::mutex waitMutex;
+  std::condition_variable available;
+  bool closed = false;
+};
+
+// One recognizer's position in an AudioHub, read by the SDK through a pull
+// stream. Reading starts at the audio pushed after the reader was created.
+class AudioHubReader
+{
+public:
+  const std::string name;
+
+  AudioHubReader(const std::shared_ptr<AudioHub> &hub, const std::string &name)
+      : name(name), hub(hub), position(hub->Written())
+  {
+  }
+
+  // Called by the SDK. Blocks until audio is available and returns 0 (end
+  // of stream) once the reader or the hub was closed.
+  int Read(uint8_t *buffer, uint32_t size)
+  {
+    while (true)
+    {
+      if (this->closed)
+      {
+        return 0;
+      }
+
+      auto position = this->position.load();
+      auto written = this->hub->Written();
+      if (written > position)
+      {
+        if (written - position > this->hub->capacity)
+        {
+          this->dropped += written - this->hub->capacity - position;
+          position = written - this->hub->capacity;
+        }
+        auto count = static_cast<size_t>(std::min<uint64_t>(size, written - position));
+        if (!this->hub->Copy(position, buffer, count))
+        {
+          // Overwritten while copying, skip ahead on the next attempt
+          this->position = position;
+          continue;
+        }
+        this->position = position + count;
+        return static_cast<int>(count);
+      }
+
+      // Hand out silence so that a pending read does not hold up stopping
+      // the recognizer.
+      if (this->interrupted.exchange(false))
+      {
+        std::memset(buffer, 0, size);
+        return static_cast<int>(size);
+      }
+      if (this->hub->IsClosed())
+      {
+        return 0;
+      }
+
+      this->hub->Wait(written, [this]
+                      { return this->closed || this->interrupted; });
+    }
+  }
+
+  // Wakes up a pending read before the recognizer is stopped.
+  void Interrupt()
+  {
+    this->interrupted = true;
+    this->hub->Notify();
+  }
+
+  void Close()
+  {
+    this->closed = true;
+    this->hub->Notify();
+  }
+
+  // Bytes pushed to the hub that were not read yet.
+  uint64_t Lag() const
+  {
+    auto written = this->hub->Written();
+    auto position = this->position.load();
+    return written > position ? written - position : 0;
+  }
+
+  uint64_t Dropped() const
+  {
+    return this->dropped;
+  }
+
+  std::shared_ptr<AudioConfig> CreateAudioConfig(const std::shared_ptr<AudioHubReader> &self)
+  {
+    auto format = AudioStreamFormat::GetWaveFormatPCM(this->hub->samplesPerSecond, this->hub->bitsPerSample, this->hub->channels);
+    auto stream = AudioInputStream::CreatePullStream(format, [self](uint8_t *buffer, uint32_t size)
+                                                     { return self->Read(buffer, size); });
+    return AudioConfig::FromStreamInput(stream);
+  }
+
+private:
+  const std::shared_ptr<AudioHub> hub;
+  std::atomic<uint64_t> position;
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<bool> interrupted{false};
+  std::atomic<bool> closed{false};
+};
+
+struct AudioHubEntry
+{
+  std::shared_ptr<AudioHub> hub;
+  std::vector<std::weak_ptr<AudioHubReader>> readers;
+};
+
+static int audioHubIds = 0;
+static std::unordered_map<int, AudioHubEntry> audioHubs;
+static std::mutex audioHubsMutex;
+
+std::shared_ptr<AudioHub> GetAudioHub(int hubId)
+{
+  std::lock_guard<std::mutex> lock(audioHubsMutex);
+  auto it = audioHubs.find(hubId);
+  return it != audioHubs.end() ? it->second.hub : nullptr;
+}
+
+// Parses the `audioHub` option of the create bindings. Returns nullptr when
+// audio does not come from a hub.
+std::shared_ptr<AudioHubReader> CreateAudioHubReader(const Napi::Object &options, const std::string &name)
+{
+  auto value = options.Get("audioHub");
+  if (!value.IsNumber())
+  {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(audioHubsMutex);
+  auto it = audioHubs.find(value.As<Napi::Number>().Int32Value());
+  if (it == audioHubs.end())
+  {
+    throw std::invalid_argument("Unknown audio hub");
+  }
+
+  auto &readers = it->second.readers;
+  readers.erase(std::remove_if(readers.begin(), readers.end(), [](const std::weak_ptr<AudioHubReader> &reader)
+                               { return reader.expired(); }),
+                readers.end());
+  auto reader = std::make_shared<AudioHubReader>(it->second.hub, name);
+  readers.push_back(reader);
+  return reader;
+}
+
+Napi::Value CreateAudioHub(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 4)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber() || !info[1].IsNumber() || !info[2].IsNumber() || !info[3].IsNumber())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto samplesPerSecond = info[0].As<Napi::Number>().Uint32Value();
+  auto bitsPerSample = static_cast<uint8_t>(info[1].As<Napi::Number>().Uint32Value());
+  auto channels = static_cast<uint8_t>(info[2].As<Napi::Number>().Uint32Value());
+  auto capacity = static_cast<size_t>(std::max<int64_t>(info[3].As<Napi::Number>().Int64Value(), 1));
+
+  std::lock_guard<std::mutex> lock(audioHubsMutex);
+  auto hubId = audioHubIds++;
+  audioHubs[hubId] = AudioHubEntry{std::make_shared<AudioHub>(samplesPerSecond, bitsPerSample, channels, capacity), {}};
+  return Napi::Number::New(env, hubId);
+}
+
+Napi::Value PushAudioHub(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() < 2)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber() || (!info[1].IsArrayBuffer() && !info[1].IsTypedArray()))
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto hub = GetAudioHub(info[0].As<Napi::Number>().Int32Value());
+  if (!hub || hub->IsClosed())
+  {
+    return Napi::Boolean::New(env, false);
+  }
+
+  // Copied into the ring, so the caller may reuse the buffer right away
+  if (info[1].IsArrayBuffer())
+  {
+    auto buffer = info[1].As<Napi::ArrayBuffer>();
+    hub->Push(static_cast<const uint8_t *>(buffer.Data()), buffer.ByteLength());
+  }
+  else
+  {
+    auto view = info[1].As<Napi::TypedArray>();
+    hub->Push(static_cast<const uint8_t *>(view.ArrayBuffer().Data()) + view.ByteOffset(), view.ByteLength());
+  }
+  return Napi::Boolean::New(env, true);
+}
+
+Napi::Value GetAudioHubStats(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() < 1)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  std::lock_guard<std::mutex> lock(audioHubsMutex);
+  auto it = audioHubs.find(info[0].As<Napi::Number>().Int32Value());
+  if (it == audioHubs.end())
+  {
+    return env.Undefined();
+  }
+
+  auto &hub = it->second.hub;
+  auto jsReaders = Napi::Array::New(env);
+  for (const auto &weakReader : it->second.readers)
+  {
+    auto reader = weakReader.lock();
+    if (!reader)
+    {
+      continue;
+    }
+    auto jsReader = Napi::Object::New(env);
+    jsReader.Set("name", Napi::String::New(env, reader->name));
+    jsReader.Set("lagMs", Napi::Number::New(env, PcmMs(hub->samplesPerSecond, hub->bitsPerSample, hub->channels, reader->Lag())));
+    jsReader.Set("droppedMs", Napi::Number::New(env, PcmMs(hub->samplesPerSecond, hub->bitsPerSample, hub->channels, reader->Dropped())));
+    jsReaders.Set(jsReaders.Length(), jsReader);
+  }
+
+  auto jsResult = Napi::Object::New(env);
+  jsResult.Set("pushedMs", Napi::Number::New(env, PcmMs(hub->samplesPerSecond, hub->bitsPerSample, hub->channels, hub->Written())));
+  jsResult.Set("capacityMs", Napi::Number::New(env, PcmMs(hub->samplesPerSecond, hub->bitsPerSample, hub->channels, hub->capacity)));
+  jsResult.Set("readers", jsReaders);
+  return jsResult;
+}
+
+// Ends the streams of all readers once they read what was pushed.
+Napi::Value DisposeAudioHub(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() < 1)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  std::lock_guard<std::mutex> lock(audioHubsMutex);
+  auto it = audioHubs.find(info[0].As<Napi::Number>().Int32Value());
+  if (it != audioHubs.end())
+  {
+    it->second.hub->Close();
+    audioHubs.erase(it);
+  }
+  return env.Undefined();
+}
+
+#pragma endregion
+
+#pragma region SpeechConfigCache
+
+// Process wide cache of speech configs, keyed by everything that is applied
+// to a config when it is created. Workers share one config per key instead
+// of building their own. The cache also keeps the recognizers and
+// synthesizers built from them, with their model loaded, which prewarming
+// builds ahead of time and disposed sessions leave behind, for the next
+// session with the same options to reuse. Configs and instances that are no
+// longer used are kept until they were idle for `idleTimeout`.
+class SpeechConfigCache
+{
+public:
+  struct Stats
+  {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    size_t instances;
+  };
+
+  static SpeechConfigCache &Instance()
+  {
+    // Leaked so that handles released during shutdown never outlive it
+    static auto *instance = new SpeechConfigCache();
+    return *instance;
+  }
+
+  // Returns a handle to the config for `key`, calling `create` on a miss.
+  // The config is marked idle once every handle to it was released.
+  std::shared_ptr<EmbeddedSpeechConfig> Acquire(const std::string &key, const std::function<std::shared_ptr<EmbeddedSpeechConfig>()> &create)
+  {
+    std::promise<std::shared_ptr<EmbeddedSpeechConfig>> created;
+    std::shared_future<std::shared_ptr<EmbeddedSpeechConfig>> future;
+    bool creating = false;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      auto it = this->entries.find(key);
+      if (it == this->entries.end())
+      {
+        creating = true;
+        Entry entry;
+        entry.config = created.get_future().share();
+        it = this->entries.emplace(key, std::move(entry)).first;
+      }
+      it->second.users++;
+      future = it->second.config;
+    }
+
+    // Created outside the lock, so that only sessions of the same key wait
+    // for it. On failure the entry is dropped for the next call to retry,
+    // and every waiter fails without releasing it.
+    if (creating)
+    {
+      try
+      {
+        created.set_value(create());
+      }
+      catch (...)
+      {
+        {
+          std::lock_guard<std::mutex> lock(this->mutex);
+          this->entries.erase(key);
+        }
+        created.set_exception(std::current_exception());
+      }
+    }
+
+    auto config = future.get();
+    return std::shared_ptr<EmbeddedSpeechConfig>(config.get(), [this, key, config](EmbeddedSpeechConfig * /* released */)
+                                                 { this->Release(key); });
+  }
+
+  bool Has(const std::string &key)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->idle.find(key) != this->idle.end();
+  }
+
+  // Keeps a recognizer or synthesizer for the next session of `key`.
+  void Put(const std::string &key, const std::shared_ptr<void> &instance)
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->idle.emplace(key, IdleInstance{instance, std::chrono::steady_clock::now()});
+      this->StartSweeping();
+    }
+    this->changed.notify_all();
+  }
+
+  // Hands out a kept recognizer or synthesizer of `key`, if there is one.
+  std::shared_ptr<void> Take(const std::string &key)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->idle.find(key);
+    if (it == this->idle.end())
+    {
+      this->misses++;
+      return nullptr;
+    }
+    this->hits++;
+    auto instance = it->second.instance;
+    this->idle.erase(it);
+    return instance;
+  }
+
+  void SetIdleTimeout(std::chrono::milliseconds idleTimeout)
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->idleTimeout = idleTimeout;
+    }
+    this->changed.notify_all();
+  }
+
+  Stats GetStats()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return Stats{this->hits, this->misses, this->evictions, this->entries.size(), this->idle.size()};
+  }
+
+private:
+  struct Entry
+  {
+    // Ready once the config was created
+    std::shared_future<std::shared_ptr<EmbeddedSpeechConfig>> config;
+    size_t users = 0;
+    std::chrono::steady_clock::time_point idleSince;
+  };
+
+  struct IdleInstance
+  {
+    std::shared_ptr<void> instance;
+    std::chrono::steady_clock::time_point idleSince;
+  };
+
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::unordered_map<std::string, Entry> entries;
+  std::unordered_multimap<std::string, IdleInstance> idle;
+  std::chrono::milliseconds idleTimeout = std::chrono::minutes(5);
+  bool sweeping = false;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+
+  SpeechConfigCache() = default;
+
+  void Release(const std::string &key)
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      auto it = this->entries.find(key);
+      if (it == this->entries.end() || --it->second.users > 0)
+      {
+        return;
+      }
+      it->second.idleSince = std::chrono::steady_clock::now();
+      this->StartSweeping();
+    }
+    this->changed.notify_all();
+  }
+
+  // Must be called with `mutex` held. The sweeper only runs while there
+  // are idle configs or instances.
+  void StartSweeping()
+  {
+    if (!this->sweeping)
+    {
+      this->sweeping = true;
+      std::thread([this]
+                  { this->Sweep(); })
+          .detach();
+    }
+  }
+
+  void Sweep()
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true)
+    {
+      auto now = std::chrono::steady_clock::now();
+      auto next = std::chrono::steady_clock::time_point::max();
+      std::vector<std::shared_ptr<void>> evicted;
+      for (auto it = this->idle.begin(); it != this->idle.end();)
+      {
+        auto expiry = it->second.idleSince + this->idleTimeout;
+        if (expiry <= now)
+        {
+          evicted.push_back(std::move(it->second.instance));
+          it = this->idle.erase(it);
+          this->evictions++;
+        }
+        else
+        {
+          next = std::min(next, expiry);
+          ++it;
+        }
+      }
+
+      // Released outside the lock, since an instance releases its config
+      if (!evicted.empty())
+      {
+        lock.unlock();
+        evicted.clear();
+        lock.lock();
+        continue;
+      }
+
+      for (auto it = this->entries.begin(); it != this->entries.end();)
+      {
+        auto expiry = it->second.idleSince + this->idleTimeout;
+        if (it->second.users > 0)
+        {
+          ++it;
+        }
+        else if (expiry <= now)
+        {
+          it = this->entries.erase(it);
+          this->evictions++;
+        }
+        else
+        {
+          next = std::min(next, expiry);
+          ++it;
+        }
+      }
+
+      if (next == std::chrono::steady_clock::time_point::max())
+      {
+        this->sweeping = false;
+        return;
+      }
+      this->changed.wait_until(lock, next);
+    }
+  }
+};
+
+// Joins the parts of a cache key so that they cannot run into each other.
+std::string CreateCacheKey(std::initializer_list<std::string> parts)
+{
+  std::string key;
+  for (const auto &part : parts)
+  {
+    key += part;
+    key.push_back('\0');
+  }
+  return key;
+}
+
+// The recognizers or synthesizers of one kind that the speech config
+// cache keeps, built ahead of time by the prewarm bindings or left by
+// disposed sessions, adopted by the next create call with matching options.
+template <typename T>
+class WarmPool
+{
+public:
+  explicit WarmPool(const std::string &kind)
+      : prefix(CreateCacheKey({kind}))
+  {
+  }
+
+  bool Has(const std::string &key)
+  {
+    return SpeechConfigCache::Instance().Has(this->prefix + key);
+  }
+
+  void Put(const std::string &key, const std::shared_ptr<T> &instance)
+  {
+    SpeechConfigCache::Instance().Put(this->prefix + key, instance);
+  }
+
+  std::shared_ptr<T> Take(const std::string &key)
+  {
+    return std::static_pointer_cast<T>(SpeechConfigCache::Instance().Take(this->prefix + key));
+  }
+
+private:
+  const std::string prefix;
+};
+
+class PrewarmWorker : public Napi::AsyncWorker
+{
+public:
+  PrewarmWorker(const std::function<void()> &prewarm, const Napi::Function &callback)
+      : Napi::AsyncWorker(callback), prewarm(prewarm)
+  {
+  }
+
+  void Execute()
+  {
+    try
+    {
+      this->prewarm();
+    }
+    catch (const std::exception &e)
+    {
+      SetError(e.what());
+    }
+  }
+
+  void OnOK()
+  {
+    Napi::HandleScope scope(Env());
+
+    Callback().Call({Env().Undefined()});
+  }
+
+  void OnError(const Napi::Error &e)
+  {
+    Napi::HandleScope scope(Env());
+
+    Callback().Call({Napi::String::New(Env(), e.Message())});
+  }
+
+private:
+  const std::function<void()> prewarm;
+};
+
+Napi::Value GetSpeechConfigCacheStats(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+  auto stats = SpeechConfigCache::Instance().GetStats();
+
+  auto jsResult = Napi::Object::New(env);
+  jsResult.Set("hits", Napi::Number::New(env, static_cast<double>(stats.hits)));
+  jsResult.Set("misses", Napi::Number::New(env, static_cast<double>(stats.misses)));
+  jsResult.Set("evictions", Napi::Number::New(env, static_cast<double>(stats.evictions)));
+  jsResult.Set("entries", Napi::Number::New(env, static_cast<double>(stats.entries)));
+  jsResult.Set("instances", Napi::Number::New(env, static_cast<double>(stats.instances)));
+  return jsResult;
+}
+
+Napi::Value SetSpeechConfigCacheIdleTimeout(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() < 1)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto idleTimeout = info[0].As<Napi::Number>().Int64Value();
+  SpeechConfigCache::Instance().SetIdleTimeout(std::chrono::milliseconds(std::max<int64_t>(idleTimeout, 0)));
+
+  return env.Undefined();
+}
+
+#pragma endregion
+
+#pragma region DetailedResults
+
+// Just enough JSON to read detailed recognition results on the worker
+// thread, so that JS gets the fields instead of a string to parse.
+struct JsonValue
+{
+  enum Type
+  {
+    NONE,
+    BOOLEAN,
+    NUMBER,
+    STRING,
+    ARRAY,
+    OBJECT
+  };
+
+  Type type = NONE;
+  bool boolean = false;
+  double number = 0;
+  std::string string;
+  std::vector<JsonValue> items;
+  std::vector<std::pair<std::string, JsonValue>> members;
+
+  static JsonValue Parse(const std::string &text)
+  {
+    size_t position = 0;
+    auto value = ParseValue(text, position, 0);
+    SkipWhitespace(text, position);
+    if (position != text.size())
+    {
+      throw std::runtime_error("Unexpected data after JSON value");
+    }
+    return value;
+  }
+
+  // Returns an empty value for missing members, so lookups can be chained
+  const JsonValue &operator[](const char *name) const
+  {
+    static const JsonValue none;
+    for (const auto &member : this->members)
+    {
+      if (member.first == name)
+      {
+        return member.second;
+      }
+    }
+    return none;
+  }
+
+private:
+  // Deeper values are rejected instead of running out of stack
+  static constexpr size_t MaxDepth = 256;
+
+  static void SkipWhitespace(const std::string &text, size_t &position)
+  {
+    while (position < text.size() && std::isspace(static_cast<unsigned char>(text[position])))
+    {
+      position++;
+    }
+  }
+
+  static void Expect(const std::string &text, size_t &position, char expected)
+  {
+    SkipWhitespace(text, position);
+    if (position >= text.size() || text[position] != expected)
+    {
+      throw std::runtime_error(std::string("Expected '") + expected + "' in JSON");
+    }
+    position++;
+  }
+
+  static JsonValue ParseValue(const std::string &text, size_t &position, size_t depth)
+  {
+    SkipWhitespace(text, position);
+    if (position >= text.size())
+    {
+      throw std::runtime_error("Unexpected end of JSON");
+    }
+    if (depth > MaxDepth)
+    {
+      throw std::runtime_error("JSON nested too deeply");
+    }
+
+    JsonValue value;
+    switch (text[position])
+    {
+    case '{':
+      value.type = OBJECT;
+      position++;
+      SkipWhitespace(text, position);
+      if (position < text.size() && text[position] == '}')
+      {
+        position++;
+        return value;
+      }
+      do
+      {
+        SkipWhitespace(text, position);
+        auto name = ParseString(text, position);
+        Expect(text, position, ':');
+        value.members.emplace_back(name, ParseValue(text, position, depth + 1));
+        SkipWhitespace(text, position);
+      } while (position < text.size() && text[position] == ',' && ++position);
+      Expect(text, position, '}');
+      return value;
+
+    case '[':
+      value.type = ARRAY;
+      position++;
+      SkipWhitespace(text, position);
+      if (position < text.size() && text[position] == ']')
+      {
+        position++;
+        return value;
+      }
+      do
+      {
+        value.items.push_back(ParseValue(text, position, depth + 1));
+        SkipWhitespace(text, position);
+      } while (position < text.size() && text[position] == ',' && ++position);
+      Expect(text, position, ']');
+      return value;
+
+    case '"':
+      value.type = STRING;
+      value.string = ParseString(text, position);
+      return value;
+
+    case 't':
+    case 'f':
+    case 'n':
+      for (auto literal : {"true", "false", "null"})
+      {
+        auto length = std::strlen(literal);
+        if (text.compare(position, length, literal) == 0)
+        {
+          position += length;
+          value.type = literal[0] == 'n' ? NONE : BOOLEAN;
+          value.boolean = literal[0] == 't';
+          return value;
+        }
+      }
+      throw std::runtime_error("Invalid literal in JSON");
+
+    default:
+    {
+      // strtod alone would also take hex, infinity and a leading '+'
+      auto length = MatchNumber(text, position);
+      if (length == 0)
+      {
+        throw std::runtime_error("Invalid number in JSON");
+      }
+      value.type = NUMBER;
+      value.number = std::strtod(text.substr(position, length).c_str(), nullptr);
+      position += length;
+      return value;
+    }
+    }
+  }
+
+  // Returns the length of the JSON number at `position`, 0 if there is none.
+  static size_t MatchNumber(const std::string &text, size_t position)
+  {
+    auto digits = [&](size_t from)
+    {
+      auto end = from;
+      while (end < text.size() && std::isdigit(static_cast<unsigned char>(text[end])))
+      {
+        end++;
+      }
+      return end - from;
+    };
+
+    auto end = position;
+    if (end < text.size() && text[end] == '-')
+    {
+      end++;
+    }
+
+    // No leading zeros
+    auto integer = digits(end);
+    if (integer == 0 || (integer > 1 && text[end] == '0'))
+    {
+      return 0;
+    }
+    end += integer;
+
+    if (end < text.size() && text[end] == '.')
+    {
+      auto fraction = digits(end + 1);
+      if (fraction == 0)
+      {
+        return 0;
+      }
+      end += 1 + fraction;
+    }
+
+    if (end < text.size() && (text[end] == 'e' || text[end] == 'E'))
+    {
+      end++;
+      if (end < text.size() && (text[end] == '+' || text[end] == '-'))
+      {
+        end++;
+      }
+      auto exponent = digits(end);
+      if (exponent == 0)
+      {
+        return 0;
+      }
+      end += exponent;
+    }
+
+    return end - position;
+  }
+
+  // Reads the 4 hex digits of a \u escape at `position`.
+  static uint32_t ParseHex(const std::string &text, size_t position)
+  {
+    if (position + 4 > text.size())
+    {
+      throw std::runtime_error("Invalid escape in JSON");
+    }
+
+    uint32_t codeUnit = 0;
+    for (size_t i = position; i < position + 4; i++)
+    {
+      auto c = static_cast<unsigned char>(text[i]);
+      if (!std::isxdigit(c))
+      {
+        throw std::runtime_error("Invalid escape in JSON");
+      }
+      codeUnit = codeUnit << 4 | static_cast<uint32_t>(std::isdigit(c) ? c - '0' : std::tolower(c) - 'a' + 10);
+    }
+    return codeUnit;
+  }
+
+  static std::string ParseString(const std::string &text, size_t &position)
+  {
+    Expect(text, position, '"');
+
+    std::string result;
+    while (position < text.size() && text[position] != '"')
+    {
+      char c = text[position++];
+      if (static_cast<unsigned char>(c) < 0x20)
+      {
+        throw std::runtime_error("Control character in JSON string");
+      }
+      if (c != '\\' || position >= text.size())
+      {
+        result += c;
+        continue;
+      }
+
+      c = text[position++];
+      switch (c)
+      {
+      case '"':
+      case '\\':
+      case '/':
+        result += c;
+        break;
+      case 'b':
+        result += '\b';
+        break;
+      case 'f':
+        result += '\f';
+        break;
+      case 'n':
+        result += '\n';
+        break;
+      case 'r':
+        result += '\r';
+        break;
+      case 't':
+        result += '\t';
+        break;
+      case 'u':
+      {
+        uint32_t codePoint = ParseHex(text, position);
+        position += 4;
+
+        // Surrogate pair
+        if (codePoint >= 0xD800 && codePoint <= 0xDBFF && text.compare(position, 2, "\\u") == 0)
+        {
+          auto low = ParseHex(text, position + 2);
+          if (low >= 0xDC00 && low <= 0xDFFF)
+          {
+            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+            position += 6;
+          }
+        }
+
+        // UTF-8 has no encoding for unpaired surrogates
+        if (codePoint >= 0xD800 && codePoint <= 0xDFFF)
+        {
+          codePoint = 0xFFFD;
+        }
+
+        // Encode as UTF-8
+        if (codePoint < 0x80)
+        {
+          result += static_cast<char>(codePoint);
+        }
+        else if (codePoint < 0x800)
+        {
+          result += static_cast<char>(0xC0 | (codePoint >> 6));
+          result += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+        else if (codePoint < 0x10000)
+        {
+          result += static_cast<char>(0xE0 | (codePoint >> 12));
+          result += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+          result += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+        else
+        {
+          result += static_cast<char>(0xF0 | (codePoint >> 18));
+          result += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+          result += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+          result += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+        break;
+      }
+      default:
+        throw std::runtime_error("Invalid escape in JSON");
+      }
+    }
+
+    Expect(text, position, '"');
+    return result;
+  }
+};
+
+// Timings are in milliseconds, the SDK reports them in 100ns ticks.
+struct TranscriptionDetails
+{
+  double offset = 0;
+  double duration = 0;
+  std::vector<std::string> words;
+  std::vector<double> wordOffsets;
+  std::vector<double> wordDurations;
+  std::vector<std::string> alternatives;
+  std::vector<double> confidences;
+};
+
+const double TicksPerMs = 10000;
+
+std::shared_ptr<TranscriptionDetails> CreateTranscriptionDetails(const RecognitionResult &result)
+{
+  auto details = std::make_shared<TranscriptionDetails>();
+  details->offset = result.Offset() / TicksPerMs;
+  details->duration = result.Duration() / TicksPerMs;
+
+  auto json = result.Properties.GetProperty(PropertyId::SpeechServiceResponse_JsonResult);
+  if (json.empty())
+  {
+    return details;
+  }
+
+  // Timings are still useful if the JSON turns out to be malformed
+  JsonValue parsed;
+  try
+  {
+    parsed = JsonValue::Parse(json);
+  }
+  catch (const std::exception &)
+  {
+    return details;
+  }
+
+  // N-best alternatives come ordered by confidence, words are taken from
+  // the best one
+  for (const auto &alternative : parsed["NBest"].items)
+  {
+    details->alternatives.push_back(alternative["Display"].string);
+    details->confidences.push_back(alternative["Confidence"].number);
+
+    if (details->alternatives.size() == 1)
+    {
+      for (const auto &word : alternative["Words"].items)
+      {
+        details->words.push_back(word["Word"].string);
+        details->wordOffsets.push_back(word["Offset"].number / TicksPerMs);
+        details->wordDurations.push_back(word["Duration"].number / TicksPerMs);
+      }
+    }
+  }
+
+  return details;
+}
+
+Napi::Float64Array CreateFloat64Array(Napi::Env env, const std::vector<double> &values)
+{
+  auto array = Napi::Float64Array::New(env, values.size());
+  if (!values.empty())
+  {
+    std::memcpy(array.Data(), values.data(), values.size() * sizeof(double));
+  }
+  return array;
+}
+
+Napi::Array CreateStringArray(Napi::Env env, const std::vector<std::string> &values)
+{
+  auto array = Napi::Array::New(env, values.size());
+  for (size_t i = 0; i < values.size(); i++)
+  {
+    array.Set(static_cast<uint32_t>(i), Napi::String::New(env, values[i]));
+  }
+  return array;
+}
+
+Napi::Object CreateTranscriptionDetailsObject(Napi::Env env, const TranscriptionDetails &details)
+{
+  auto jsDetails = Napi::Object::New(env);
+  jsDetails.Set("offset", Napi::Number::New(env, details.offset));
+  jsDetails.Set("duration", Napi::Number::New(env, details.duration));
+  jsDetails.Set("words", CreateStringArray(env, details.words));
+  jsDetails.Set("wordOffsets", CreateFloat64Array(env, details.wordOffsets));
+  jsDetails.Set("wordDurations", CreateFloat64Array(env, details.wordDurations));
+  jsDetails.Set("alternatives", CreateStringArray(env, details.alternatives));
+  jsDetails.Set("confidences", CreateFloat64Array(env, details.confidences));
+  return jsDetails;
+}
+
+#ifdef NODE_SPEECH_TEST_HOOKS
+
+Napi::Value CreateJsonValue(Napi::Env env, const JsonValue &value)
+{
+  switch (value.type)
+  {
+  case JsonValue::BOOLEAN:
+    return Napi::Boolean::New(env, value.boolean);
+  case JsonValue::NUMBER:
+    return Napi::Number::New(env, value.number);
+  case JsonValue::STRING:
+    return Napi::String::New(env, value.string);
+  case JsonValue::ARRAY:
+  {
+    auto array = Napi::Array::New(env, value.items.size());
+    for (size_t i = 0; i < value.items.size(); i++)
+    {
+      array.Set(static_cast<uint32_t>(i), CreateJsonValue(env, value.items[i]));
+    }
+    return array;
+  }
+  case JsonValue::OBJECT:
+  {
+    auto object = Napi::Object::New(env);
+    for (const auto &member : value.members)
+    {
+      object.Set(member.first, CreateJsonValue(env, member.second));
+    }
+    return object;
+  }
+  default:
+    return env.Null();
+  }
+}
+
+// Parses `text` the way detailed results are parsed, so that the parser
+// can be checked against JSON.parse without a model.
+Napi::Value ParseJson(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 1)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsString())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  try
+  {
+    return CreateJsonValue(env, JsonValue::Parse(info[0].As<Napi::String>().Utf8Value()));
+  }
+  catch (const std::exception &e)
+  {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+}
+
+#endif
+
+#pragma endregion
+
+#pragma region Transcription
+
+// Detailed results need a differently configured model config, so they
+// are cached separately.
+std::shared_ptr<EmbeddedSpeechConfig> AcquireTranscriptionConfig(const std::string &path, const std::string &model, const std::string &key, const std::string &logsPath, bool detailed = false)
+{
+  auto cacheKey = CreateCacheKey({"transcription", path, model, key, logsPath, detailed ? "detailed" : "simple"});
+  return SpeechConfigCache::Instance().Acquire(cacheKey, [&]()
+                                               {
+    auto speechConfig = EmbeddedSpeechConfig::FromPath(path);
+    speechConfig->SetSpeechRecognitionModel(model, key);
+    if (!logsPath.empty())
+    {
+      speechConfig->SetProperty(PropertyId::Speech_LogFilename, logsPath);
+    }
+    if (detailed)
+    {
+      speechConfig->SetSpeechRecognitionOutputFormat(OutputFormat::Detailed);
+      speechConfig->SetProperty(PropertyId::SpeechServiceResponse_RequestWordLevelTimestamps, "true");
+    }
+    return speechConfig; });
+}
+
+struct WarmTranscriber
+{
+  std::shared_ptr<EmbeddedSpeechConfig> speechConfig;
+  std::shared_ptr<AudioInputQueue> audioInput;
+  std::shared_ptr<SpeechRecognizer> recognizer;
+};
+
+static WarmPool<WarmTranscriber> warmTranscribers("transcriber");
+
+std::string GetWarmTranscriberKey(const std::string &path, const std::string &model, const std::string &key, const std::string &logsPath, const std::shared_ptr<AudioInputQueue> &audioInput, bool detailed)
+{
+  return CreateCacheKey({path, model, key, logsPath, audioInput ? audioInput->Describe() : "microphone", detailed ? "detailed" : "simple"});
+}
+
+// Builds a recognizer of pushed audio ahead of time, and runs it over half
+// a second of silence from its own stream, so that the model is loaded by
+// the recognizer the session adopts. A recognizer of the microphone would
+// listen while warming up, so there a throwaway recognizer runs over
+// silence instead, which only gets the model into the page cache.
+void PrewarmTranscriberModel(const std::string &path, const std::string &model, const std::string &key, const std::string &logsPath, const std::shared_ptr<AudioInputQueue> &audioInput, bool detailed)
+{
+  auto warmKey = GetWarmTranscriberKey(path, model, key, logsPath, audioInput, detailed);
+  if (warmTranscribers.Has(warmKey))
+  {
+    return;
+  }
+
+  auto speechConfig = AcquireTranscriptionConfig(path, model, key, logsPath, detailed);
+  if (!audioInput)
+  {
+    auto silenceStream = AudioInputStream::CreatePushStream(AudioStreamFormat::GetWaveFormatPCM(16000, 16, 1));
+    std::vector<uint8_t> silence(16000 * 2 / 2);
+    silenceStream->Write(silence.data(), static_cast<uint32_t>(silence.size()));
+    silenceStream->Close();
+    SpeechRecognizer::FromConfig(speechConfig, AudioConfig::FromStreamInput(silenceStream))->RecognizeOnceAsync().get();
+    return;
+  }
+
+  auto recognizer = SpeechRecognizer::FromConfig(speechConfig, audioInput->CreateAudioConfig(audioInput));
+  audioInput->Prime(static_cast<size_t>(PcmBytes(audioInput->samplesPerSecond, audioInput->bitsPerSample, audioInput->channels, 500)));
+  recognizer->StartContinuousRecognitionAsync().get();
+  audioInput->WaitPrimed(std::chrono::seconds(5));
+  audioInput->Interrupt();
+  recognizer->StopContinuousRecognitionAsync().get();
+
+  auto warm = std::make_shared<WarmTranscriber>();
+  warm->speechConfig = speechConfig;
+  warm->audioInput = audioInput;
+  warm->recognizer = recognizer;
+  warmTranscribers.Put(warmKey, warm);
+}
+
+// The phrases of a live phrase list. Phrases are deduplicated ignoring
+// case and surrounding whitespace, so that large sets, like the symbols of
+// a codebase, don't bias the recognizer with copies. Additions are passed
+// to the phrase list as they come, removals rebuild it, since it can only
+// be cleared.
+class PhraseSet
+{
+public:
+  explicit PhraseSet(const std::vector<std::string> &phrases)
+  {
+    this->Update(phrases, {}, false);
+  }
+
+  void Update(const std::vector<std::string> &add, const std::vector<std::string> &remove, bool clear)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (clear && !this->index.empty())
+    {
+      this->index.clear();
+      this->phrases.clear();
+      this->rebuild = true;
+    }
+    for (const auto &phrase : remove)
+    {
+      auto it = this->index.find(Key(Normalize(phrase)));
+      if (it != this->index.end())
+      {
+        // Left as a hole until the phrase list is rebuilt
+        this->phrases[it->second].clear();
+        this->index.erase(it);
+        this->rebuild = true;
+      }
+    }
+    for (const auto &phrase : add)
+    {
+      auto normalized = Normalize(phrase);
+      if (!normalized.empty() && this->index.emplace(Key(normalized), this->phrases.size()).second)
+      {
+        this->phrases.push_back(std::move(normalized));
+      }
+    }
+  }
+
+  bool Pending()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->rebuild || this->applied < this->phrases.size();
+  }
+
+  size_t Size()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->index.size();
+  }
+
+  // Brings the phrase list up to date with the changes since the last call.
+  template <typename PhraseList>
+  void Apply(PhraseList &phraseList)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->rebuild)
+    {
+      phraseList.Clear();
+      this->Compact();
+      this->applied = 0;
+      this->rebuild = false;
+    }
+    for (; this->applied < this->phrases.size(); this->applied++)
+    {
+      phraseList.AddPhrase(this->phrases[this->applied]);
+    }
+  }
+
+private:
+  std::mutex mutex;
+  // Keys of the phrases to their position in `phrases`
+  std::unordered_map<std::string, size_t> index;
+  std::vector<std::string> phrases;
+  size_t applied = 0;
+  bool rebuild = false;
+
+  // Trims the phrase and collapses runs of whitespace
+  static std::string Normalize(const std::string &phrase)
+  {
+    std::string normalized;
+    normalized.reserve(phrase.size());
+    bool space = false;
+    for (auto c : phrase)
+    {
+      if (std::isspace(static_cast<unsigned char>(c)))
+      {
+        space = !normalized.empty();
+        continue;
+      }
+      if (space)
+      {
+        normalized += ' ';
+        space = false;
+      }
+      normalized += c;
+    }
+    return normalized;
+  }
+
+  static std::string Key(std::string normalized)
+  {
+    std::transform(normalized.begin(), normalized.end(), normalized.begin(), [](unsigned char c)
+                   { return static_cast<char>(std::tolower(c)); });
+    return normalized;
+  }
+
+  void Compact()
+  {
+    this->phrases.erase(std::remove_if(this->phrases.begin(), this->phrases.end(), [](const std::string &phrase)
+                                       { return phrase.empty(); }),
+                        this->phrases.end());
+    for (size_t i = 0; i < this->phrases.size(); i++)
+    {
+      this->index[Key(this->phrases[i])] = i;
+    }
+  }
+};
+
+#ifdef NODE_SPEECH_TEST_HOOKS
+
+// Creates a PhraseSet of `initial` phrases, applies it and then each of
+// `updates` to a phrase list, and returns the calls each apply made to the
+// list, as "clear" and "add <phrase>".
+Napi::Value TestPhraseSet(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 2)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsArray() || !info[1].IsArray())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  struct RecordingPhraseList
+  {
+    std::vector<std::string> calls;
+
+    void AddPhrase(const std::string &phrase)
+    {
+      this->calls.push_back("add " + phrase);
+    }
+
+    void Clear()
+    {
+      this->calls.push_back("clear");
+    }
+  };
+
+  auto toStrings = [](const Napi::Value &value)
+  {
+    std::vector<std::string> strings;
+    if (value.IsArray())
+    {
+      auto array = value.As<Napi::Array>();
+      for (uint32_t i = 0; i < array.Length(); i++)
+      {
+        strings.push_back(array.Get(i).ToString().Utf8Value());
+      }
+    }
+    return strings;
+  };
+
+  PhraseSet phrases(toStrings(info[0]));
+  auto updates = info[1].As<Napi::Array>();
+  auto applies = Napi::Array::New(env);
+  for (uint32_t i = 0; i <= updates.Length(); i++)
+  {
+    if (i > 0)
+    {
+      auto value = updates.Get(i - 1);
+      auto update = value.IsObject() ? value.As<Napi::Object>() : Napi::Object::New(env);
+      phrases.Update(toStrings(update.Get("add")), toStrings(update.Get("remove")), update.Get("clear").ToBoolean());
+    }
+    RecordingPhraseList phraseList;
+    phrases.Apply(phraseList);
+    applies.Set(i, CreateStringArray(env, phraseList.calls));
+  }
+
+  return applies;
+}
+
+#endif
+
+class TranscriptionControl : public WorkerControl
+{
+public:
+  TranscriptionControl(const std::shared_ptr<AudioInputQueue> &audioInput, const std::shared_ptr<ResultCredits> &credits, const std::shared_ptr<PhraseSet> &phrases = nullptr)
+      : audioInput(audioInput), credits(credits), phrases(phrases)
+  {
+  }
+
+  // Returns false if the phrases of this transcriber can't be changed.
+  bool UpdatePhrases(const std::vector<std::string> &add, const std::vector<std::string> &remove, bool clear)
+  {
+    if (!this->phrases)
+    {
+      return false;
+    }
+    this->phrases->Update(add, remove, clear);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->Wake();
+    return true;
+  }
+
+  // Set when audio is pushed from JS instead of read from the microphone.
+  const std::shared_ptr<AudioInputQueue> audioInput;
+
+  // Set when JS acknowledges the results it consumed.
+  const std::shared_ptr<ResultCredits> credits;
+
+  const std::shared_ptr<PhraseSet> phrases;
+};
+
+void UpdateTranscriptionWorkerStatus(int workerId, RuntimeStatus status)
+{
+  if (auto control = SessionRegistry::Instance().Get<TranscriptionControl>(workerId))
+  {
+    control->Post(status);
+  }
+}
+
+std::shared_ptr<AudioInputQueue> GetTranscriptionAudioInput(int workerId)
+{
+  auto control = SessionRegistry::Instance().Get<TranscriptionControl>(workerId);
+  return control ? control->audioInput : nullptr;
+}
+
+bool UpdateTranscriptionPhrases(int workerId, const std::vector<std::string> &add, const std::vector<std::string> &remove, bool clear)
+{
+  auto control = SessionRegistry::Instance().Get<TranscriptionControl>(workerId);
+  return control && control->UpdatePhrases(add, remove, clear);
+}
+
+void AcknowledgeTranscriptionResults(int workerId, size_t count)
+{
+  auto control = SessionRegistry::Instance().Get<TranscriptionControl>(workerId);
+  if (control && control->credits)
+  {
+    control->credits->Release(count);
+  }
+}
+
+struct TranscriptionWorkerCallbackResult
+{
+  StatusCode status;
+  std::string data = "";
+  std::shared_ptr<const TranscriptionDetails> details = nullptr;
+
+  // Set by transcribers with several models
+  std::string model = "";
+  double confidence = 0;
+};
+
+class TranscriptionWorker : public SessionWorker<TranscriptionWorkerCallbackResult>
+{
+public:
+  const int id;
+
+  TranscriptionWorker(const std::string &path, const std::string &key, const std::string &model, const std::string &logsPath, const std::vector<std::string> &phrases, const std::shared_ptr<AudioInputQueue> &audioInput, const std::shared_ptr<AudioHubReader> &hubReader, const std::shared_ptr<WarmTranscriber> &warm, bool batched, bool detailed, const std::shared_ptr<ResultCredits> &credits, const Napi::Function &callback)
+      : SessionWorker<TranscriptionWorkerCallbackResult>(callback, "TranscriptionWorker"), id(SessionRegistry::Instance().Add(std::make_shared<TranscriptionControl>(audioInput, credits, std::make_shared<PhraseSet>(phrases)))), path(path), key(key), model(model), logsPath(logsPath), audioInput(audioInput), hubReader(hubReader), warm(warm), credits(credits), batched(batched), detailed(detailed), started(false)
+  {
+    this->SetBatched(batched);
+    this->SetCredits(credits);
+    this->metrics = AddSessionMetrics("transcription", this->id);
+    this->SetMetrics(this->metrics);
+    this->control = SessionRegistry::Instance().Get<TranscriptionControl>(this->id);
+    this->control->Post(RuntimeStatus::START);
+    this->control->Attach([this]
+                          { this->Schedule(); });
+  }
+
+  bool Execute(const ExecutionProgress &progress)
+  {
+    try
+    {
+      if (!this->recognizer)
+      {
+        this->Setup(progress);
+      }
+
+      // Phrases changed during an utterance wait for its end, which
+      // schedules the worker again
+      if (!this->inUtterance && this->control->phrases->Pending())
+      {
+        this->control->phrases->Apply(*this->phraseList);
+      }
+
+      // Only runs when start/stop/dispose was called, or phrases changed
+      RuntimeStatus status;
+      while (this->control->Poll(this->seen, status))
+      {
+        switch (status)
+        {
+        case RuntimeStatus::START:
+          if (this->credits)
+          {
+            this->credits->SetBlocking(true);
+          }
+          if (!this->started)
+          {
+            this->metrics->Mark("startRequested");
+            this->recognizer->StartContinuousRecognitionAsync().get();
+          }
+          break;
+        case RuntimeStatus::STOP:
+          // Results of the rest of the session must not hold up stopping
+          if (this->credits)
+          {
+            this->credits->SetBlocking(false);
+          }
+          if (this->started)
+          {
+            if (this->audioInput)
+            {
+              this->audioInput->Interrupt();
+            }
+            if (this->hubReader)
+            {
+              this->hubReader->Interrupt();
+            }
+            this->recognizer->StopContinuousRecognitionAsync().get();
+          }
+          break;
+        case RuntimeStatus::DISPOSE:
+          this->Dispose(progress);
+          return false;
+        }
+      }
+      return true;
+    }
+    catch (const std::exception &e)
+    {
+      this->failed = true;
+      auto result = TranscriptionWorkerCallbackResult{StatusCode::ERROR, e.what()};
+      progress.Send(&result, 1);
+    }
+
+    this->Dispose(progress);
+    return false;
+  }
+
+  void Setup(const ExecutionProgress &progress)
+  {
+    std::shared_ptr<EmbeddedSpeechConfig> speechConfig;
+    std::shared_ptr<SpeechRecognizer> recognizer;
+    if (this->warm)
+    {
+      speechConfig = this->warm->speechConfig;
+      recognizer = this->warm->recognizer;
+      this->warm.reset();
+    }
+    else
+    {
+      this->metrics->Mark("setup");
+      speechConfig = AcquireTranscriptionConfig(path, model, key, logsPath, detailed);
+      this->metrics->Mark("configCreated");
+      this->metrics->Measure("configCreation", "setup");
+
+      std::shared_ptr<AudioConfig> audioConfig;
+      if (this->hubReader)
+      {
+        audioConfig = this->hubReader->CreateAudioConfig(this->hubReader);
+      }
+      else
+      {
+        audioConfig = this->audioInput ? this->audioInput->CreateAudioConfig(this->audioInput) : AudioConfig::FromDefaultMicrophoneInput();
+      }
+      recognizer = SpeechRecognizer::FromConfig(speechConfig, audioConfig);
+      this->metrics->Mark("recognizerCreated");
+      this->metrics->Measure("recognizerConstruction", "configCreated");
+    }
+
+    auto phraseList = PhraseListGrammar::FromRecognizer(recognizer);
+    this->control->phrases->Apply(*phraseList);
+
+    // Callback: intermediate transcription results
+    recognizer->Recognizing += [this, progress](const SpeechRecognitionEventArgs &e)
+    {
+      if (e.Result->Reason == ResultReason::RecognizingSpeech)
+      {
+        this->inUtterance = true;
+        this->metrics->MarkFirst("firstRecognizing");
+        if (this->metrics->MarkFirst("utteranceRecognizing"))
+        {
+          this->metrics->Measure("firstPartial", "speechStart");
+          this->metrics->Clear("speechStart");
+        }
+
+        auto result = TranscriptionWorkerCallbackResult{StatusCode::RECOGNIZING, e.Result->Text};
+        progress.Send(&result, 1);
+      }
+    };
+
+    // Callback: final transcription result (sentence)
+    recognizer->Recognized += [this, progress](const SpeechRecognitionEventArgs &e)
+    {
+      this->EndUtterance();
+      if (e.Result->Reason == ResultReason::RecognizedSpeech)
+      {
+        this->metrics->Mark("recognized");
+        this->metrics->Measure("partialToFinal", "utteranceRecognizing");
+        this->metrics->Measure("speechEndToFinal", "speechEnd");
+        this->metrics->Clear("utteranceRecognizing");
+        this->metrics->Clear("speechEnd");
+
+        auto result = TranscriptionWorkerCallbackResult{StatusCode::RECOGNIZED, e.Result->Text};
+        if (this->detailed)
+        {
+          result.details = CreateTranscriptionDetails(*e.Result);
+        }
+        progress.Send(&result, 1);
+      }
+      else if (e.Result->Reason == ResultReason::NoMatch)
+      {
+        auto reason = NoMatchDetails::FromResult(e.Result)->Reason;
+        switch (reason)
+        {
+        // Input audio was not silent but contained no recognizable speech.
+        case NoMatchReason::NotRecognized:
+        {
+          auto result = TranscriptionWorkerCallbackResult{StatusCode::NOT_RECOGNIZED};
+          progress.Send(&result, 1);
+          break;
+        }
+
+        // Input audio was silent and the initial silence timeout expired.
+        // In continuous recognition this can happen multiple times during
+        // a session, not just at the very beginning.
+        case NoMatchReason::InitialSilenceTimeout:
+        {
+          auto result = TranscriptionWorkerCallbackResult{StatusCode::INITIAL_SILENCE_TIMEOUT};
+          progress.Send(&result, 1);
+          break;
+        }
+
+        // Input audio was silent and the end silence timeout expired.
+        // This can happen in continuous recognition after a phrase is
+        // recognized (a final result is generated) and it is followed
+        // by silence. If the silence continues long enough there will
+        // be InitialSilenceTimeout after this.
+        case NoMatchReason::EndSilenceTimeout:
+        {
+          auto result = TranscriptionWorkerCallbackResult{StatusCode::END_SILENCE_TIMEOUT};
+          progress.Send(&result, 1);
+          break;
+        }
+
+        // Other reasons are not supported in embedded speech at the moment.
+        default:
+          break;
+        }
+      }
+    };
+
+    // Callback: errors
+    recognizer->Canceled += [this, progress](const SpeechRecognitionCanceledEventArgs &e)
+    {
+      switch (e.Reason)
+      {
+      case CancellationReason::Error:
+      {
+        this->failed = true;
+        auto result = TranscriptionWorkerCallbackResult{StatusCode::ERROR, e.ErrorDetails};
+        progress.Send(&result, 1);
+        break;
+      }
+
+      default:
+        break;
+      }
+    };
+
+    // Callback: begin of recognition session
+    recognizer->SessionStarted += [this, progress](const SessionEventArgs &e)
+    {
+      this->started = true;
+      this->metrics->Mark("started");
+      this->metrics->Measure("sessionStart", "startRequested");
+
+      UNUSED(e);
+      auto result = TranscriptionWorkerCallbackResult{StatusCode::STARTED};
+      progress.Send(&result, 1);
+    };
+
+    // Callback: speech start detected
+    recognizer->SpeechStartDetected += [this, progress](const RecognitionEventArgs &e)
+    {
+      this->inUtterance = true;
+      this->metrics->Mark("speechStart");
+
+      UNUSED(e);
+      auto result = TranscriptionWorkerCallbackResult{StatusCode::SPEECH_START_DETECTED};
+      progress.Send(&result, 1);
+    };
+
+    // Callback: speech end detected
+    recognizer->SpeechEndDetected += [this, progress](const RecognitionEventArgs &e)
+    {
+      this->metrics->Mark("speechEnd");
+
+      UNUSED(e);
+      auto result = TranscriptionWorkerCallbackResult{StatusCode::SPEECH_END_DETECTED};
+      progress.Send(&result, 1);
+    };
+
+    // Callback: end of recognition session
+    recognizer->SessionStopped += [this, progress](const SessionEventArgs &e)
+    {
+      this->started = false;
+      this->EndUtterance();
+
+      UNUSED(e);
+      auto result = TranscriptionWorkerCallbackResult{StatusCode::STOPPED};
+      progress.Send(&result, 1);
+    };
+
+    this->speechConfig = speechConfig;
+    this->recognizer = recognizer;
+    this->phraseList = phraseList;
+  }
+
+  void EndUtterance()
+  {
+    this->inUtterance = false;
+    if (this->control->phrases->Pending())
+    {
+      this->Schedule();
+    }
+  }
+
+  // Stops and releases the recognizer, after which no progress is sent. A
+  // recognizer that did not fail is kept for the next session with the
+  // same options, which OnOK hands to the speech config cache. Recognizers
+  // of an audio hub read its end, so they are not kept.
+  void Dispose(const ExecutionProgress &progress)
+  {
+    this->control->Detach();
+
+    bool reuse = this->recognizer && !this->hubReader && !this->failed;
+    if (this->credits)
+    {
+      this->credits->SetBlocking(false);
+    }
+    if (this->audioInput)
+    {
+      // A kept recognizer must not read the end of its stream
+      if (reuse)
+      {
+        this->audioInput->Interrupt();
+      }
+      else
+      {
+        this->audioInput->Close();
+      }
+    }
+    if (this->hubReader)
+    {
+      this->hubReader->Close();
+    }
+    try
+    {
+      if (this->recognizer && this->started)
+      {
+        this->recognizer->StopContinuousRecognitionAsync().get();
+      }
+    }
+    catch (const std::exception &e)
+    {
+      reuse = false;
+      auto result = TranscriptionWorkerCallbackResult{StatusCode::ERROR, e.what()};
+      progress.Send(&result, 1);
+    }
+    if (reuse)
+    {
+      this->recognizer->Recognizing.DisconnectAll();
+      this->recognizer->Recognized.DisconnectAll();
+      this->recognizer->Canceled.DisconnectAll();
+      this->recognizer->SessionStarted.DisconnectAll();
+      this->recognizer->SpeechStartDetected.DisconnectAll();
+      this->recognizer->SpeechEndDetected.DisconnectAll();
+      this->recognizer->SessionStopped.DisconnectAll();
+      this->phraseList->Clear();
+      this->reusable = std::make_shared<WarmTranscriber>(WarmTranscriber{this->speechConfig, this->audioInput, this->recognizer});
+    }
+    else if (this->audioInput)
+    {
+      this->audioInput->Close();
+    }
+    this->phraseList.reset();
+    this->recognizer.reset();
+    this->speechConfig.reset();
+
+    SessionRegistry::Instance().Remove<TranscriptionControl>(this->id);
+    RemoveSessionMetrics("transcription", this->id);
+  }
+
+  void OnProgress(const TranscriptionWorkerCallbackResult *result, size_t /* count */)
+  {
+    Napi::HandleScope scope(Env());
+
+    if (this->audioInput)
+    {
+      this->audioInput->ReleaseDrained();
+    }
+
+    Callback().Call({Env().Undefined(), this->CreateResult(*result)});
+  }
+
+  // Partial hypotheses are only useful until the next one arrives
+  bool Supersedes(const TranscriptionWorkerCallbackResult &next, const TranscriptionWorkerCallbackResult &previous) const
+  {
+    return next.status == StatusCode::RECOGNIZING && previous.status == StatusCode::RECOGNIZING;
+  }
+
+  // Waiting for JS holds up the recognizer, and with it the audio it
+  // reads, so pushed audio is refused until JS caught up. Partial
+  // hypotheses are dropped instead, the next one covers them.
+  Backpressure GetBackpressure(const TranscriptionWorkerCallbackResult &result) const
+  {
+    switch (result.status)
+    {
+    case StatusCode::RECOGNIZING:
+      return Backpressure::DROP;
+    case StatusCode::RECOGNIZED:
+    case StatusCode::NOT_RECOGNIZED:
+    case StatusCode::INITIAL_SILENCE_TIMEOUT:
+    case StatusCode::END_SILENCE_TIMEOUT:
+    case StatusCode::SPEECH_START_DETECTED:
+    case StatusCode::SPEECH_END_DETECTED:
+      return Backpressure::WAIT;
+    default:
+      return Backpressure::SEND;
+    }
+  }
+
+  void OnBatch(const TranscriptionWorkerCallbackResult *results, size_t count, size_t coalesced)
+  {
+    Napi::HandleScope scope(Env());
+
+    if (this->audioInput)
+    {
+      this->audioInput->ReleaseDrained();
+    }
+
+    auto jsResults = Napi::Array::New(Env(), count);
+    for (size_t i = 0; i < count; i++)
+    {
+      jsResults.Set(static_cast<uint32_t>(i), this->CreateResult(results[i]));
+    }
+
+    Callback().Call({Env().Undefined(), jsResults, Napi::Number::New(Env(), static_cast<double>(coalesced))});
+  }
+
+  void OnOK()
+  {
+    Napi::HandleScope scope(Env());
+
+    if (this->audioInput)
+    {
+      this->audioInput->ReleaseAll();
+    }
+
+    // Kept once the audio of this session was released, so that the next
+    // session cannot push before that
+    if (this->reusable)
+    {
+      if (this->audioInput)
+      {
+        this->audioInput->Reset();
+      }
+      warmTranscribers.Put(GetWarmTranscriberKey(this->path, this->model, this->key, this->logsPath, this->audioInput, this->detailed), this->reusable);
+      this->reusable.reset();
+    }
+
+    auto jsResult = this->CreateResult({StatusCode::DISPOSED});
+    if (this->batched)
+    {
+      auto jsResults = Napi::Array::New(Env(), 1);
+      jsResults.Set(static_cast<uint32_t>(0), jsResult);
+      Callback().Call({Env().Undefined(), jsResults, Napi::Number::New(Env(), 0)});
+    }
+    else
+    {
+      Callback().Call({Env().Undefined(), jsResult});
+    }
+  }
+
+  void OnError(const Napi::Error &e)
+  {
+    Napi::HandleScope scope(Env());
+
+    if (this->audioInput)
+    {
+      this->audioInput->ReleaseAll();
+    }
+
+    Callback().Call({Napi::String::New(Env(), e.Message())});
+  }
+
+private:
+  Napi::Object CreateResult(const TranscriptionWorkerCallbackResult &result)
+  {
+    auto jsResult = AddonData::Get(Env()).CreateResult(Env(), result.status, result.data);
+    if (result.details)
+    {
+      jsResult.Set("details", CreateTranscriptionDetailsObject(Env(), *result.details));
+    }
+    return jsResult;
+  }
+
+  const std::string path;
+  const std::string key;
+  const std::string model;
+  const std::string logsPath;
+  const std::shared_ptr<AudioInputQueue> audioInput;
+  const std::shared_ptr<AudioHubReader> hubReader;
+  std::shared_ptr<WarmTranscriber> warm;
+  std::shared_ptr<WarmTranscriber> reusable;
+  const std::shared_ptr<ResultCredits> credits;
+  const bool batched;
+  const bool detailed;
+  std::shared_ptr<TranscriptionControl> control;
+  std::shared_ptr<SessionMetrics> metrics;
+  std::shared_ptr<EmbeddedSpeechConfig> speechConfig;
+  std::shared_ptr<SpeechRecognizer> recognizer;
+  std::shared_ptr<PhraseListGrammar> phraseList;
+  uint64_t seen = 0;
+  std::atomic<bool> started;
+  std::atomic<bool> inUtterance{false};
+  std::atomic<bool> failed{false};
+};
+
+Napi::Value CreateTranscriber(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 7)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsString() || !info[1].IsString() || !info[2].IsString() || (!info[3].IsUndefined() && !info[3].IsString()) || !info[4].IsArray() || !info[5].IsObject() || !info[6].IsFunction())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto modelPath = info[0].As<Napi::String>().Utf8Value();
+  auto modelName = info[1].As<Napi::String>().Utf8Value();
+  auto modelKey = info[2].As<Napi::String>().Utf8Value();
+  std::string logsPath;
+  if (!info[3].IsUndefined())
+  {
+    logsPath = info[3].As<Napi::String>().Utf8Value();
+  }
+  auto phrasesRaw = info[4].As<Napi::Array>();
+  std::vector<std::string> phrases;
+  for (uint32_t i = 0; i < static_cast<uint32_t>(phrasesRaw.Length()); i++)
+  {
+    phrases.push_back(phrasesRaw.Get(i).As<Napi::String>().Utf8Value());
+  }
+  auto options = info[5].As<Napi::Object>();
+  auto callback = info[6].As<Napi::Function>();
+
+  try
+  {
+    // Adopt a prewarmed recognizer, and its audio stream, if there is one.
+    // Prewarmed recognizers never read from an audio hub.
+    auto hubReader = CreateAudioHubReader(options, "transcription");
+    auto audioInput = hubReader ? nullptr : CreateAudioInputQueue(options);
+    bool detailed = options.Has("detailed") && options.Get("detailed").ToBoolean();
+    auto warm = hubReader ? nullptr : warmTranscribers.Take(GetWarmTranscriberKey(modelPath, modelName, modelKey, logsPath, audioInput, detailed));
+    if (warm)
+    {
+      audioInput = warm->audioInput;
+    }
+
+    bool batched = options.Has("batch") && options.Get("batch").ToBoolean();
+    std::shared_ptr<ResultCredits> credits;
+    if (!batched && options.Get("maxPending").IsNumber())
+    {
+      credits = std::make_shared<ResultCredits>(options.Get("maxPending").As<Napi::Number>().Uint32Value());
+    }
+    auto *worker = new TranscriptionWorker(modelPath, modelKey, modelName, logsPath, phrases, audioInput, hubReader, warm, batched, detailed, credits, callback);
+    worker->Queue();
+
+    return Napi::Number::New(env, worker->id);
+  }
+  catch (const std::exception &e)
+  {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+}
+
+Napi::Value PrewarmTranscriber(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 6)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsString() || !info[1].IsString() || !info[2].IsString() || (!info[3].IsUndefined() && !info[3].IsString()) || !info[4].IsObject() || !info[5].IsFunction())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto modelPath = info[0].As<Napi::String>().Utf8Value();
+  auto modelName = info[1].As<Napi::String>().Utf8Value();
+  auto modelKey = info[2].As<Napi::String>().Utf8Value();
+  std::string logsPath;
+  if (!info[3].IsUndefined())
+  {
+    logsPath = info[3].As<Napi::String>().Utf8Value();
+  }
+  auto options = info[4].As<Napi::Object>();
+  auto callback = info[5].As<Napi::Function>();
+
+  try
+  {
+    auto audioInput = CreateAudioInputQueue(options);
+    bool detailed = options.Has("detailed") && options.Get("detailed").ToBoolean();
+    auto *worker = new PrewarmWorker([modelPath, modelKey, modelName, logsPath, audioInput, detailed]()
+                                     { PrewarmTranscriberModel(modelPath, modelName, modelKey, logsPath, audioInput, detailed); },
+                                     callback);
+    worker->Queue();
+
+    return env.Undefined();
+  }
+  catch (const std::exception &e)
+  {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+}
+
+Napi::Value UpdateTranscriber(const Napi::CallbackInfo &info, RuntimeStatus status)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() < 1)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto workerId = info[0].As<Napi::Number>();
+  UpdateTranscriptionWorkerStatus(workerId.Int32Value(), status);
+
+  return env.Undefined();
+}
+
+Napi::Value PushAudio(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() < 2)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber() || (!info[1].IsArrayBuffer() && !info[1].IsTypedArray()))
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto workerId = info[0].As<Napi::Number>();
+  auto audioInput = GetTranscriptionAudioInput(workerId.Int32Value());
+  if (!audioInput)
+  {
+    return Napi::Boolean::New(env, false);
+  }
+
+  // Reference the caller's memory directly, Buffers are Uint8Arrays
+  const uint8_t *data;
+  size_t size;
+  if (info[1].IsArrayBuffer())
+  {
+    auto buffer = info[1].As<Napi::ArrayBuffer>();
+    data = static_cast<const uint8_t *>(buffer.Data());
+    size = buffer.ByteLength();
+  }
+  else
+  {
+    auto view = info[1].As<Napi::TypedArray>();
+    data = static_cast<const uint8_t *>(view.ArrayBuffer().Data()) + view.ByteOffset();
+    size = view.ByteLength();
+  }
+
+  return Napi::Boolean::New(env, audioInput->Push(info[1].As<Napi::Object>(), data, size));
+}
+
+Napi::Value GetAudioGateStats(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() < 1)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto workerId = info[0].As<Napi::Number>();
+  auto audioInput = GetTranscriptionAudioInput(workerId.Int32Value());
+  if (!audioInput || !audioInput->IsGated())
+  {
+    return env.Undefined();
+  }
+
+  // Audio held back is audio the recognizer did not run inference on
+  auto stats = audioInput->GetGateStats();
+  auto jsResult = Napi::Object::New(env);
+  jsResult.Set("open", Napi::Boolean::New(env, stats.open));
+  jsResult.Set("audioMs", Napi::Number::New(env, PcmMs(audioInput->samplesPerSecond, audioInput->bitsPerSample, audioInput->channels, stats.pushedBytes)));
+  jsResult.Set("gatedMs", Napi::Number::New(env, PcmMs(audioInput->samplesPerSecond, audioInput->bitsPerSample, audioInput->channels, stats.gatedBytes)));
+  jsResult.Set("savedFraction", Napi::Number::New(env, stats.pushedBytes > 0 ? static_cast<double>(stats.gatedBytes) / stats.pushedBytes : 0));
+  jsResult.Set("openings", Napi::Number::New(env, static_cast<double>(stats.openings)));
+  return jsResult;
+}
+
+std::vector<std::string> GetStrings(const Napi::Array &array)
+{
+  std::vector<std::string> strings;
+  strings.reserve(array.Length());
+  for (uint32_t i = 0; i < static_cast<uint32_t>(array.Length()); i++)
+  {
+    auto value = array.Get(i);
+    if (value.IsString())
+    {
+      strings.push_back(value.As<Napi::String>().Utf8Value());
+    }
+  }
+  return strings;
+}
+
+Napi::Value UpdatePhrases(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() < 4)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber() || !info[1].IsArray() || !info[2].IsArray() || !info[3].IsBoolean())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto workerId = info[0].As<Napi::Number>();
+  auto add = GetStrings(info[1].As<Napi::Array>());
+  auto remove = GetStrings(info[2].As<Napi::Array>());
+  bool clear = info[3].As<Napi::Boolean>();
+
+  return Napi::Boolean::New(env, UpdateTranscriptionPhrases(workerId.Int32Value(), add, remove, clear));
+}
+
+Napi::Value AcknowledgeResults(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() < 2)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber() || !info[1].IsNumber())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto workerId = info[0].As<Napi::Number>();
+  AcknowledgeTranscriptionResults(workerId.Int32Value(), info[1].As<Napi::Number>().Uint32Value());
+
+  return env.Undefined();
+}
+
+Napi::Value StartTranscriber(const Napi::CallbackInfo &info)
+{
+  return UpdateTranscriber(info, RuntimeStatus::START);
+}
+
+Napi::Value StopTranscriber(const Napi::CallbackInfo &info)
+{
+  return UpdateTranscriber(info, RuntimeStatus::STOP);
+}
+
+Napi::Value DisposeTranscriber(const Napi::CallbackInfo &info)
+{
+  return UpdateTranscriber(info, RuntimeStatus::DISPOSE);
+}
+
+#ifdef NODE_SPEECH_TEST_HOOKS
+
+// Stands in for a TranscriptionWorker without a model. It is reached
+// through a transcriber handle, woken through a TranscriptionControl and
+// run on the SessionExecutor like one, and reports STARTED and STOPPED
+// when the recognizer would, so that JS commands can be timed up to the
+// worker reacting, without the recognizer's own work.
+class CommandProbeWorker : public SessionWorker<TranscriptionWorkerCallbackResult>
+{
+public:
+  const int id;
+
+  explicit CommandProbeWorker(const Napi::Function &callback)
+      : SessionWorker<TranscriptionWorkerCallbackResult>(callback, "CommandProbeWorker"), id(SessionRegistry::Instance().Add(std::make_shared<TranscriptionControl>(nullptr, nullptr)))
+  {
+    this->control = SessionRegistry::Instance().Get<TranscriptionControl>(this->id);
+    this->control->Post(RuntimeStatus::START);
+    this->control->Attach([this]
+                          { this->Schedule(); });
+  }
+
+  bool Execute(const ExecutionProgress &progress)
+  {
+    RuntimeStatus status;
+    while (this->control->Poll(this->seen, status))
+    {
+      if (status == RuntimeStatus::DISPOSE)
+      {
+        this->control->Detach();
+        SessionRegistry::Instance().Remove<TranscriptionControl>(this->id);
+        return false;
+      }
+
+      // Like the recognizer, only changes are reported
+      auto started = status == RuntimeStatus::START;
+      if (started != this->started)
+      {
+        this->started = started;
+        auto result = TranscriptionWorkerCallbackResult{started ? StatusCode::STARTED : StatusCode::STOPPED};
+        progress.Send(&result, 1);
+      }
+    }
+    return true;
+  }
+
+  void OnProgress(const TranscriptionWorkerCallbackResult *result, size_t /* count */)
+  {
+    Napi::HandleScope scope(Env());
+    Callback().Call({Env().Undefined(), AddonData::Get(Env()).CreateResult(Env(), result->status, result->data)});
+  }
+
+  void OnOK()
+  {
+    Napi::HandleScope scope(Env());
+    Callback().Call({Env().Undefined(), AddonData::Get(Env()).CreateResult(Env(), StatusCode::DISPOSED, "")});
+  }
+
+  void OnError(const Napi::Error &e)
+  {
+    Napi::HandleScope scope(Env());
+    Callback().Call({Napi::String::New(Env(), e.Message())});
+  }
+
+private:
+  std::shared_ptr<TranscriptionControl> control;
+  uint64_t seen = 0;
+  bool started = false;
+};
+
+Napi::Value CreateCommandProbe(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 1)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsFunction())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto *worker = new CommandProbeWorker(info[0].As<Napi::Function>());
+  worker->Queue();
+
+  return Napi::Number::New(env, worker->id);
+}
+
+#endif
+
+#pragma endregion
+
+#pragma region MultiModelTranscription
+
+// Picks one result per utterance when several models transcribe the same
+// audio. Models segment the audio on their own, so final results are
+// grouped by overlapping time ranges, and a group is decided once every
+// model reported past its end. The model whose results in the group are
+// most confident, weighted by duration, wins it; models without results
+// in the group did not recognize anything there. Ties go to the model
+// listed first, whichever model reported first.
+class UtteranceArbiter
+{
+public:
+  struct Candidate
+  {
+    size_t model;
+    std::string text;
+    double confidence;
+    double offset;
+    double end;
+    std::shared_ptr<const TranscriptionDetails> details;
+  };
+
+  struct Decision
+  {
+    size_t model;
+    std::string text;
+    double confidence;
+    std::shared_ptr<const TranscriptionDetails> details;
+  };
+
+  explicit UtteranceArbiter(size_t models) : heard(models, 0), finished(models, false)
+  {
+  }
+
+  void Add(Candidate candidate)
+  {
+    this->Advance(candidate.model, candidate.end);
+    auto it = std::upper_bound(this->candidates.begin(), this->candidates.end(), candidate.offset, [](double offset, const Candidate &other)
+                               { return offset < other.offset; });
+    this->candidates.insert(it, std::move(candidate));
+  }
+
+  // The model produced all of its final results for audio before
+  // `position`, in milliseconds.
+  void Advance(size_t model, double position)
+  {
+    this->heard[model] = std::max(this->heard[model], position);
+  }
+
+  // The model won't report anything anymore, e.g. because it stopped.
+  void Finish(size_t model)
+  {
+    this->finished[model] = true;
+  }
+
+  // Starts over, with every model at the start of the audio again.
+  void Reset()
+  {
+    this->candidates.clear();
+    std::fill(this->heard.begin(), this->heard.end(), 0);
+    std::fill(this->finished.begin(), this->finished.end(), false);
+  }
+
+  bool Next(Decision &decision)
+  {
+    if (this->candidates.empty())
+    {
+      return false;
+    }
+
+    // Candidates are ordered by offset, so a group is a prefix
+    size_t count = 1;
+    auto end = this->candidates.front().end;
+    while (count < this->candidates.size() && this->candidates[count].offset < end)
+    {
+      end = std::max(end, this->candidates[count].end);
+      count++;
+    }
+    for (size_t model = 0; model < this->heard.size(); model++)
+    {
+      if (!this->finished[model] && this->heard[model] < end)
+      {
+        return false;
+      }
+    }
+
+    std::vector<double> weighted(this->heard.size(), 0);
+    std::vector<double> durations(this->heard.size(), 0);
+    for (size_t i = 0; i < count; i++)
+    {
+      const auto &candidate = this->candidates[i];
+      auto duration = std::max(candidate.end - candidate.offset, 1.0);
+      weighted[candidate.model] += candidate.confidence * duration;
+      durations[candidate.model] += duration;
+    }
+    auto winner = this->heard.size();
+    for (size_t model = 0; model < this->heard.size(); model++)
+    {
+      if (durations[model] > 0 && (winner == this->heard.size() || weighted[model] / durations[model] > weighted[winner] / durations[winner]))
+      {
+        winner = model;
+      }
+    }
+
+    decision = Decision{winner, "", weighted[winner] / durations[winner], nullptr};
+    size_t parts = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+      const auto &candidate = this->candidates[i];
+      if (candidate.model != winner)
+      {
+        continue;
+      }
+      decision.text += decision.text.empty() ? candidate.text : " " + candidate.text;
+      decision.details = parts++ == 0 ? candidate.details : nullptr;
+    }
+    this->candidates.erase(this->candidates.begin(), this->candidates.begin() + count);
+    return true;
+  }
+
+private:
+  std::vector<Candidate> candidates;
+  std::vector<double> heard;
+  std::vector<bool> finished;
+};
+
+#ifdef NODE_SPEECH_TEST_HOOKS
+
+// Feeds `events` of `models` models to an UtteranceArbiter and returns
+// its decisions as "<model>: <text>", in order.
+Napi::Value ArbitrateUtterances(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 2)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber() || !info[1].IsArray())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto models = std::max<uint32_t>(info[0].As<Napi::Number>().Uint32Value(), 1);
+  auto events = info[1].As<Napi::Array>();
+  UtteranceArbiter arbiter(models);
+  std::vector<std::string> decisions;
+  for (uint32_t i = 0; i < events.Length(); i++)
+  {
+    auto value = events.Get(i);
+    auto event = value.IsObject() ? value.As<Napi::Object>() : Napi::Object::New(env);
+    auto op = event.Get("op").ToString().Utf8Value();
+    auto model = event.Get("model").IsNumber() ? event.Get("model").As<Napi::Number>().Uint32Value() : models;
+    if (model >= models)
+    {
+      Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    if (op == "add")
+    {
+      arbiter.Add(UtteranceArbiter::Candidate{
+          model,
+          event.Get("text").ToString().Utf8Value(),
+          event.Get("confidence").ToNumber().DoubleValue(),
+          event.Get("offset").ToNumber().DoubleValue(),
+          event.Get("end").ToNumber().DoubleValue(),
+          nullptr});
+    }
+    else if (op == "advance")
+    {
+      arbiter.Advance(model, event.Get("position").ToNumber().DoubleValue());
+    }
+    else if (op == "finish")
+    {
+      arbiter.Finish(model);
+    }
+    else
+    {
+      Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    UtteranceArbiter::Decision decision;
+    while (arbiter.Next(decision))
+    {
+      decisions.push_back(std::to_string(decision.model) + ": " + decision.text);
+    }
+  }
+
+  return CreateStringArray(env, decisions);
+}
+
+#endif
+
+struct TranscriptionModel
+{
+  std::string path;
+  std::string name;
+  std::string key;
+};
+
+// Transcribes the audio of one audio hub with several models at once,
+// e.g. one per language, with each recognizer running on its own SDK
+// threads. Results are reported as if from one transcriber: every final
+// result comes from the model that won its utterance, and partial results
+// and speech events from the model that won the last one.
+class MultiModelTranscriptionWorker : public SessionWorker<TranscriptionWorkerCallbackResult>
+{
+public:
+  const int id;
+
+  MultiModelTranscriptionWorker(const std::vector<TranscriptionModel> &models, const std::string &logsPath, const std::vector<std::string> &phrases, const std::vector<std::shared_ptr<AudioHubReader>> &hubReaders, bool detailed, const std::shared_ptr<ResultCredits> &credits, const Napi::Function &callback)
+      : SessionWorker<TranscriptionWorkerCallbackResult>(callback, "MultiModelTranscriptionWorker"), id(SessionRegistry::Instance().Add(std::make_shared<TranscriptionControl>(nullptr, credits))), models(models), logsPath(logsPath), phrases(phrases), hubReaders(hubReaders), detailed(detailed), credits(credits), arbiter(models.size())
+  {
+    this->SetCredits(credits);
+    this->metrics = AddSessionMetrics("transcription", this->id);
+    this->SetMetrics(this->metrics);
+    this->control = SessionRegistry::Instance().Get<TranscriptionControl>(this->id);
+    this->control->Post(RuntimeStatus::START);
+    this->control->Attach([this]
+                          { this->Schedule(); });
+  }
+
+  bool Execute(const ExecutionProgress &progress)
+  {
+    try
+    {
+      if (this->recognizers.empty())
+      {
+        this->Setup(progress);
+      }
+
+      // Only runs when start/stop/dispose was called
+      RuntimeStatus status;
+      while (this->control->Poll(this->seen, status))
+      {
+        switch (status)
+        {
+        case RuntimeStatus::START:
+          if (this->credits)
+          {
+            this->credits->SetBlocking(true);
+          }
+          if (this->started == 0)
+          {
+            this->metrics->Mark("startRequested");
+            {
+              std::lock_guard<std::mutex> lock(this->arbiterMutex);
+              this->arbiter.Reset();
+            }
+            this->ForEachRecognizer([](SpeechRecognizer &recognizer)
+                                    { return recognizer.StartContinuousRecognitionAsync(); });
+          }
+          break;
+        case RuntimeStatus::STOP:
+          // Results of the rest of the session must not hold up stopping
+          if (this->credits)
+          {
+            this->credits->SetBlocking(false);
+          }
+          if (this->started > 0)
+          {
+            for (auto &hubReader : this->hubReaders)
+            {
+              hubReader->Interrupt();
+            }
+            this->ForEachRecognizer([](SpeechRecognizer &recognizer)
+                                    { return recognizer.StopContinuousRecognitionAsync(); });
+          }
+          break;
+        case RuntimeStatus::DISPOSE:
+          this->Dispose(progress);
+          return false;
+        }
+      }
+      return true;
+    }
+    catch (const std::exception &e)
+    {
+      auto result = TranscriptionWorkerCallbackResult{StatusCode::ERROR, e.what()};
+      progress.Send(&result, 1);
+    }
+
+    this->Dispose(progress);
+    return false;
+  }
+
+  // Builds the recognizers at the same time, so that loading N models
+  // takes about as long as loading the slowest one.
+  void Setup(const ExecutionProgress &progress)
+  {
+    this->metrics->Mark("setup");
+    std::vector<std::future<std::shared_ptr<SpeechRecognizer>>> futures;
+    for (size_t i = 0; i < this->models.size(); i++)
+    {
+      futures.push_back(std::async(std::launch::async, [this, i]()
+                                   {
+        const auto &model = this->models[i];
+        // Detailed results carry the confidences utterances are decided by
+        auto speechConfig = AcquireTranscriptionConfig(model.path, model.name, model.key, this->logsPath, true);
+        auto recognizer = SpeechRecognizer::FromConfig(speechConfig, this->hubReaders[i]->CreateAudioConfig(this->hubReaders[i]));
+        auto phraseList = PhraseListGrammar::FromRecognizer(recognizer);
+        for (const auto &phrase : this->phrases)
+        {
+          phraseList->AddPhrase(phrase);
+        }
+        return recognizer; }));
+    }
+
+    std::vector<std::shared_ptr<SpeechRecognizer>> recognizers;
+    for (auto &future : futures)
+    {
+      recognizers.push_back(future.get());
+    }
+    this->metrics->Mark("recognizerCreated");
+    this->metrics->Measure("recognizerConstruction", "setup");
+
+    for (size_t i = 0; i < recognizers.size(); i++)
+    {
+      this->Connect(progress, *recognizers[i], i);
+    }
+    this->recognizers = recognizers;
+  }
+
+  void Connect(const ExecutionProgress &progress, SpeechRecognizer &recognizer, size_t model)
+  {
+    // Callback: intermediate transcription results
+    recognizer.Recognizing += [this, progress, model](const SpeechRecognitionEventArgs &e)
+    {
+      if (e.Result->Reason != ResultReason::RecognizingSpeech)
+      {
+        return;
+      }
+
+      // Final results before a partial one were all reported
+      this->Advance(progress, model, e.Result->Offset() / TicksPerMs);
+      if (model == this->leader)
+      {
+        this->metrics->MarkFirst("firstRecognizing");
+        auto result = TranscriptionWorkerCallbackResult{StatusCode::RECOGNIZING, e.Result->Text};
+        progress.Send(&result, 1);
+      }
+    };
+
+    // Callback: final transcription result (sentence)
+    recognizer.Recognized += [this, progress, model](const SpeechRecognitionEventArgs &e)
+    {
+      if (e.Result->Reason == ResultReason::RecognizedSpeech)
+      {
+        auto details = CreateTranscriptionDetails(*e.Result);
+        auto confidence = details->confidences.empty() ? 0 : details->confidences.front();
+        std::vector<UtteranceArbiter::Decision> decisions;
+        {
+          std::lock_guard<std::mutex> lock(this->arbiterMutex);
+          this->arbiter.Add({model, e.Result->Text, confidence, details->offset, details->offset + details->duration, details});
+          this->Decide(decisions);
+        }
+        this->SendDecisions(progress, decisions);
+      }
+      else if (e.Result->Reason == ResultReason::NoMatch)
+      {
+        this->Advance(progress, model, (e.Result->Offset() + e.Result->Duration()) / TicksPerMs);
+
+        StatusCode status;
+        switch (NoMatchDetails::FromResult(e.Result)->Reason)
+        {
+        case NoMatchReason::NotRecognized:
+          status = StatusCode::NOT_RECOGNIZED;
+          break;
+        case NoMatchReason::InitialSilenceTimeout:
+          status = StatusCode::INITIAL_SILENCE_TIMEOUT;
+          break;
+        case NoMatchReason::EndSilenceTimeout:
+          status = StatusCode::END_SILENCE_TIMEOUT;
+          break;
+        default:
+          return;
+        }
+        if (model == this->leader)
+        {
+          auto result = TranscriptionWorkerCallbackResult{status};
+          progress.Send(&result, 1);
+        }
+      }
+    };
+
+    // Callback: errors
+    recognizer.Canceled += [this, progress, model](const SpeechRecognitionCanceledEventArgs &e)
+    {
+      if (e.Reason == CancellationReason::Error)
+      {
+        auto result = TranscriptionWorkerCallbackResult{StatusCode::ERROR, e.ErrorDetails};
+        result.model = this->models[model].name;
+        progress.Send(&result, 1);
+      }
+    };
+
+    // Callback: begin of recognition session, reported once all began
+    recognizer.SessionStarted += [this, progress](const SessionEventArgs &e)
+    {
+      UNUSED(e);
+      if (++this->started == this->models.size())
+      {
+        this->metrics->Mark("started");
+        this->metrics->Measure("sessionStart", "startRequested");
+
+        auto result = TranscriptionWorkerCallbackResult{StatusCode::STARTED};
+        progress.Send(&result, 1);
+      }
+    };
+
+    // Callback: speech start detected
+    recognizer.SpeechStartDetected += [this, progress, model](const RecognitionEventArgs &e)
+    {
+      UNUSED(e);
+      if (model == this->leader)
+      {
+        this->metrics->Mark("speechStart");
+        auto result = TranscriptionWorkerCallbackResult{StatusCode::SPEECH_START_DETECTED};
+        progress.Send(&result, 1);
+      }
+    };
+
+    // Callback: speech end detected
+    recognizer.SpeechEndDetected += [this, progress, model](const RecognitionEventArgs &e)
+    {
+      UNUSED(e);
+      if (model == this->leader)
+      {
+        this->metrics->Mark("speechEnd");
+        auto result = TranscriptionWorkerCallbackResult{StatusCode::SPEECH_END_DETECTED};
+        progress.Send(&result, 1);
+      }
+    };
+
+    // Callback: end of recognition session, reported once all ended
+    recognizer.SessionStopped += [this, progress, model](const SessionEventArgs &e)
+    {
+      UNUSED(e);
+      std::vector<UtteranceArbiter::Decision> decisions;
+      {
+        std::lock_guard<std::mutex> lock(this->arbiterMutex);
+        this->arbiter.Finish(model);
+        this->Decide(decisions);
+      }
+      this->SendDecisions(progress, decisions);
+
+      if (--this->started == 0)
+      {
+        auto result = TranscriptionWorkerCallbackResult{StatusCode::STOPPED};
+        progress.Send(&result, 1);
+      }
+    };
+  }
+
+  // Stops and releases the recognizers, after which no progress is sent.
+  void Dispose(const ExecutionProgress &progress)
+  {
+    this->control->Detach();
+
+    if (this->credits)
+    {
+      this->credits->SetBlocking(false);
+    }
+    for (auto &hubReader : this->hubReaders)
+    {
+      hubReader->Close();
+    }
+    try
+    {
+      if (this->started > 0)
+      {
+        this->ForEachRecognizer([](SpeechRecognizer &recognizer)
+                                { return recognizer.StopContinuousRecognitionAsync(); });
+      }
+    }
+    catch (const std::exception &e)
+    {
+      auto result = TranscriptionWorkerCallbackResult{StatusCode::ERROR, e.what()};
+      progress.Send(&result, 1);
+    }
+    this->recognizers.clear();
+
+    SessionRegistry::Instance().Remove<TranscriptionControl>(this->id);
+    RemoveSessionMetrics("transcription", this->id);
+  }
+
+  void OnProgress(const TranscriptionWorkerCallbackResult *result, size_t /* count */)
+  {
+    Napi::HandleScope scope(Env());
+
+    Callback().Call({Env().Undefined(), this->CreateResult(*result)});
+  }
+
+  void OnOK()
+  {
+    Napi::HandleScope scope(Env());
+
+    Callback().Call({Env().Undefined(), this->CreateResult({StatusCode::DISPOSED})});
+  }
+
+  void OnError(const Napi::Error &e)
+  {
+    Napi::HandleScope scope(Env());
+
+    Callback().Call({Napi::String::New(Env(), e.Message())});
+  }
+
+private:
+  // Starts an operation on every recognizer before waiting for any, so
+  // that they run at the same time.
+  void ForEachRecognizer(const std::function<std::future<void>(SpeechRecognizer &)> &operation)
+  {
+    std::vector<std::future<void>> futures;
+    for (auto &recognizer : this->recognizers)
+    {
+      futures.push_back(operation(*recognizer));
+    }
+    for (auto &future : futures)
+    {
+      future.get();
+    }
+  }
+
+  void Advance(const ExecutionProgress &progress, size_t model, double position)
+  {
+    std::vector<UtteranceArbiter::Decision> decisions;
+    {
+      std::lock_guard<std::mutex> lock(this->arbiterMutex);
+      this->arbiter.Advance(model, position);
+      this->Decide(decisions);
+    }
+    this->SendDecisions(progress, decisions);
+  }
+
+  // Must be called with `arbiterMutex` held.
+  void Decide(std::vector<UtteranceArbiter::Decision> &decisions)
+  {
+    UtteranceArbiter::Decision decision;
+    while (this->arbiter.Next(decision))
+    {
+      this->leader = decision.model;
+      decisions.push_back(std::move(decision));
+    }
+  }
+
+  void SendDecisions(const ExecutionProgress &progress, const std::vector<UtteranceArbiter::Decision> &decisions)
+  {
+    for (const auto &decision : decisions)
+    {
+      auto result = TranscriptionWorkerCallbackResult{StatusCode::RECOGNIZED, decision.text};
+      result.details = this->detailed ? decision.details : nullptr;
+      result.model = this->models[decision.model].name;
+      result.confidence = decision.confidence;
+      progress.Send(&result, 1);
+    }
+  }
+
+  Napi::Object CreateResult(const TranscriptionWorkerCallbackResult &result)
+  {
+    auto jsResult = AddonData::Get(Env()).CreateResult(Env(), result.status, result.data);
+    if (result.details)
+    {
+      jsResult.Set("details", CreateTranscriptionDetailsObject(Env(), *result.details));
+    }
+    if (!result.model.empty())
+    {
+      jsResult.Set("model", Napi::String::New(Env(), result.model));
+    }
+    if (result.status == StatusCode::RECOGNIZED)
+    {
+      jsResult.Set("confidence", Napi::Number::New(Env(), result.confidence));
+    }
+    return jsResult;
+  }
+
+  const std::vector<TranscriptionModel> models;
+  const std::string logsPath;
+  const std::vector<std::string> phrases;
+  const std::vector<std::shared_ptr<AudioHubReader>> hubReaders;
+  const bool detailed;
+  const std::shared_ptr<ResultCredits> credits;
+  std::shared_ptr<TranscriptionControl> control;
+  std::shared_ptr<SessionMetrics> metrics;
+  std::vector<std::shared_ptr<SpeechRecognizer>> recognizers;
+  std::mutex arbiterMutex;
+  UtteranceArbiter arbiter;
+  std::atomic<size_t> leader{0};
+  std::atomic<size_t> started{0};
+  uint64_t seen = 0;
+};
+
+Napi::Value CreateMultiModelTranscriber(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 5)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsArray() || (!info[1].IsUndefined() && !info[1].IsString()) || !info[2].IsArray() || !info[3].IsObject() || !info[4].IsFunction())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto modelsRaw = info[0].As<Napi::Array>();
+  std::vector<TranscriptionModel> models;
+  for (uint32_t i = 0; i < static_cast<uint32_t>(modelsRaw.Length()); i++)
+  {
+    auto model = modelsRaw.Get(i);
+    if (!model.IsObject() || !model.As<Napi::Object>().Get("modelPath").IsString() || !model.As<Napi::Object>().Get("modelName").IsString() || !model.As<Napi::Object>().Get("modelKey").IsString())
+    {
+      Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    auto modelObject = model.As<Napi::Object>();
+    models.push_back({modelObject.Get("modelPath").As<Napi::String>().Utf8Value(), modelObject.Get("modelName").As<Napi::String>().Utf8Value(), modelObject.Get("modelKey").As<Napi::String>().Utf8Value()});
+  }
+  std::string logsPath;
+  if (!info[1].IsUndefined())
+  {
+    logsPath = info[1].As<Napi::String>().Utf8Value();
+  }
+  auto phrasesRaw = info[2].As<Napi::Array>();
+  std::vector<std::string> phrases;
+  for (uint32_t i = 0; i < static_cast<uint32_t>(phrasesRaw.Length()); i++)
+  {
+    phrases.push_back(phrasesRaw.Get(i).As<Napi::String>().Utf8Value());
+  }
+  auto options = info[3].As<Napi::Object>();
+  auto callback = info[4].As<Napi::Function>();
+
+  try
+  {
+    if (models.empty())
+    {
+      throw std::invalid_argument("No models to transcribe with");
+    }
+
+    // The SDK can't share its microphone capture, so every model reads
+    // the audio pushed to a hub.
+    std::vector<std::shared_ptr<AudioHubReader>> hubReaders;
+    for (const auto &model : models)
+    {
+      auto hubReader = CreateAudioHubReader(options, "transcription:" + model.name);
+      if (!hubReader)
+      {
+        throw std::invalid_argument("Transcribing with several models needs an audio hub");
+      }
+      hubReaders.push_back(hubReader);
+    }
+
+    bool detailed = options.Has("detailed") && options.Get("detailed").ToBoolean();
+    std::shared_ptr<ResultCredits> credits;
+    if (options.Get("maxPending").IsNumber())
+    {
+      credits = std::make_shared<ResultCredits>(options.Get("maxPending").As<Napi::Number>().Uint32Value());
+    }
+    auto *worker = new MultiModelTranscriptionWorker(models, logsPath, phrases, hubReaders, detailed, credits, callback);
+    worker->Queue();
+
+    return Napi::Number::New(env, worker->id);
+  }
+  catch (const std::exception &e)
+  {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+}
+
+#pragma endregion
+
+#pragma region FileTranscription
+
+// Layout of the PCM audio in a WAV file, read from its header.
+struct WavFormat
+{
+  uint32_t samplesPerSecond = 0;
+  uint32_t byteRate = 0;
+  uint16_t bitsPerSample = 0;
+  uint16_t channels = 0;
+  std::streamoff dataOffset = 0;
+  uint32_t dataSize = 0;
+
+  double DurationMs() const
+  {
+    return this->byteRate > 0 ? 1000.0 * this->dataSize / this->byteRate : 0;
+  }
+
+  // Whether a recognizer built for `other` can read this audio
+  bool SameStream(const WavFormat &other) const
+  {
+    return this->samplesPerSecond == other.samplesPerSecond && this->bitsPerSample == other.bitsPerSample && this->channels == other.channels;
+  }
+};
+
+// Reads the header of a PCM WAV file. Returns false if it is not one.
+bool ReadWavFormat(const std::string &path, WavFormat &wav)
+{
+  std::ifstream file(path, std::ios::binary);
+  char riff[12];
+  if (!file.read(riff, sizeof(riff)) || std::memcmp(riff, "RIFF", 4) != 0 || std::memcmp(riff + 8, "WAVE", 4) != 0)
+  {
+    return false;
+  }
+
+  auto read16 = [](const char *bytes)
+  {
+    return static_cast<uint16_t>(static_cast<uint8_t>(bytes[0]) | static_cast<uint8_t>(bytes[1]) << 8);
+  };
+  auto read32 = [](const char *bytes)
+  {
+    return static_cast<uint8_t>(bytes[0]) | static_cast<uint8_t>(bytes[1]) << 8 | static_cast<uint8_t>(bytes[2]) << 16 | static_cast<uint32_t>(static_cast<uint8_t>(bytes[3])) << 24;
+  };
+
+  bool pcm = false;
+  char chunk[8];
+  while (file.read(chunk, sizeof(chunk)))
+  {
+    uint32_t chunkSize = read32(chunk + 4);
+    if (std::memcmp(chunk, "fmt ", 4) == 0)
+    {
+      char format[16];
+      if (chunkSize < sizeof(format) || !file.read(format, sizeof(format)))
+      {
+        return false;
+      }
+
+      // Plain or extensible PCM
+      auto formatTag = read16(format);
+      pcm = formatTag == 1 || formatTag == 0xFFFE;
+      wav.channels = read16(format + 2);
+      wav.samplesPerSecond = read32(format + 4);
+      wav.byteRate = read32(format + 8);
+      wav.bitsPerSample = read16(format + 14);
+      chunkSize -= sizeof(format);
+    }
+    else if (std::memcmp(chunk, "data", 4) == 0)
+    {
+      wav.dataOffset = file.tellg();
+      wav.dataSize = chunkSize;
+      return pcm && wav.samplesPerSecond > 0 && wav.bitsPerSample > 0 && wav.channels > 0;
+    }
+
+    // Chunks are padded to an even size
+    file.seekg(chunkSize + (chunkSize & 1), std::ios::cur);
+  }
+
+  return false;
+}
+
+class FileTranscriptionControl : public WorkerControl
+{
+};
+
+void StopFileTranscriptionWorker(int workerId)
+{
+  if (auto control = SessionRegistry::Instance().Remove<FileTranscriptionControl>(workerId))
+  {
+    control->Post(RuntimeStatus::DISPOSE);
+  }
+}
+
+struct FileTranscriptionWorkerCallbackResult
+{
+  StatusCode status;
+  std::string path;
+  std::string data = "";
+  double audioDuration = 0;
+  double processingDuration = 0;
+};
+
+// One recognizer of the pool and the file it is on. The recognizer reads
+// the file through a pull stream, which stays open from file to file, since
+// the SDK does not read a stream again once it ended. Instead, each file
+// ends with a second of silence, which ends its last utterance, after
+// which reads wait for the worker to stop the recognizer and restart it on
+// the next file. SDK callbacks fill in the results, the worker picks them
+// up once the file ended or the session stopped.
+struct FileTranscriptionLane
+{
+  WavFormat format;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::ifstream file;
+  uint64_t remaining = 0;
+  uint64_t silence = 0;
+  std::string path;
+  std::chrono::steady_clock::time_point start;
+  std::string text;
+  std::string error;
+  bool busy = false;
+  bool stopping = false;
+  bool interrupted = false;
+  bool closed = false;
+  std::atomic<bool> done{false};
+
+  // Schedules the worker once the file ended
+  std::function<void()> ended;
+
+  // Released before the lane is
+  std::shared_ptr<SpeechRecognizer> recognizer;
+
+  // Called by the SDK. Past the end of the file and its silence, blocks
+  // until the recognizer is stopped, and only returns 0 (end of stream)
+  // once the stream is closed for good.
+  int Read(uint8_t *buffer, uint32_t size)
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if (this->remaining > 0 && this->file.is_open())
+    {
+      auto count = static_cast<std::streamsize>(std::min<uint64_t>(size, this->remaining));
+      this->file.read(reinterpret_cast<char *>(buffer), count);
+      auto read = this->file.gcount();
+      this->remaining = read == count ? this->remaining - count : 0;
+      if (read > 0)
+      {
+        return static_cast<int>(read);
+      }
+    }
+
+    if (this->silence > 0)
+    {
+      auto count = std::min<uint64_t>(size, this->silence);
+      std::memset(buffer, 0, static_cast<size_t>(count));
+      this->silence -= count;
+      if (this->silence == 0 && !this->stopping)
+      {
+        this->done = true;
+        lock.unlock();
+        this->ended();
+      }
+      return static_cast<int>(count);
+    }
+
+    this->wake.wait(lock, [this]
+                    { return this->interrupted || this->closed; });
+    if (this->closed)
+    {
+      return 0;
+    }
+
+    // Hand out silence so that the pending read does not hold up stopping
+    this->interrupted = false;
+    std::memset(buffer, 0, size);
+    return static_cast<int>(size);
+  }
+
+  // Wakes up a read waiting past the end of the file before the
+  // recognizer is stopped.
+  void Interrupt()
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->stopping = true;
+      this->interrupted = true;
+    }
+    this->wake.notify_all();
+  }
+
+  // Ends the stream, before the recognizer is released.
+  void Close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->closed = true;
+    }
+    this->wake.notify_all();
+  }
+};
+
+// Transcribes WAV files with a pool of up to `concurrency` recognizers,
+// all sharing one speech config. Each recognizer loads the model once and
+// takes file after file, and runs on SDK threads, so the worker only runs
+// to hand out files and collect finished ones.
+class FileTranscriptionWorker : public SessionWorker<FileTranscriptionWorkerCallbackResult>
+{
+public:
+  const int id;
+
+  FileTranscriptionWorker(const std::string &path, const std::string &key, const std::string &model, const std::string &logsPath, const std::vector<std::string> &phrases, const std::vector<std::string> &files, size_t concurrency, const Napi::Function &callback)
+      : SessionWorker<FileTranscriptionWorkerCallbackResult>(callback, "FileTranscriptionWorker"), id(SessionRegistry::Instance().Add(std::make_shared<FileTranscriptionControl>())), path(path), key(key), model(model), logsPath(logsPath), phrases(phrases), files(files), concurrency(std::max<size_t>(concurrency, 1))
+  {
+    this->control = SessionRegistry::Instance().Get<FileTranscriptionControl>(this->id);
+    this->control->Attach([this]
+                          { this->Schedule(); });
+  }
+
+  bool Execute(const ExecutionProgress &progress)
+  {
+    if (!this->speechConfig)
+    {
+      this->start = std::chrono::steady_clock::now();
+      try
+      {
+        this->speechConfig = AcquireTranscriptionConfig(path, model, key, logsPath);
+      }
+      catch (const std::exception &e)
+      {
+        this->SetError(e.what());
+        return this->End();
+      }
+    }
+
+    RuntimeStatus status;
+    while (this->control->Poll(this->seen, status))
+    {
+      this->canceled = this->canceled || status == RuntimeStatus::DISPOSE;
+    }
+
+    bool running = false;
+    for (auto &lane : this->lanes)
+    {
+      if (lane->busy && (this->canceled || lane->done))
+      {
+        this->Complete(*lane, progress);
+      }
+      running = running || lane->busy;
+    }
+
+    while (!this->canceled && this->next < this->files.size())
+    {
+      auto *lane = this->GetIdleLane();
+      if (!lane)
+      {
+        break;
+      }
+      this->Begin(*lane, this->files[this->next++], progress);
+      running = running || lane->busy;
+    }
+
+    if (!running && (this->canceled || this->next == this->files.size()))
+    {
+      return this->End();
+    }
+
+    return true;
+  }
+
+  void OnProgress(const FileTranscriptionWorkerCallbackResult *result, size_t /* count */)
+  {
+    Napi::HandleScope scope(Env());
+
+    auto jsResult = AddonData::Get(Env()).CreateResult(Env(), result->status, result->data);
+    jsResult.Set("path", Napi::String::New(Env(), result->path));
+    jsResult.Set("audioDuration", Napi::Number::New(Env(), result->audioDuration));
+    jsResult.Set("processingDuration", Napi::Number::New(Env(), result->processingDuration));
+
+    Callback().Call({Env().Undefined(), jsResult});
+  }
+
+  void OnOK()
+  {
+    Napi::HandleScope scope(Env());
+
+    auto elapsedSeconds = this->elapsed / 1000;
+    auto jsResult = AddonData::Get(Env()).CreateResult(Env(), StatusCode::STOPPED);
+    jsResult.Set("files", Napi::Number::New(Env(), static_cast<double>(this->completed)));
+    jsResult.Set("failed", Napi::Number::New(Env(), static_cast<double>(this->failed)));
+    jsResult.Set("recognizers", Napi::Number::New(Env(), static_cast<double>(this->recognizers)));
+    jsResult.Set("audioDuration", Napi::Number::New(Env(), this->audioDuration));
+    jsResult.Set("elapsed", Napi::Number::New(Env(), this->elapsed));
+    jsResult.Set("realTimeFactor", Napi::Number::New(Env(), this->audioDuration > 0 ? this->elapsed / this->audioDuration : 0));
+    jsResult.Set("filesPerSecond", Napi::Number::New(Env(), elapsedSeconds > 0 ? this->completed / elapsedSeconds : 0));
+
+    Callback().Call({Env().Undefined(), jsResult});
+  }
+
+  void OnError(const Napi::Error &e)
+  {
+    Napi::HandleScope scope(Env());
+
+    Callback().Call({Napi::String::New(Env(), e.Message())});
+  }
+
+private:
+  const std::string path;
+  const std::string key;
+  const std::string model;
+  const std::string logsPath;
+  const std::vector<std::string> phrases;
+  const std::vector<std::string> files;
+  const size_t concurrency;
+  std::shared_ptr<WorkerControl> control;
+  std::shared_ptr<EmbeddedSpeechConfig> speechConfig;
+  std::vector<std::unique_ptr<FileTranscriptionLane>> lanes;
+  std::chrono::steady_clock::time_point start;
+  size_t next = 0;
+  size_t completed = 0;
+  size_t failed = 0;
+  size_t recognizers = 0;
+  double audioDuration = 0;
+  double elapsed = 0;
+  bool canceled = false;
+  uint64_t seen = 0;
+
+  // Returns a lane without a file, adding one while there are fewer than
+  // `concurrency`, or null if all are busy.
+  FileTranscriptionLane *GetIdleLane()
+  {
+    for (auto &lane : this->lanes)
+    {
+      if (!lane->busy)
+      {
+        return lane.get();
+      }
+    }
+    if (this->lanes.size() < this->concurrency)
+    {
+      this->lanes.push_back(std::make_unique<FileTranscriptionLane>());
+      this->lanes.back()->ended = [this]
+      { this->Schedule(); };
+      return this->lanes.back().get();
+    }
+    return nullptr;
+  }
+
+  std::shared_ptr<SpeechRecognizer> CreateRecognizer(FileTranscriptionLane &lane, const WavFormat &wav)
+  {
+    // The lane outlives its recognizer, which is released before the
+    // lane is
+    auto *current = &lane;
+    {
+      std::lock_guard<std::mutex> lock(lane.mutex);
+      lane.closed = false;
+    }
+    auto format = AudioStreamFormat::GetWaveFormatPCM(wav.samplesPerSecond, static_cast<uint8_t>(wav.bitsPerSample), static_cast<uint8_t>(wav.channels));
+    auto stream = AudioInputStream::CreatePullStream(format, [current](uint8_t *buffer, uint32_t size)
+                                                     { return current->Read(buffer, size); });
+    auto recognizer = SpeechRecognizer::FromConfig(this->speechConfig, AudioConfig::FromStreamInput(stream));
+
+    auto phraseList = PhraseListGrammar::FromRecognizer(recognizer);
+    for (auto phrase : this->phrases)
+    {
+      phraseList->AddPhrase(phrase);
+    }
+
+    recognizer->Recognized += [current](const SpeechRecognitionEventArgs &e)
+    {
+      if (e.Result->Reason == ResultReason::RecognizedSpeech && !e.Result->Text.empty())
+      {
+        std::lock_guard<std::mutex> lock(current->mutex);
+        current->text += current->text.empty() ? e.Result->Text : " " + e.Result->Text;
+      }
+    };
+
+    recognizer->Canceled += [current](const SpeechRecognitionCanceledEventArgs &e)
+    {
+      if (e.Reason == CancellationReason::Error)
+      {
+        std::lock_guard<std::mutex> lock(current->mutex);
+        current->error = e.ErrorDetails;
+      }
+    };
+
+    // Only an error stops the session before the worker does
+    recognizer->SessionStopped += [this, current](const SessionEventArgs &e)
+    {
+      UNUSED(e);
+      {
+        std::lock_guard<std::mutex> lock(current->mutex);
+        if (current->stopping)
+        {
+          return;
+        }
+        current->done = true;
+      }
+      this->Schedule();
+    };
+
+    this->recognizers++;
+    return recognizer;
+  }
+
+  void Begin(FileTranscriptionLane &lane, const std::string &filePath, const ExecutionProgress &progress)
+  {
+    WavFormat wav;
+    if (!ReadWavFormat(filePath, wav))
+    {
+      auto result = FileTranscriptionWorkerCallbackResult{StatusCode::ERROR, filePath, "Not a PCM WAV file: " + filePath};
+      progress.Send(&result, 1);
+      this->failed++;
+      return;
+    }
+
+    try
+    {
+      // Files of another format need a recognizer of their own
+      if (!lane.recognizer || !lane.format.SameStream(wav))
+      {
+        this->ReleaseRecognizer(lane);
+        lane.recognizer = this->CreateRecognizer(lane, wav);
+      }
+      lane.format = wav;
+
+      {
+        std::lock_guard<std::mutex> lock(lane.mutex);
+        lane.file = std::ifstream(filePath, std::ios::binary);
+        lane.file.seekg(wav.dataOffset);
+        lane.remaining = wav.dataSize;
+        lane.silence = PcmBytes(wav.samplesPerSecond, wav.bitsPerSample, wav.channels, 1000);
+        lane.path = filePath;
+        lane.start = std::chrono::steady_clock::now();
+        lane.text.clear();
+        lane.error.clear();
+        lane.stopping = false;
+        lane.interrupted = false;
+        lane.done = false;
+      }
+
+      lane.busy = true;
+      lane.recognizer->StartContinuousRecognitionAsync().get();
+    }
+    catch (const std::exception &e)
+    {
+      // Built again for the next file
+      lane.busy = false;
+      {
+        std::lock_guard<std::mutex> lock(lane.mutex);
+        lane.file.close();
+      }
+      this->ReleaseRecognizer(lane);
+
+      auto result = FileTranscriptionWorkerCallbackResult{StatusCode::ERROR, filePath, e.what()};
+      progress.Send(&result, 1);
+      this->failed++;
+    }
+  }
+
+  void Complete(FileTranscriptionLane &lane, const ExecutionProgress &progress)
+  {
+    // Files interrupted by a cancellation are not reported
+    bool finished = lane.done;
+
+    bool broken = false;
+    lane.Interrupt();
+    try
+    {
+      lane.recognizer->StopContinuousRecognitionAsync().get();
+    }
+    catch (const std::exception &e)
+    {
+      std::lock_guard<std::mutex> lock(lane.mutex);
+      lane.error = e.what();
+      broken = true;
+    }
+    lane.busy = false;
+
+    {
+      std::lock_guard<std::mutex> lock(lane.mutex);
+      lane.file.close();
+      broken = broken || !lane.error.empty();
+    }
+
+    // Built again for the next file. Released outside the lock, since
+    // the SDK reads under it.
+    if (broken)
+    {
+      this->ReleaseRecognizer(lane);
+    }
+    if (!finished)
+    {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(lane.mutex);
+    auto result = FileTranscriptionWorkerCallbackResult{lane.error.empty() ? StatusCode::RECOGNIZED : StatusCode::ERROR, lane.path, lane.error.empty() ? lane.text : lane.error};
+    result.audioDuration = lane.format.DurationMs();
+    result.processingDuration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lane.start).count();
+    progress.Send(&result, 1);
+
+    if (lane.error.empty())
+    {
+      this->completed++;
+      this->audioDuration += result.audioDuration;
+    }
+    else
+    {
+      this->failed++;
+    }
+  }
+
+  // Ends the stream of the lane's recognizer, so that no read holds up
+  // releasing it.
+  void ReleaseRecognizer(FileTranscriptionLane &lane)
+  {
+    lane.Close();
+    lane.recognizer.reset();
+  }
+
+  bool End()
+  {
+    this->elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - this->start).count();
+    this->control->Detach();
+    for (auto &lane : this->lanes)
+    {
+      this->ReleaseRecognizer(*lane);
+    }
+    this->lanes.clear();
+    this->speechConfig.reset();
+    StopFileTranscriptionWorker(this->id);
+    return false;
+  }
+};
+
+Napi::Value TranscribeFiles(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 8)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsString() || !info[1].IsString() || !info[2].IsString() || (!info[3].IsUndefined() && !info[3].IsString()) || !info[4].IsArray() || !info[5].IsArray() || !info[6].IsObject() || !info[7].IsFunction())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto modelPath = info[0].As<Napi::String>().Utf8Value();
+  auto modelName = info[1].As<Napi::String>().Utf8Value();
+  auto modelKey = info[2].As<Napi::String>().Utf8Value();
+  std::string logsPath;
+  if (!info[3].IsUndefined())
+  {
+    logsPath = info[3].As<Napi::String>().Utf8Value();
+  }
+  auto phrasesRaw = info[4].As<Napi::Array>();
+  std::vector<std::string> phrases;
+  for (uint32_t i = 0; i < static_cast<uint32_t>(phrasesRaw.Length()); i++)
+  {
+    phrases.push_back(phrasesRaw.Get(i).As<Napi::String>().Utf8Value());
+  }
+  auto filesRaw = info[5].As<Napi::Array>();
+  std::vector<std::string> files;
+  for (uint32_t i = 0; i < static_cast<uint32_t>(filesRaw.Length()); i++)
+  {
+    files.push_back(filesRaw.Get(i).As<Napi::String>().Utf8Value());
+  }
+  auto options = info[6].As<Napi::Object>();
+  auto callback = info[7].As<Napi::Function>();
+
+  size_t concurrency = std::max(1u, std::thread::hardware_concurrency());
+  if (options.Has("concurrency") && options.Get("concurrency").IsNumber())
+  {
+    concurrency = options.Get("concurrency").As<Napi::Number>().Uint32Value();
+  }
+
+  try
+  {
+    auto *worker = new FileTranscriptionWorker(modelPath, modelKey, modelName, logsPath, phrases, files, concurrency, callback);
+    worker->Queue();
+
+    return Napi::Number::New(env, worker->id);
+  }
+  catch (const std::exception &e)
+  {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+}
+
+Napi::Value CancelFileTranscription(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() < 1)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  StopFileTranscriptionWorker(info[0].As<Napi::Number>().Int32Value());
+
+  return env.Undefined();
+}
+
+#pragma endregion
+
+#pragma region SynthesisCache
+
+// View of a whole file, mapped instead of read. The mapping is copy on
+// write, as it is handed to JS as an ArrayBuffer that JS may write to, and
+// outlives the file handles, which are closed once it is mapped.
+class MappedFile
+{
+public:
+  explicit MappedFile(const std::string &path)
+  {
+#ifdef _WIN32
+    auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+      return;
+    }
+    LARGE_INTEGER size;
+    auto mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0 ? CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr) : nullptr;
+    CloseHandle(file);
+    if (!mapping)
+    {
+      return;
+    }
+    this->data = static_cast<uint8_t *>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+    this->size = this->data ? static_cast<size_t>(size.QuadPart) : 0;
+    CloseHandle(mapping);
+#else
+    auto file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+      return;
+    }
+    struct stat info;
+    auto *data = fstat(file, &info) == 0 && info.st_size > 0 ? mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0) : MAP_FAILED;
+    close(file);
+    if (data == MAP_FAILED)
+    {
+      return;
+    }
+    this->data = static_cast<uint8_t *>(data);
+    this->size = static_cast<size_t>(info.st_size);
+#endif
+  }
+
+  ~MappedFile()
+  {
+    if (!this->data)
+    {
+      return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(this->data);
+#else
+    munmap(this->data, this->size);
+#endif
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const uint8_t *Data() const { return this->data; }
+  size_t Size() const { return this->size; }
+
+private:
+  uint8_t *data = nullptr;
+  size_t size = 0;
+};
+
+// Audio shared without copying: synthesized by the SDK, or a view into a
+// mapped cache file, which stays mapped as long as the view is used.
+struct AudioBuffer
+{
+  std::shared_ptr<const uint8_t> data;
+  size_t size = 0;
+
+  AudioBuffer() = default;
+
+  AudioBuffer(std::shared_ptr<const uint8_t> data, size_t size) : data(std::move(data)), size(size)
+  {
+  }
+
+  explicit AudioBuffer(const std::shared_ptr<std::vector<uint8_t>> &audio)
+      : data(audio ? std::shared_ptr<const uint8_t>(audio, audio->data()) : nullptr), size(audio ? audio->size() : 0)
+  {
+  }
+
+  explicit operator bool() const
+  {
+    return this->data != nullptr;
+  }
+};
+
+// Process wide LRU cache of synthesized audio, keyed by voice, output
+// format and text, so that repeated phrases skip synthesis. Entries are
+// evicted once they take more than `maxBytes`, which is 0, disabling the
+// cache, until configured. With a directory, entries are also written to
+// disk and mapped back in on a miss, so that they survive restarts.
+class SynthesisCache
+{
+public:
+  struct Stats
+  {
+    uint64_t hits;
+    uint64_t diskHits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    size_t bytes;
+    size_t maxBytes;
+  };
+
+  static SynthesisCache &Instance()
+  {
+    static auto *instance = new SynthesisCache();
+    return *instance;
+  }
+
+  void Configure(size_t maxBytes, const std::string &directory)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->maxBytes = maxBytes;
+    this->directory = directory;
+    this->Evict();
+  }
+
+  bool Enabled()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->maxBytes > 0;
+  }
+
+  AudioBuffer Get(const std::string &key)
+  {
+    std::string directory;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (this->maxBytes == 0)
+      {
+        return AudioBuffer();
+      }
+      auto it = this->index.find(key);
+      if (it != this->index.end())
+      {
+        this->hits++;
+        this->entries.splice(this->entries.begin(), this->entries, it->second);
+        return it->second->second;
+      }
+      directory = this->directory;
+    }
+
+    auto audio = directory.empty() ? AudioBuffer() : Load(GetPath(directory, key), key);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (!audio)
+    {
+      this->misses++;
+      return AudioBuffer();
+    }
+    this->diskHits++;
+    this->Insert(key, audio);
+    return audio;
+  }
+
+  void Put(const std::string &key, const AudioBuffer &audio)
+  {
+    if (!audio || audio.size == 0)
+    {
+      return;
+    }
+
+    std::string directory;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (audio.size > this->maxBytes || this->index.find(key) != this->index.end())
+      {
+        return;
+      }
+      this->Insert(key, audio);
+      directory = this->directory;
+    }
+
+    if (!directory.empty())
+    {
+      Store(GetPath(directory, key), key, audio);
+    }
+  }
+
+  Stats GetStats()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return Stats{this->hits, this->diskHits, this->misses, this->evictions, this->index.size(), this->bytes, this->maxBytes};
+  }
+
+private:
+  typedef std::pair<std::string, AudioBuffer> Entry;
+
+  // Files start with the magic, the key length and the key, followed by
+  // the audio.
+  static constexpr char Magic[4] = {'N', 'S', 'C', '1'};
+
+  std::mutex mutex;
+  std::list<Entry> entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+  size_t maxBytes = 0;
+  size_t bytes = 0;
+  std::string directory;
+  uint64_t hits = 0;
+  uint64_t diskHits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+
+  SynthesisCache() = default;
+
+  // Must be called with `mutex` held.
+  void Insert(const std::string &key, const AudioBuffer &audio)
+  {
+    if (this->index.find(key) != this->index.end())
+    {
+      return;
+    }
+    this->entries.emplace_front(key, audio);
+    this->index[key] = this->entries.begin();
+    this->bytes += audio.size;
+    this->Evict();
+  }
+
+  // Must be called with `mutex` held.
+  void Evict()
+  {
+    while (this->bytes > this->maxBytes && !this->entries.empty())
+    {
+      auto &last = this->entries.back();
+      this->bytes -= last.second.size;
+      this->index.erase(last.first);
+      this->entries.pop_back();
+      this->evictions++;
+    }
+  }
+
+  // FNV-1a, stable across processes unlike std::hash
+  static std::string GetPath(const std::string &directory, const std::string &key)
+  {
+    uint64_t hash = 14695981039346656037ull;
+    for (auto c : key)
+    {
+      hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+    }
+    char name[24];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(hash));
+    return directory + "/" + name;
+  }
+
+  // Returns the audio in the file as a view into its mapping.
+  static AudioBuffer Load(const std::string &path, const std::string &key)
+  {
+    auto file = std::make_shared<MappedFile>(path);
+    auto header = sizeof(Magic) + sizeof(uint32_t);
+    if (!file->Data() || file->Size() < header || std::memcmp(file->Data(), Magic, sizeof(Magic)) != 0)
+    {
+      return AudioBuffer();
+    }
+    uint32_t keyLength;
+    std::memcpy(&keyLength, file->Data() + sizeof(Magic), sizeof(keyLength));
+
+    // Different keys can share a file name
+    auto *start = file->Data() + header;
+    if (file->Size() <= header + keyLength || keyLength != key.size() || std::memcmp(start, key.data(), keyLength) != 0)
+    {
+      return AudioBuffer();
+    }
+    auto offset = header + keyLength;
+    return AudioBuffer(std::shared_ptr<const uint8_t>(file, file->Data() + offset), file->Size() - offset);
+  }
+
+  // Writes to a temporary file first, so that readers never map a file
+  // that is partially written. Temporary files are unique per process and
+  // call, so that concurrent stores of one key never write to the same one.
+  static void Store(const std::string &path, const std::string &key, const AudioBuffer &audio)
+  {
+    static std::atomic<uint64_t> stores{0};
+#ifdef _WIN32
+    auto processId = static_cast<uint64_t>(GetCurrentProcessId());
+#else
+    auto processId = static_cast<uint64_t>(getpid());
+#endif
+    auto temporaryPath = path + "." + std::to_string(processId) + "." + std::to_string(stores++) + ".tmp";
+    {
+      std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+      auto keyLength = static_cast<uint32_t>(key.size());
+      file.write(Magic, sizeof(Magic));
+      file.write(reinterpret_cast<const char *>(&keyLength), sizeof(keyLength));
+      file.write(key.data(), key.size());
+      file.write(reinterpret_cast<const char *>(audio.data.get()), audio.size);
+      if (!file)
+      {
+        file.close();
+        std::remove(temporaryPath.c_str());
+        return;
+      }
+    }
+    std::remove(path.c_str());
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+      std::remove(temporaryPath.c_str());
+    }
+  }
+};
+
+constexpr char SynthesisCache::Magic[4];
+
+Napi::Value GetSynthesisCacheStats(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+  auto stats = SynthesisCache::Instance().GetStats();
+  auto lookups = stats.hits + stats.diskHits + stats.misses;
+
+  auto jsResult = Napi::Object::New(env);
+  jsResult.Set("hits", Napi::Number::New(env, static_cast<double>(stats.hits)));
+  jsResult.Set("diskHits", Napi::Number::New(env, static_cast<double>(stats.diskHits)));
+  jsResult.Set("misses", Napi::Number::New(env, static_cast<double>(stats.misses)));
+  jsResult.Set("hitRate", Napi::Number::New(env, lookups > 0 ? static_cast<double>(stats.hits + stats.diskHits) / lookups : 0));
+  jsResult.Set("evictions", Napi::Number::New(env, static_cast<double>(stats.evictions)));
+  jsResult.Set("entries", Napi::Number::New(env, static_cast<double>(stats.entries)));
+  jsResult.Set("bytes", Napi::Number::New(env, static_cast<double>(stats.bytes)));
+  jsResult.Set("maxBytes", Napi::Number::New(env, static_cast<double>(stats.maxBytes)));
+  return jsResult;
+}
+
+Napi::Value ConfigureSynthesisCache(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() < 2)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber() || (!info[1].IsUndefined() && !info[1].IsString()))
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto maxBytes = info[0].As<Napi::Number>().Int64Value();
+  std::string directory;
+  if (info[1].IsString())
+  {
+    directory = info[1].As<Napi::String>().Utf8Value();
+  }
+  SynthesisCache::Instance().Configure(static_cast<size_t>(std::max<int64_t>(maxBytes, 0)), directory);
+
+  return env.Undefined();
+}
+
+#pragma endregion
+
+#pragma region Synthesizer
+
+// Splits streamed text into segments that can be synthesized on their own,
+// so that speaking starts after the first sentence instead of after the
+// whole text.
+class TextSegmenter
+{
+public:
+  // Shorter segments are not cut at ASCII terminators, which keeps short
+  // sentences such as "Yes. " together with the next one.
+  static const size_t MinSegmentLength = 12;
+
+  // Longer segments are also cut at clause boundaries.
+  static const size_t ClauseLength = 80;
+
+  // Longer segments are cut at the last whitespace.
+  static const size_t MaxSegmentLength = 400;
+
+  // Adds `chunk` and moves every completed segment to `segments`.
+  void Append(const std::string &chunk, std::vector<std::string> &segments)
+  {
+    this->pending += chunk;
+
+    size_t start = 0;
+    size_t end;
+    while ((end = this->FindEnd(start)) != std::string::npos)
+    {
+      AddSegment(this->pending.substr(start, end - start), segments);
+      start = end;
+    }
+    this->pending.erase(0, start);
+  }
+
+  // Moves the remaining text to `segments`, for the end of the stream.
+  void Flush(std::vector<std::string> &segments)
+  {
+    AddSegment(this->pending, segments);
+    this->pending.clear();
+  }
+
+  void Clear()
+  {
+    this->pending.clear();
+  }
+
+private:
+  std::string pending;
+
+  // Returns the end of the segment starting at `start`, or npos if it is
+  // not complete yet. Terminators only end a segment when followed by
+  // whitespace, which needs the next chunk when they end this one.
+  size_t FindEnd(size_t start) const
+  {
+    const auto &text = this->pending;
+    size_t lastSpace = std::string::npos;
+    size_t lastClause = std::string::npos;
+    for (size_t i = start; i < text.size(); i++)
+    {
+      auto length = i - start;
+      auto c = text[i];
+      if (c == '\n')
+      {
+        return i + 1;
+      }
+
+      // 。！？；： in UTF-8, which are not followed by whitespace
+      if (i + 2 < text.size() && IsCjkTerminator(text, i))
+      {
+        return i + 3;
+      }
+
+      if (std::isspace(static_cast<unsigned char>(c)))
+      {
+        lastSpace = i;
+        continue;
+      }
+
+      auto next = SkipClosing(text, i + 1);
+      if (next >= text.size() || !std::isspace(static_cast<unsigned char>(text[next])))
+      {
+        continue;
+      }
+      if ((c == '.' || c == '!' || c == '?' || c == ';' || c == ':') && length + 1 >= MinSegmentLength && !(c == '.' && IsAbbreviation(text, start, i)))
+      {
+        return next;
+      }
+      if (c == ',')
+      {
+        lastClause = next;
+      }
+    }
+
+    auto length = text.size() - start;
+    if (length >= ClauseLength && lastClause != std::string::npos)
+    {
+      return lastClause;
+    }
+    if (length >= MaxSegmentLength && lastSpace != std::string::npos && lastSpace > start)
+    {
+      return lastSpace;
+    }
+    return std::string::npos;
+  }
+
+  // Whether the '.' at `dot` ends an initial such as "J." or an
+  // abbreviation that is followed by more of the sentence, such as "Dr."
+  // or "e.g.", rather than the sentence.
+  static bool IsAbbreviation(const std::string &text, size_t start, size_t dot)
+  {
+    auto wordStart = dot;
+    while (wordStart > start && (std::isalpha(static_cast<unsigned char>(text[wordStart - 1])) || text[wordStart - 1] == '.'))
+    {
+      wordStart--;
+    }
+    if (dot - wordStart == 1)
+    {
+      return true;
+    }
+
+    std::string word;
+    for (auto i = wordStart; i < dot; i++)
+    {
+      word += static_cast<char>(std::tolower(static_cast<unsigned char>(text[i])));
+    }
+    for (auto abbreviation : {"dr", "mr", "mrs", "ms", "prof", "st", "mt", "vs", "e.g", "i.e", "fig", "approx", "gen", "capt", "rev"})
+    {
+      if (word == abbreviation)
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Skips closing quotes and brackets after a terminator.
+  static size_t SkipClosing(const std::string &text, size_t i)
+  {
+    while (i < text.size() && (text[i] == '"' || text[i] == '\'' || text[i] == ')' || text[i] == ']'))
+    {
+      i++;
+    }
+    return i;
+  }
+
+  static bool IsCjkTerminator(const std::string &text, size_t i)
+  {
+    auto b0 = static_cast<unsigned char>(text[i]);
+    auto b1 = static_cast<unsigned char>(text[i + 1]);
+    auto b2 = static_cast<unsigned char>(text[i + 2]);
+    if (b0 == 0xE3 && b1 == 0x80 && b2 == 0x82)
+    {
+      return true;
+    }
+    return b0 == 0xEF && b1 == 0xBC && (b2 == 0x81 || b2 == 0x9F || b2 == 0x9B || b2 == 0x9A);
+  }
+
+  static void AddSegment(const std::string &text, std::vector<std::string> &segments)
+  {
+    auto first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos)
+    {
+      return;
+    }
+    auto last = text.find_last_not_of(" \t\r\n");
+    segments.push_back(text.substr(first, last - first + 1));
+  }
+};
+
+#ifdef NODE_SPEECH_TEST_HOOKS
+
+// Runs `chunks` through a TextSegmenter, as if appended to a synthesizer
+// one by one, and returns the segments that would be synthesized.
+Napi::Value SegmentText(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 2)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsArray() || !info[1].IsBoolean())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto chunks = info[0].As<Napi::Array>();
+  TextSegmenter segmenter;
+  std::vector<std::string> segments;
+  for (uint32_t i = 0; i < chunks.Length(); i++)
+  {
+    segmenter.Append(chunks.Get(i).ToString().Utf8Value(), segments);
+  }
+  if (info[1].As<Napi::Boolean>().Value())
+  {
+    segmenter.Flush(segments);
+  }
+
+  return CreateStringArray(env, segments);
+}
+
+#endif
+
+// Checks that SSML is well-formed XML with a <speak> root, so that
+// malformed SSML is rejected when it is queued instead of failing in the
+// engine. Only the XML is checked, not the SSML elements.
+class SsmlValidator
+{
+public:
+  explicit SsmlValidator(const std::string &ssml) : ssml(ssml)
+  {
+  }
+
+  // Throws std::invalid_argument with the offset of the first error.
+  void Validate()
+  {
+    std::vector<std::string> elements;
+    bool root = false;
+    while (this->position < this->ssml.size())
+    {
+      auto c = this->ssml[this->position];
+      if (c == '<')
+      {
+        if (this->Skip("<!--"))
+        {
+          this->SkipPast("-->", "unterminated comment");
+        }
+        else if (this->Skip("<?"))
+        {
+          this->SkipPast("?>", "unterminated processing instruction");
+        }
+        else if (this->Skip("<![CDATA["))
+        {
+          if (elements.empty())
+          {
+            this->Fail("CDATA outside of <speak>");
+          }
+          this->SkipPast("]]>", "unterminated CDATA");
+        }
+        else if (this->Skip("</"))
+        {
+          auto name = this->ReadName();
+          this->SkipWhitespace();
+          this->Expect('>');
+          if (elements.empty() || elements.back() != name)
+          {
+            this->Fail("unexpected </" + name + ">");
+          }
+          elements.pop_back();
+        }
+        else if (this->Skip("<!"))
+        {
+          this->Fail("document type declarations are not supported");
+        }
+        else
+        {
+          this->position++;
+          auto name = this->ReadName();
+          if (elements.empty())
+          {
+            if (root)
+            {
+              this->Fail("content after </speak>");
+            }
+            if (name != "speak")
+            {
+              this->Fail("the root element must be <speak>");
+            }
+            root = true;
+          }
+          if (this->ReadAttributes())
+          {
+            elements.push_back(name);
+          }
+        }
+      }
+      else if (c == '&')
+      {
+        this->ReadReference();
+      }
+      else if (elements.empty() && !std::isspace(static_cast<unsigned char>(c)))
+      {
+        this->Fail("text outside of <speak>");
+      }
+      else
+      {
+        this->position++;
+      }
+    }
+
+    if (!elements.empty())
+    {
+      this->Fail("<" + elements.back() + "> is not closed");
+    }
+    if (!root)
+    {
+      this->Fail("missing <speak>");
+    }
+  }
+
+private:
+  const std::string &ssml;
+  size_t position = 0;
+
+  [[noreturn]] void Fail(const std::string &message) const
+  {
+    throw std::invalid_argument("Invalid SSML at offset " + std::to_string(this->position) + ": " + message);
+  }
+
+  bool Skip(const char *token)
+  {
+    auto length = std::strlen(token);
+    if (this->ssml.compare(this->position, length, token) != 0)
+    {
+      return false;
+    }
+    this->position += length;
+    return true;
+  }
+
+  void SkipPast(const char *token, const char *message)
+  {
+    auto end = this->ssml.find(token, this->position);
+    if (end == std::string::npos)
+    {
+      this->Fail(message);
+    }
+    this->position = end + std::strlen(token);
+  }
+
+  void SkipWhitespace()
+  {
+    while (this->position < this->ssml.size() && std::isspace(static_cast<unsigned char>(this->ssml[this->position])))
+    {
+      this->position++;
+    }
+  }
+
+  void Expect(char c)
+  {
+    if (this->position >= this->ssml.size() || this->ssml[this->position] != c)
+    {
+      this->Fail(std::string("expected '") + c + "'");
+    }
+    this->position++;
+  }
+
+  static bool IsNameChar(unsigned char c, bool first)
+  {
+    return std::isalpha(c) || c == '_' || c == ':' || c >= 0x80 || (!first && (std::isdigit(c) || c == '-' || c == '.'));
+  }
+
+  std::string ReadName()
+  {
+    auto start = this->position;
+    while (this->position < this->ssml.size() && IsNameChar(static_cast<unsigned char>(this->ssml[this->position]), this->position == start))
+    {
+      this->position++;
+    }
+    if (this->position == start)
+    {
+      this->Fail("expected a name");
+    }
+    return this->ssml.substr(start, this->position - start);
+  }
+
+  // Reads the attributes of a start tag up to its end, returns false if
+  // the element is self-closing.
+  bool ReadAttributes()
+  {
+    std::vector<std::string> names;
+    while (true)
+    {
+      auto start = this->position;
+      this->SkipWhitespace();
+      if (this->position >= this->ssml.size())
+      {
+        this->Fail("unterminated tag");
+      }
+      if (this->Skip("/>"))
+      {
+        return false;
+      }
+      if (this->Skip(">"))
+      {
+        return true;
+      }
+      if (this->position == start)
+      {
+        this->Fail("expected whitespace before an attribute");
+      }
+
+      auto name = this->ReadName();
+      if (std::find(names.begin(), names.end(), name) != names.end())
+      {
+        this->Fail("duplicate attribute " + name);
+      }
+      names.push_back(name);
+
+      this->SkipWhitespace();
+      this->Expect('=');
+      this->SkipWhitespace();
+      if (this->position >= this->ssml.size() || (this->ssml[this->position] != '"' && this->ssml[this->position] != '\''))
+      {
+        this->Fail("expected a quoted value for " + name);
+      }
+      auto quote = this->ssml[this->position++];
+      while (this->position < this->ssml.size() && this->ssml[this->position] != quote)
+      {
+        if (this->ssml[this->position] == '<')
+        {
+          this->Fail("'<' in the value of " + name);
+        }
+        if (this->ssml[this->position] == '&')
+        {
+          this->ReadReference();
+        }
+        else
+        {
+          this->position++;
+        }
+      }
+      this->Expect(quote);
+    }
+  }
+
+  void ReadReference()
+  {
+    static const char *entities[] = {"&amp;", "&lt;", "&gt;", "&quot;", "&apos;"};
+    for (auto *entity : entities)
+    {
+      if (this->Skip(entity))
+      {
+        return;
+      }
+    }
+
+    auto start = this->position;
+    auto hex = this->Skip("&#x");
+    if (!hex && !this->Skip("&#"))
+    {
+      this->Fail("invalid entity reference");
+    }
+    auto digits = this->position;
+    while (this->position < this->ssml.size() && (hex ? std::isxdigit(static_cast<unsigned char>(this->ssml[this->position])) : std::isdigit(static_cast<unsigned char>(this->ssml[this->position]))))
+    {
+      this->position++;
+    }
+    if (this->position == digits || this->position >= this->ssml.size() || this->ssml[this->position] != ';')
+    {
+      this->position = start;
+      this->Fail("invalid character reference");
+    }
+    this->position++;
+  }
+};
+
+std::string EscapeXml(const std::string &text)
+{
+  std::string escaped;
+  escaped.reserve(text.size());
+  for (auto c : text)
+  {
+    switch (c)
+    {
+    case '&':
+      escaped += "&amp;";
+      break;
+    case '<':
+      escaped += "&lt;";
+      break;
+    case '>':
+      escaped += "&gt;";
+      break;
+    case '"':
+      escaped += "&quot;";
+      break;
+    case '\'':
+      escaped += "&apos;";
+      break;
+    default:
+      escaped.push_back(c);
+    }
+  }
+  return escaped;
+}
+
+struct ProsodyOptions
+{
+  // Multiplier of the default speaking rate, 0 keeps the default
+  double rate = 0;
+
+  // Semitones to raise or lower the pitch by
+  double pitch = 0;
+
+  // Pause after the text
+  int64_t breakMs = 0;
+
+  // Voices distort beyond an octave, and SSML breaks are at most 5s
+  static constexpr double MaxPitch = 12;
+  static constexpr int64_t MaxBreakMs = 5000;
+
+  bool IsSet() const
+  {
+    return this->rate > 0 || this->pitch != 0 || this->breakMs > 0;
+  }
+};
+
+// Wraps plain text in SSML for `voice`, so that the engine applies the
+// rate and pitch while synthesizing instead of the audio being stretched
+// afterwards.
+std::string CreateProsodySsml(const std::string &text, const std::string &voice, const ProsodyOptions &prosody)
+{
+  // Embedded voice names contain their locale, e.g.
+  // "Microsoft Server Speech Text to Speech Voice (en-US, AriaNeural)"
+  std::string locale = "en-US";
+  auto open = voice.find('(');
+  auto comma = voice.find(',', open);
+  if (open != std::string::npos && comma != std::string::npos)
+  {
+    locale = voice.substr(open + 1, comma - open - 1);
+  }
+
+  std::string attributes;
+  char value[32];
+  if (prosody.rate > 0)
+  {
+    // The engine supports half to twice the default rate
+    std::snprintf(value, sizeof(value), "%.2f", std::min(std::max(prosody.rate, 0.5), 2.0));
+    attributes += std::string(" rate=\"") + value + "\"";
+  }
+  if (prosody.pitch != 0 && !std::isnan(prosody.pitch))
+  {
+    std::snprintf(value, sizeof(value), "%+.1fst", std::min(std::max(prosody.pitch, -ProsodyOptions::MaxPitch), ProsodyOptions::MaxPitch));
+    attributes += std::string(" pitch=\"") + value + "\"";
+  }
+
+  std::string ssml = "<speak version=\"1.0\" xmlns=\"http://www.w3.org/2001/10/synthesis\" xml:lang=\"" + EscapeXml(locale) + "\">";
+  ssml += "<voice name=\"" + EscapeXml(voice) + "\">";
+  if (attributes.empty())
+  {
+    ssml += EscapeXml(text);
+  }
+  else
+  {
+    ssml += "<prosody" + attributes + ">" + EscapeXml(text) + "</prosody>";
+  }
+  if (prosody.breakMs > 0)
+  {
+    ssml += "<break time=\"" + std::to_string(std::min(prosody.breakMs, ProsodyOptions::MaxBreakMs)) + "ms\"/>";
+  }
+  ssml += "</voice></speak>";
+  return ssml;
+}
+
+ProsodyOptions GetProsodyOptions(const Napi::Object &options)
+{
+  ProsodyOptions prosody;
+  if (options.Get("rate").IsNumber())
+  {
+    prosody.rate = options.Get("rate").As<Napi::Number>().DoubleValue();
+  }
+  if (options.Get("pitch").IsNumber())
+  {
+    prosody.pitch = options.Get("pitch").As<Napi::Number>().DoubleValue();
+  }
+  if (options.Get("breakMs").IsNumber())
+  {
+    prosody.breakMs = options.Get("breakMs").As<Napi::Number>().Int64Value();
+  }
+  return prosody;
+}
+
+#ifdef NODE_SPEECH_TEST_HOOKS
+
+// Returns the SSML that plain text is synthesized as with the rate, pitch
+// and break in `options`.
+Napi::Value CreateProsodySsmlForTest(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 3)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsString() || !info[1].IsString() || !info[2].IsObject())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto ssml = CreateProsodySsml(info[0].As<Napi::String>().Utf8Value(), info[1].As<Napi::String>().Utf8Value(), GetProsodyOptions(info[2].As<Napi::Object>()));
+  return Napi::String::New(env, ssml);
+}
+
+#endif
+
+// Text or SSML to synthesize, with its audio if it was cached. Text
+// queued through `synthesize` has an id to report its completion by,
+// streamed text has none.
+struct Utterance
+{
+  std::string text;
+  bool ssml = false;
+  AudioBuffer audio;
+  uint32_t id = 0;
+};
+
+// Per-worker queue of text to synthesize. The worker is woken as soon as
+// text arrives or a command is posted, and keeps up to `MaxInFlight`
+// utterances submitted to the SDK so that the next one is synthesized
+// while the current one is still playing.
+//
+// Text with a higher priority is dispatched first, text with the same
+// priority in the order it was queued.
+class SynthesizerQueue : public WorkerControl
+{
+public:
+  static const size_t MaxInFlight = 2;
+
+  // The voice name, used for SSML built from prosody options
+  const std::string voice;
+
+  explicit SynthesizerQueue(const std::string &voice) : voice(voice)
+  {
+  }
+
+  // `interrupt` stops the utterance that is playing, `flush` drops the
+  // text that is still queued, including streamed text, before `text`
+  // is queued. Returns the id of the utterance, or 0 if there is no text.
+  uint32_t Push(const std::string &text, bool ssml = false, int priority = 0, bool interrupt = false, bool flush = false)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (flush)
+    {
+      this->FlushQueued();
+    }
+    if (interrupt)
+    {
+      this->interrupt = true;
+      this->requeue = !flush;
+    }
+    uint32_t id = 0;
+    if (!text.empty())
+    {
+      id = this->utterances++;
+      this->texts.push(QueuedText{priority, this->sequence++, Utterance{text, ssml, AudioBuffer(), id}});
+    }
+    if (interrupt || !text.empty() || !this->canceled.empty())
+    {
+      this->Wake();
+    }
+    return id;
+  }
+
+  // Adds a chunk of streamed text, queueing each segment once it is
+  // complete.
+  void Append(const std::string &chunk)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::vector<std::string> segments;
+    this->segmenter.Append(chunk, segments);
+    this->PushSegments(segments);
+  }
+
+  // Queues the rest of the streamed text.
+  void Flush()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::vector<std::string> segments;
+    this->segmenter.Flush(segments);
+    this->PushSegments(segments);
+  }
+
+  // Stops speaking and drops everything queued. Text queued afterwards
+  // is spoken again.
+  void Stop()
+  {
+    this->Push("", false, 0, true, true);
+  }
+
+  // Called when an utterance submitted to the SDK completed or failed,
+  // returns it.
+  Utterance Done()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    Utterance utterance;
+    auto it = std::find_if(this->inFlight.begin(), this->inFlight.end(), [](const QueuedText &queued)
+                           { return !queued.utterance.audio; });
+    if (it != this->inFlight.end())
+    {
+      utterance = std::move(it->utterance);
+      this->inFlight.erase(it);
+    }
+    this->Wake();
+    return utterance;
+  }
+
+  // Sets the audio of the text dispatched last, which is then returned by
+  // `Next` once the utterances before it are done, instead of being
+  // submitted to the SDK.
+  void Cached(const AudioBuffer &audio)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (!this->inFlight.empty())
+    {
+      this->inFlight.back().utterance.audio = audio;
+    }
+    this->Wake();
+  }
+
+  size_t InFlight()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->inFlight.size();
+  }
+
+  // Returns the ids of the utterances that were stopped or dropped since
+  // the last call.
+  std::vector<uint32_t> TakeCanceled()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::vector<uint32_t> canceled;
+    canceled.swap(this->canceled);
+    return canceled;
+  }
+
+  // Returns STOP if the utterances submitted to the SDK must be stopped,
+  // START and sets `utterance` if cached audio is up next or text can be
+  // dispatched, otherwise returns the latest status if a command newer
+  // than `seen` was posted.
+  bool Next(uint64_t &seen, RuntimeStatus &status, Utterance &utterance)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    utterance = Utterance();
+    if (this->interrupt)
+    {
+      this->interrupt = false;
+      if (!this->inFlight.empty())
+      {
+        // Stopping drops every submitted utterance, the ones that did
+        // not start playing yet are queued again.
+        this->Cancel(this->inFlight.front().utterance);
+        this->inFlight.pop_front();
+        while (this->requeue && !this->inFlight.empty())
+        {
+          this->inFlight.front().utterance.audio = AudioBuffer();
+          this->texts.push(std::move(this->inFlight.front()));
+          this->inFlight.pop_front();
+        }
+        for (const auto &queued : this->inFlight)
+        {
+          this->Cancel(queued.utterance);
+        }
+        this->inFlight.clear();
+        status = RuntimeStatus::STOP;
+        return true;
+      }
+    }
+    if (!this->inFlight.empty() && this->inFlight.front().utterance.audio)
+    {
+      utterance = std::move(this->inFlight.front().utterance);
+      this->inFlight.pop_front();
+      status = RuntimeStatus::START;
+      return true;
+    }
+    if (this->CanDispatch())
+    {
+      auto next = this->texts.top();
+      this->texts.pop();
+      utterance = next.utterance;
+      this->inFlight.push_back(std::move(next));
+      status = RuntimeStatus::START;
+      return true;
+    }
+    return this->Poll(seen, status);
+  }
+
+private:
+  struct QueuedText
+  {
+    int priority;
+    uint64_t sequence;
+    Utterance utterance;
+  };
+
+  struct QueuedTextOrder
+  {
+    bool operator()(const QueuedText &a, const QueuedText &b) const
+    {
+      return a.priority != b.priority ? a.priority < b.priority : a.sequence > b.sequence;
+    }
+  };
+
+  std::priority_queue<QueuedText, std::vector<QueuedText>, QueuedTextOrder> texts;
+  std::deque<QueuedText> inFlight;
+  TextSegmenter segmenter;
+  uint64_t sequence = 0;
+  uint32_t utterances = 1;
+  std::vector<uint32_t> canceled;
+  bool interrupt = false;
+  bool requeue = false;
+
+  bool CanDispatch() const
+  {
+    return this->Status() == RuntimeStatus::START && !this->texts.empty() && this->inFlight.size() < MaxInFlight;
+  }
+
+  void FlushQueued()
+  {
+    while (!this->texts.empty())
+    {
+      this->Cancel(this->texts.top().utterance);
+      this->texts.pop();
+    }
+    this->segmenter.Clear();
+  }
+
+  void Cancel(const Utterance &utterance)
+  {
+    if (utterance.id)
+    {
+      this->canceled.push_back(utterance.id);
+    }
+  }
+
+  void PushSegments(std::vector<std::string> &segments)
+  {
+    if (segments.empty())
+    {
+      return;
+    }
+    for (auto &segment : segments)
+    {
+      this->texts.push(QueuedText{0, this->sequence++, Utterance{std::move(segment)}});
+    }
+    this->Wake();
+  }
+};
+
+#ifdef NODE_SPEECH_TEST_HOOKS
+
+// Runs `operations` against a SynthesizerQueue the way a synthesizer
+// worker does, without a synthesizer, and returns what happened as a log:
+// "start <text>" or "stop" for what `next` dispatched, "idle" if nothing,
+// "done <text>" for the utterance `done` completed, and "canceled <id>"
+// for utterances dropped by an operation. Operations are objects with an
+// `op` of push, append, flush, next or done, and the text and options of
+// push and append.
+Napi::Value TestSynthesizerQueue(const Napi::CallbackInfo &info)
+{
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() != 1)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsArray())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto operations = info[0].As<Napi::Array>();
+  SynthesizerQueue queue("voice");
+  uint64_t seen = 0;
+  std::vector<std::string> log;
+  for (uint32_t i = 0; i < operations.Length(); i++)
+  {
+    auto operation = operations.Get(i).As<Napi::Object>();
+    auto op = operation.Get("op").ToString().Utf8Value();
+    auto text = operation.Has("text") ? operation.Get("text").ToString().Utf8Value() : "";
+    if (op == "push")
+    {
+      queue.Push(text, false, operation.Get("priority").IsNumber() ? operation.Get("priority").As<Napi::Number>().Int32Value() : 0, operation.Get("interrupt").ToBoolean(), operation.Get("flush").ToBoolean());
+    }
+    else if (op == "append")
+    {
+      queue.Append(text);
+    }
+    else if (op == "flush")
+    {
+      queue.Flush();
+    }
+    else if (op == "next")
+    {
+      RuntimeStatus status;
+      Utterance utterance;
+      if (!queue.Next(seen, status, utterance))
+      {
+        log.push_back("idle");
+      }
+      else
+      {
+        log.push_back(status == RuntimeStatus::STOP ? "stop" : "start " + utterance.text);
+      }
+    }
+    else if (op == "done")
+    {
+      log.push_back("done " + queue.Done().text);
+    }
+    else
+    {
+      Napi::TypeError::New(env, "Unknown operation: " + op).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    for (auto id : queue.TakeCanceled())
+    {
+      log.push_back("canceled " + std::to_string(id));
+    }
+  }
+
+  return CreateStringArray(env, log);
+}
+
+#endif
+
+std::shared_ptr<EmbeddedSpeechConfig> AcquireSynthesizerConfig(const std::string &path, const std::string &model, const std::string &key, const std::string &logsPath, bool stream, const std::string &outputFormat)
+{
+  auto cacheKey = CreateCacheKey({"synthesis", path, model, key, logsPath, stream ? "stream" : "speaker", outputFormat});
+  return SpeechConfigCache::Instance().Acquire(cacheKey, [&]()
+                                               {
+    auto speechConfig = EmbeddedSpeechConfig::FromPath(path);
+    speechConfig->SetSpeechSynthesisVoice(model, key);
+    if (!logsPath.empty())
+    {
+      speechConfig->SetProperty(PropertyId::Speech_LogFilename, logsPath);
+    }
+    if (!outputFormat.empty())
+    {
+      // Takes the names of SpeechSynthesisOutputFormat, e.g. raw-16khz-16bit-mono-pcm
+      speechConfig->SetProperty(PropertyId::SpeechServiceConnection_SynthOutputFormat, outputFormat);
+    }
+    else if (stream)
+    {
+      speechConfig->SetSpeechSynthesisOutputFormat(SpeechSynthesisOutputFormat::Raw24Khz16BitMonoPcm);
+    }
+    else
+    {
+      speechConfig->SetSpeechSynthesisOutputFormat(SpeechSynthesisOutputFormat::Riff24Khz16BitMonoPcm);
+    }
+    return speechConfig; });
+}
+
+struct WarmSynthesizer
+{
+  std::shared_ptr<EmbeddedSpeechConfig> speechConfig;
+  std::shared_ptr<SpeechSynthesizer> synthesizer;
+};
+
+static WarmPool<WarmSynthesizer> warmSynthesizers("synthesizer");
+
+std::string GetWarmSynthesizerKey(const std::string &path, const std::string &model, const std::string &key, const std::string &logsPath, bool stream, const std::string &outputFormat)
+{
+  return CreateCacheKey({path, model, key, logsPath, stream ? "stream" : "speaker", outputFormat});
+}
+
+std::shared_ptr<SpeechSynthesizer> CreateSpeechSynthesizer(const std::shared_ptr<EmbeddedSpeechConfig> &speechConfig, bool stream)
+{
+  // The nullptr overload creates a synthesizer without audio output,
+  // the audio is only handed to the Synthesizing callback.
+  return stream ? SpeechSynthesizer::FromConfig(speechConfig, nullptr) : SpeechSynthesizer::FromConfig(speechConfig, AudioConfig::FromDefaultSpeakerOutput());
+}
+
+// Builds a streaming synthesizer ahead of time, and runs a synthesis on it
+// so that the voice is loaded by the synthesizer the session adopts. A
+// synthesizer of the speaker would play the warm-up, so there a throwaway
+// synthesizer without audio output runs it instead, which only gets the
+// voice into the page cache.
+void PrewarmSynthesizerModel(const std::string &path, const std::string &model, const std::string &key, const std::string &logsPath, bool stream, const std::string &outputFormat)
+{
+  auto warmKey = GetWarmSynthesizerKey(path, model, key, logsPath, stream, outputFormat);
+  if (warmSynthesizers.Has(warmKey))
+  {
+    return;
+  }
+
+  auto speechConfig = AcquireSynthesizerConfig(path, model, key, logsPath, stream, outputFormat);
+  if (!stream)
+  {
+    SpeechSynthesizer::FromConfig(speechConfig, nullptr)->SpeakTextAsync("Hello.").get();
+    return;
+  }
+
+  auto synthesizer = CreateSpeechSynthesizer(speechConfig, stream);
+  synthesizer->SpeakTextAsync("Hello.").get();
+
+  auto warm = std::make_shared<WarmSynthesizer>();
+  warm->speechConfig = speechConfig;
+  warm->synthesizer = synthesizer;
+  warmSynthesizers.Put(warmKey, warm);
+}
+
+void UpdateSynthesizerWorkerStatus(int workerId, RuntimeStatus status)
+{
+  if (auto queue = SessionRegistry::Instance().Get<SynthesizerQueue>(workerId))
+  {
+    queue->Post(status);
+  }
+}
+
+// Returns the id of the utterance, or 0 if nothing was queued.
+uint32_t AddTextToSynthesize(int workerId, const std::string &text, bool ssml, const ProsodyOptions &prosody, int priority, bool interrupt, bool flush)
+{
+  auto queue = SessionRegistry::Instance().Get<SynthesizerQueue>(workerId);
+  if (!queue)
+  {
+    return 0;
+  }
+  if (!ssml && prosody.IsSet() && !text.empty())
+  {
+    return queue->Push(CreateProsodySsml(text, queue->voice, prosody), true, priority, interrupt, flush);
+  }
+  return queue->Push(text, ssml, priority, interrupt, flush);
+}
+
+void StopSynthesizerWorker(int workerId)
+{
+  if (auto queue = SessionRegistry::Instance().Get<SynthesizerQueue>(workerId))
+  {
+    queue->Stop();
+  }
+}
+
+void AppendTextToSynthesize(int workerId, const std::string &chunk, bool flush)
+{
+  if (auto queue = SessionRegistry::Instance().Get<SynthesizerQueue>(workerId))
+  {
+    queue->Append(chunk);
+    if (flush)
+    {
+      queue->Flush();
+    }
+  }
+}
+
+struct SynthesizerWorkerCallbackResult
 {
   StatusCode status;
   std::string data = "";
+  AudioBuffer audio;
+
+  // The utterance that completed, was canceled or failed
+  uint32_t utterance = 0;
 };
 
-class TranscriptionWorker : public Napi::AsyncProgressQueueWorker<TranscriptionWorkerCallbackResult>
+// Wraps a synthesized audio chunk as an ArrayBuffer without copying it.
+// The chunk is kept alive until the ArrayBuffer is garbage collected.
+Napi::ArrayBuffer CreateAudioArrayBuffer(Napi::Env env, const AudioBuffer &audio)
+{
+#ifdef NODE_API_NO_EXTERNAL_BUFFERS_ALLOWED
+  // Runtimes with a V8 sandbox, like Electron, reject external buffers
+  auto arrayBuffer = Napi::ArrayBuffer::New(env, audio.size);
+  std::memcpy(arrayBuffer.Data(), audio.data.get(), audio.size);
+  return arrayBuffer;
+#else
+  auto *hint = new std::shared_ptr<const uint8_t>(audio.data);
+  return Napi::ArrayBuffer::New(
+      env, const_cast<uint8_t *>(audio.data.get()), audio.size, [](Napi::Env /* env */, void * /* data */, std::shared_ptr<const uint8_t> *hint)
+      { delete hint; },
+      hint);
+#endif
+}
+
+class SynthesizerWorker : public SessionWorker<SynthesizerWorkerCallbackResult>
 {
 public:
   const int id;
 
-  TranscriptionWorker(const std::string &path, const std::string &key, const std::string &model, const std::string &logsPath, const std::vector<std::string> &phrases, const Napi::Function &callback)
-      : Napi::AsyncProgressQueueWorker<TranscriptionWorkerCallbackResult>(callback), id(transcriptionWorkerIds++), path(path), key(key), model(model), logsPath(logsPath), phrases(phrases), started(false)
+  SynthesizerWorker(const std::string &path, const std::string &key, const std::string &model, const std::string &logsPath, bool stream, const std::string &outputFormat, const std::shared_ptr<WarmSynthesizer> &warm, const Napi::Function &callback)
+      : SessionWorker<SynthesizerWorkerCallbackResult>(callback, "SynthesizerWorker"), id(SessionRegistry::Instance().Add(std::make_shared<SynthesizerQueue>(model))), path(path), key(key), model(model), logsPath(logsPath), stream(stream), outputFormat(outputFormat), warm(warm)
   {
-    UpdateTranscriptionWorkerStatus(this->id, RuntimeStatus::START);
+    this->metrics = AddSessionMetrics("synthesis", this->id);
+    this->SetMetrics(this->metrics);
+    this->queue = SessionRegistry::Instance().Get<SynthesizerQueue>(this->id);
+    this->queue->Post(RuntimeStatus::START);
+    this->queue->Attach([this]
+                        { this->Schedule(); });
   }
 
-  void Execute(const ExecutionProgress &progress)
+  bool Execute(const ExecutionProgress &progress)
   {
     try
     {
-      auto speechConfig = EmbeddedSpeechConfig::FromPath(path);
-      speechConfig->SetSpeechRecognitionModel(model, key);
-      if (!this->logsPath.empty())
-      {
-        speechConfig->SetProperty(PropertyId::Speech_LogFilename, logsPath);
-      }
-
-      auto audioConfig = AudioConfig::FromDefaultMicrophoneInput();
-      auto recognizer = SpeechRecognizer::FromConfig(speechConfig, audioConfig);
-
-      auto phraseList = PhraseListGrammar::FromRecognizer(recognizer);
-      for (auto phrase : this->phrases)
+      if (!this->synthesizer)
       {
-        phraseList->AddPhrase(phrase);
+        this->Setup(progress);
       }
 
-      // Callback: intermediate transcription results
-      recognizer->Recognizing += [progress](const SpeechRecognitionEventArgs &e)
+      // Only runs when text is queued, an utterance finished or
+      // stop/dispose is called. Text is dispatched as soon as it
+      // arrives, while the previous utterance is still playing, so
+      // that queued utterances play without gaps. Interrupts are
+      // handled as soon as they are queued.
+      Utterance utterance;
+      RuntimeStatus status;
+      while (this->queue->Next(this->seen, status, utterance))
       {
-        if (e.Result->Reason == ResultReason::RecognizingSpeech)
+        if (status == RuntimeStatus::START && utterance.audio)
         {
-          auto result = TranscriptionWorkerCallbackResult{StatusCode::RECOGNIZING, e.Result->Text};
-          progress.Send(&result, 1);
+          this->SendCachedAudio(progress, utterance);
         }
-      };
+        else if (status == RuntimeStatus::START && !utterance.text.empty())
+        {
+          // Cached audio skips synthesis, it is sent once the utterances
+          // before it are done.
+          auto audio = this->GetCachedAudio(utterance);
+          if (audio)
+          {
+            this->queue->Cached(audio);
+            continue;
+          }
 
-      // Callback: final transcription result (sentence)
-      recognizer->Recognized += [progress](const SpeechRecognitionEventArgs &e)
-      {
-        if (e.Result->Reason == ResultReason::RecognizedSpeech)
+          // We need to assign the future to a variable to avoid the
+          // future automatically getting destroyed, which would block
+          // the thread.
+          //
+          // https://stackoverflow.com/questions/23455104/why-is-the-destructor-of-a-future-returned-from-stdasync-blocking
+          this->metrics->Mark("speakRequested");
+          auto synthesizerFuture = utterance.ssml ? this->synthesizer->StartSpeakingSsmlAsync(utterance.text) : this->synthesizer->StartSpeakingTextAsync(utterance.text);
+        }
+        else if (status == RuntimeStatus::STOP)
         {
-          auto result = TranscriptionWorkerCallbackResult{StatusCode::RECOGNIZED, e.Result->Text};
-          progress.Send(&result, 1);
+          this->synthesizer->StopSpeakingAsync().get();
         }
-        else if (e.Result->Reason == ResultReason::NoMatch)
+        else if (status == RuntimeStatus::DISPOSE)
         {
-          auto reason = NoMatchDetails::FromResult(e.Result)->Reason;
-          switch (reason)
-          {
-          // Input audio was not silent but contained no recognizable speech.
-          case NoMatchReason::NotRecognized:
-          {
-            auto result = TranscriptionWorkerCallbackResult{StatusCode::NOT_RECOGNIZED};
-            progress.Send(&result, 1);
-            break;
-          }
+          this->Dispose(progress);
+          return false;
+        }
+      }
+      for (auto id : this->queue->TakeCanceled())
+      {
+        auto result = SynthesizerWorkerCallbackResult{StatusCode::CANCELED, "", AudioBuffer(), id};
+        progress.Send(&result, 1);
+      }
+      return true;
+    }
+    catch (const std::exception &e)
+    {
+      this->failed = true;
+      auto result = SynthesizerWorkerCallbackResult{StatusCode::ERROR, e.what()};
+      progress.Send(&result, 1);
+    }
 
-          // Input audio was silent and the initial silence timeout expired.
-          // In continuous recognition this can happen multiple times during
-          // a session, not just at the very beginning.
-          case NoMatchReason::InitialSilenceTimeout:
-          {
-            auto result = TranscriptionWorkerCallbackResult{StatusCode::INITIAL_SILENCE_TIMEOUT};
-            progress.Send(&result, 1);
-            break;
-          }
+    this->Dispose(progress);
+    return false;
+  }
+
+  void Setup(const ExecutionProgress &progress)
+  {
+    std::shared_ptr<EmbeddedSpeechConfig> speechConfig;
+    std::shared_ptr<SpeechSynthesizer> synthesizer;
+    if (this->warm)
+    {
+      speechConfig = this->warm->speechConfig;
+      synthesizer = this->warm->synthesizer;
+      this->warm.reset();
+    }
+    else
+    {
+      this->metrics->Mark("setup");
+      speechConfig = AcquireSynthesizerConfig(path, model, key, logsPath, stream, outputFormat);
+      this->metrics->Mark("configCreated");
+      this->metrics->Measure("configCreation", "setup");
+
+      synthesizer = CreateSpeechSynthesizer(speechConfig, this->stream);
+      this->metrics->Mark("synthesizerCreated");
+      this->metrics->Measure("synthesizerConstruction", "configCreated");
+    }
 
-          // Input audio was silent and the end silence timeout expired.
-          // This can happen in continuous recognition after a phrase is
-          // recognized (a final result is generated) and it is followed
-          // by silence. If the silence continues long enough there will
-          // be InitialSilenceTimeout after this.
-          case NoMatchReason::EndSilenceTimeout:
+    // Callback: synthesized audio chunk
+    if (this->stream)
+    {
+      synthesizer->Synthesizing += [this, progress](const SpeechSynthesisEventArgs &e)
+      {
+        auto audio = e.Result->GetAudioData();
+        if (audio && !audio->empty())
+        {
+          if (this->metrics->MarkFirst("utteranceAudio"))
           {
-            auto result = TranscriptionWorkerCallbackResult{StatusCode::END_SILENCE_TIMEOUT};
-            progress.Send(&result, 1);
-            break;
+            this->metrics->Measure("firstAudio", "synthesisStarted");
           }
 
-          // Other reasons are not supported in embedded speech at the moment.
-          default:
-            break;
-          }
+          auto result = SynthesizerWorkerCallbackResult{StatusCode::SYNTHESIZING, "", AudioBuffer(audio)};
+          progress.Send(&result, 1);
         }
       };
+    }
 
-      // Callback: errors
-      recognizer->Canceled += [progress](const SpeechRecognitionCanceledEventArgs &e)
-      {
-        switch (e.Reason)
-        {
-        case CancellationReason::Error:
-        {
-          auto result = TranscriptionWorkerCallbackResult{StatusCode::ERROR, e.ErrorDetails};
-          progress.Send(&result, 1);
-          break;
-        }
+    // Callback: synthesis started
+    synthesizer->SynthesisStarted += [this, progress](const SpeechSynthesisEventArgs &e)
+    {
+      this->metrics->Mark("synthesisStarted");
+      this->metrics->Measure("synthesisStart", "speakRequested");
 
-        default:
-          break;
-        }
-      };
+      UNUSED(e);
+      auto result = SynthesizerWorkerCallbackResult{StatusCode::STARTED};
+      progress.Send(&result, 1);
+    };
 
-      // Callback: begin of recognition session
-      recognizer->SessionStarted += [this, progress](const SessionEventArgs &e)
+    // Callback: synthesis completed
+    synthesizer->SynthesisCompleted += [this, progress](const SpeechSynthesisEventArgs &e)
+    {
+      auto utterance = this->queue->Done();
+      if (this->stream && !utterance.text.empty() && SynthesisCache::Instance().Enabled())
       {
-        this->started = true;
+        SynthesisCache::Instance().Put(this->GetCacheKey(utterance), AudioBuffer(e.Result->GetAudioData()));
+      }
+      this->metrics->Mark("synthesisCompleted");
+      this->metrics->Measure("synthesis", "synthesisStarted");
+      this->metrics->Clear("utteranceAudio");
 
-        UNUSED(e);
-        auto result = TranscriptionWorkerCallbackResult{StatusCode::STARTED};
-        progress.Send(&result, 1);
-      };
+      auto result = SynthesizerWorkerCallbackResult{StatusCode::STOPPED, "", AudioBuffer(), utterance.id};
+      progress.Send(&result, 1);
+    };
 
-      // Callback: speech start detected
-      recognizer->SpeechStartDetected += [progress](const RecognitionEventArgs &e)
+    // Callback: synthesis canceled
+    synthesizer->SynthesisCanceled += [this, progress](const SpeechSynthesisEventArgs &e)
+    {
+      // Utterances canceled by stopping were already taken off the queue
+      auto cancellation = SpeechSynthesisCancellationDetails::FromResult(e.Result);
+      if (cancellation->Reason == CancellationReason::Error)
       {
-        UNUSED(e);
-        auto result = TranscriptionWorkerCallbackResult{StatusCode::SPEECH_START_DETECTED};
+        auto utterance = this->queue->Done();
+        auto result = SynthesizerWorkerCallbackResult{StatusCode::ERROR, cancellation->ErrorDetails, AudioBuffer(), utterance.id};
         progress.Send(&result, 1);
-      };
+      }
+    };
 
-      // Callback: speech end detected
-      recognizer->SpeechEndDetected += [progress](const RecognitionEventArgs &e)
-      {
-        UNUSED(e);
-        auto result = TranscriptionWorkerCallbackResult{StatusCode::SPEECH_END_DETECTED};
-        progress.Send(&result, 1);
-      };
+    this->speechConfig = speechConfig;
+    this->synthesizer = synthesizer;
+  }
 
-      // Callback: end of recognition session
-      recognizer->SessionStopped += [this, progress](const SessionEventArgs &e)
-      {
-        this->started = false;
+  std::string GetCacheKey(const Utterance &utterance) const
+  {
+    return CreateCacheKey({utterance.ssml ? "ssml" : "text", this->path, this->model, this->outputFormat, utterance.text});
+  }
 
-        UNUSED(e);
-        auto result = TranscriptionWorkerCallbackResult{StatusCode::STOPPED};
-        progress.Send(&result, 1);
-      };
+  // Only audio synthesized to memory is cached, the SDK plays audio on
+  // the speaker itself.
+  AudioBuffer GetCachedAudio(const Utterance &utterance) const
+  {
+    return this->stream ? SynthesisCache::Instance().Get(this->GetCacheKey(utterance)) : AudioBuffer();
+  }
 
-      RuntimeStatus status;
-      while ((status = GetTranscriptionWorkerStatus(this->id)) != RuntimeStatus::DISPOSE)
-      {
-        switch (status)
-        {
-        case RuntimeStatus::START:
-          if (!this->started)
-          {
-            recognizer->StartContinuousRecognitionAsync().get();
-          }
-          break;
-        case RuntimeStatus::STOP:
-          if (this->started)
-          {
-            recognizer->StopContinuousRecognitionAsync().get();
-          }
-          break;
-        case RuntimeStatus::DISPOSE:
-          break;
-        }
+  // Reports cached audio like a synthesized utterance, in one chunk.
+  void SendCachedAudio(const ExecutionProgress &progress, const Utterance &utterance)
+  {
+    this->metrics->Mark("cachedAudio");
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-      }
+    SynthesizerWorkerCallbackResult results[] = {
+        {StatusCode::STARTED},
+        {StatusCode::SYNTHESIZING, "", utterance.audio},
+        {StatusCode::STOPPED, "", AudioBuffer(), utterance.id}};
+    for (auto &result : results)
+    {
+      progress.Send(&result, 1);
+    }
+  }
+
+  // Stops and releases the synthesizer, after which no progress is sent. A
+  // synthesizer that did not fail is kept by the speech config cache for
+  // the next session with the same options.
+  void Dispose(const ExecutionProgress &progress)
+  {
+    this->queue->Detach();
 
-      if (this->started)
+    bool reuse = this->synthesizer && !this->failed;
+    try
+    {
+      if (this->synthesizer && this->queue->InFlight() > 0)
       {
-        recognizer->StopContinuousRecognitionAsync().get();
+        this->synthesizer->StopSpeakingAsync().get();
       }
-
-      RemoveTranscriptionWorkerStatus(this->id);
     }
     catch (const std::exception &e)
     {
-      auto result = TranscriptionWorkerCallbackResult{StatusCode::ERROR, e.what()};
+      reuse = false;
+      auto result = SynthesizerWorkerCallbackResult{StatusCode::ERROR, e.what()};
       progress.Send(&result, 1);
     }
+    if (reuse)
+    {
+      this->synthesizer->Synthesizing.DisconnectAll();
+      this->synthesizer->SynthesisStarted.DisconnectAll();
+      this->synthesizer->SynthesisCompleted.DisconnectAll();
+      this->synthesizer->SynthesisCanceled.DisconnectAll();
+      warmSynthesizers.Put(GetWarmSynthesizerKey(this->path, this->model, this->key, this->logsPath, this->stream, this->outputFormat), std::make_shared<WarmSynthesizer>(WarmSynthesizer{this->speechConfig, this->synthesizer}));
+    }
+    this->synthesizer.reset();
+    this->speechConfig.reset();
+
+    SessionRegistry::Instance().Remove<SynthesizerQueue>(this->id);
+    RemoveSessionMetrics("synthesis", this->id);
   }
 
-  void OnProgress(const TranscriptionWorkerCallbackResult *result, size_t /* count */)
+  void OnProgress(const SynthesizerWorkerCallbackResult *result, size_t /* count */)
   {
     Napi::HandleScope scope(Env());
 
-    auto jsResult = Napi::Object::New(Env());
-    jsResult.Set("status", Napi::Number::New(Env(), result->status));
-    if (!result->data.empty())
+    const auto &addonData = AddonData::Get(Env());
+    auto jsResult = addonData.CreateResult(Env(), result->status, result->data);
+    if (result->audio)
+    {
+      addonData.SetAudio(jsResult, CreateAudioArrayBuffer(Env(), result->audio));
+    }
+    if (result->utterance)
     {
-      jsResult.Set("data", Napi::String::New(Env(), result->data));
+      addonData.SetUtterance(Env(), jsResult, result->utterance);
     }
 
     Callback().Call({Env().Undefined(), jsResult});
@@ -274,8 +7131,7 @@ public:
   {
     Napi::HandleScope scope(Env());
 
-    auto jsResult = Napi::Object::New(Env());
-    jsResult.Set("status", Napi::Number::New(Env(), StatusCode::DISPOSED));
+    auto jsResult = AddonData::Get(Env()).CreateResult(Env(), StatusCode::DISPOSED);
 
     Callback().Call({Env().Undefined(), jsResult});
   }
@@ -292,11 +7148,18 @@ private:
   const std::string key;
   const std::string model;
   const std::string logsPath;
-  const std::vector<std::string> phrases;
-  bool started;
+  const bool stream;
+  const std::string outputFormat;
+  std::shared_ptr<WarmSynthesizer> warm;
+  std::shared_ptr<SynthesizerQueue> queue;
+  std::shared_ptr<SessionMetrics> metrics;
+  std::shared_ptr<EmbeddedSpeechConfig> speechConfig;
+  std::shared_ptr<SpeechSynthesizer> synthesizer;
+  uint64_t seen = 0;
+  bool failed = false;
 };
 
-Napi::Value CreateTranscriber(const Napi::CallbackInfo &info)
+Napi::Value CreateSynthesizer(const Napi::CallbackInfo &info)
 {
   auto env = info.Env();
 
@@ -306,7 +7169,7 @@ Napi::Value CreateTranscriber(const Napi::CallbackInfo &info)
     Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
     return env.Undefined();
   }
-  else if (!info[0].IsString() || !info[1].IsString() || !info[2].IsString() || (!info[3].IsUndefined() && !info[3].IsString()) || !info[4].IsArray() || !info[5].IsFunction())
+  else if (!info[0].IsString() || !info[1].IsString() || !info[2].IsString() || (!info[3].IsUndefined() && !info[3].IsString()) || !info[4].IsObject() || !info[5].IsFunction())
   {
     Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
     return env.Undefined();
@@ -320,17 +7183,19 @@ Napi::Value CreateTranscriber(const Napi::CallbackInfo &info)
   {
     logsPath = info[3].As<Napi::String>().Utf8Value();
   }
-  auto phrasesRaw = info[4].As<Napi::Array>();
-  std::vector<std::string> phrases;
-  for (uint32_t i = 0; i < static_cast<uint32_t>(phrasesRaw.Length()); i++)
+  auto options = info[4].As<Napi::Object>();
+  auto stream = options.Get("output").IsString() && options.Get("output").As<Napi::String>().Utf8Value() == "stream";
+  std::string outputFormat;
+  if (options.Get("outputFormat").IsString())
   {
-    phrases.push_back(phrasesRaw.Get(i).As<Napi::String>().Utf8Value());
+    outputFormat = options.Get("outputFormat").As<Napi::String>().Utf8Value();
   }
   auto callback = info[5].As<Napi::Function>();
 
   try
   {
-    auto *worker = new TranscriptionWorker(modelPath, modelKey, modelName, logsPath, phrases, callback);
+    auto warm = warmSynthesizers.Take(GetWarmSynthesizerKey(modelPath, modelName, modelKey, logsPath, stream, outputFormat));
+    auto *worker = new SynthesizerWorker(modelPath, modelKey, modelName, logsPath, stream, outputFormat, warm, callback);
     worker->Queue();
 
     return Napi::Number::New(env, worker->id);
@@ -342,230 +7207,361 @@ Napi::Value CreateTranscriber(const Napi::CallbackInfo &info)
   }
 }
 
-Napi::Value UpdateTranscriber(const Napi::CallbackInfo &info, RuntimeStatus status)
+Napi::Value PrewarmSynthesizer(const Napi::CallbackInfo &info)
 {
   auto env = info.Env();
 
   // Validate args
-  if (info.Length() < 1)
+  if (info.Length() != 6)
   {
     Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
     return env.Undefined();
   }
-  else if (!info[0].IsNumber())
+  else if (!info[0].IsString() || !info[1].IsString() || !info[2].IsString() || (!info[3].IsUndefined() && !info[3].IsString()) || !info[4].IsObject() || !info[5].IsFunction())
   {
     Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
     return env.Undefined();
   }
 
-  auto workerId = info[0].As<Napi::Number>();
-  UpdateTranscriptionWorkerStatus(workerId.Int32Value(), status);
+  auto modelPath = info[0].As<Napi::String>().Utf8Value();
+  auto modelName = info[1].As<Napi::String>().Utf8Value();
+  auto modelKey = info[2].As<Napi::String>().Utf8Value();
+  std::string logsPath;
+  if (!info[3].IsUndefined())
+  {
+    logsPath = info[3].As<Napi::String>().Utf8Value();
+  }
+  auto options = info[4].As<Napi::Object>();
+  auto stream = options.Get("output").IsString() && options.Get("output").As<Napi::String>().Utf8Value() == "stream";
+  std::string outputFormat;
+  if (options.Get("outputFormat").IsString())
+  {
+    outputFormat = options.Get("outputFormat").As<Napi::String>().Utf8Value();
+  }
+  auto callback = info[5].As<Napi::Function>();
 
-  return env.Undefined();
-}
+  try
+  {
+    auto *worker = new PrewarmWorker([modelPath, modelKey, modelName, logsPath, stream, outputFormat]()
+                                     { PrewarmSynthesizerModel(modelPath, modelName, modelKey, logsPath, stream, outputFormat); },
+                                     callback);
+    worker->Queue();
 
-Napi::Value StartTranscriber(const Napi::CallbackInfo &info)
-{
-  return UpdateTranscriber(info, RuntimeStatus::START);
+    return env.Undefined();
+  }
+  catch (const std::exception &e)
+  {
+    Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
 }
 
-Napi::Value StopTranscriber(const Napi::CallbackInfo &info)
+Napi::Value UpdateSynthesizer(const Napi::CallbackInfo &info, RuntimeStatus status)
 {
-  return UpdateTranscriber(info, RuntimeStatus::STOP);
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() < 1)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  auto workerId = info[0].As<Napi::Number>();
+  UpdateSynthesizerWorkerStatus(workerId.Int32Value(), status);
+
+  return env.Undefined();
 }
 
-Napi::Value DisposeTranscriber(const Napi::CallbackInfo &info)
+Napi::Value Synthesize(const Napi::CallbackInfo &info)
 {
-  return UpdateTranscriber(info, RuntimeStatus::DISPOSE);
-}
+  auto env = info.Env();
 
-#pragma endregion
+  // Validate args
+  if (info.Length() < 2)
+  {
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber() || !info[1].IsString() || (info.Length() > 2 && !info[2].IsUndefined() && !info[2].IsObject()))
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
 
-#pragma region Synthesizer
+  auto workerId = info[0].As<Napi::Number>();
+  auto text = info[1].As<Napi::String>().Utf8Value();
+  int priority = 0;
+  bool interrupt = false;
+  bool flush = false;
+  bool ssml = false;
+  ProsodyOptions prosody;
+  if (info.Length() > 2 && info[2].IsObject())
+  {
+    auto options = info[2].As<Napi::Object>();
+    if (options.Get("priority").IsNumber())
+    {
+      priority = options.Get("priority").As<Napi::Number>().Int32Value();
+    }
+    interrupt = options.Get("interrupt").ToBoolean();
+    flush = options.Get("flush").ToBoolean();
+    ssml = options.Get("ssml").ToBoolean();
+    prosody = GetProsodyOptions(options);
+  }
 
-static int synthesizerWorkerIds = 0;
-static std::unordered_map<int, RuntimeStatus> synthesizerWorkers;
-static std::mutex synthesizerWorkersMutex;
+  if (ssml && !text.empty())
+  {
+    try
+    {
+      SsmlValidator(text).Validate();
+    }
+    catch (const std::exception &e)
+    {
+      Napi::Error::New(env, e.what()).ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+  auto utterance = AddTextToSynthesize(workerId.Int32Value(), text, ssml, prosody, priority, interrupt, flush);
 
-void UpdateSynthesizerWorkerStatus(int workerId, RuntimeStatus status)
-{
-  std::lock_guard<std::mutex> lock(synthesizerWorkersMutex);
-  synthesizerWorkers[workerId] = status;
+  return Napi::Number::New(env, utterance);
 }
 
-void RemoveSynthesizerWorkerStatus(int workerId)
+Napi::Value AppendText(const Napi::CallbackInfo &info)
 {
-  std::lock_guard<std::mutex> lock(synthesizerWorkersMutex);
-  synthesizerWorkers.erase(workerId);
-}
+  auto env = info.Env();
 
-RuntimeStatus GetSynthesizerWorkerStatus(int workerId)
-{
-  std::lock_guard<std::mutex> lock(synthesizerWorkersMutex);
-  auto it = synthesizerWorkers.find(workerId);
-  if (it != synthesizerWorkers.end())
+  // Validate args
+  if (info.Length() < 2)
   {
-    return it->second;
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
   }
-  else
+  else if (!info[0].IsNumber() || !info[1].IsString() || (info.Length() > 2 && !info[2].IsUndefined() && !info[2].IsBoolean()))
   {
-    return RuntimeStatus::DISPOSE;
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
   }
-}
 
-static std::unordered_map<int, std::queue<std::string>> synthesizerTextQueues;
-static std::mutex synthesizerTextMutex;
+  auto workerId = info[0].As<Napi::Number>();
+  auto chunk = info[1].As<Napi::String>().Utf8Value();
+  bool flush = info.Length() > 2 && info[2].IsBoolean() && info[2].As<Napi::Boolean>();
+  AppendTextToSynthesize(workerId.Int32Value(), chunk, flush);
+
+  return env.Undefined();
+}
 
-std::queue<std::string> &GetSynthesizerTextQueue(int workerId)
+Napi::Value StopSynthesizer(const Napi::CallbackInfo &info)
 {
-  auto it = synthesizerTextQueues.find(workerId);
-  if (it == synthesizerTextQueues.end())
+  auto env = info.Env();
+
+  // Validate args
+  if (info.Length() < 1)
   {
-    synthesizerTextQueues[workerId] = std::queue<std::string>();
-    it = synthesizerTextQueues.find(workerId);
+    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  else if (!info[0].IsNumber())
+  {
+    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+    return env.Undefined();
   }
-  return it->second;
+
+  auto workerId = info[0].As<Napi::Number>();
+  StopSynthesizerWorker(workerId.Int32Value());
+
+  return env.Undefined();
 }
 
-void AddTextToSynthesize(int workerId, const std::string &text)
+Napi::Value DisposeSynthesizer(const Napi::CallbackInfo &info)
 {
-  std::lock_guard<std::mutex> lock(synthesizerTextMutex);
-  auto &queue = GetSynthesizerTextQueue(workerId);
-  queue.push(text);
+  return UpdateSynthesizer(info, RuntimeStatus::DISPOSE);
 }
 
-std::string GetNextTextToSynthesize(int workerId)
+#pragma endregion
+
+#pragma region KeywordRecognition
+
+class KeywordControl : public WorkerControl
 {
-  std::lock_guard<std::mutex> lock(synthesizerTextMutex);
-  auto &queue = GetSynthesizerTextQueue(workerId);
-  if (queue.empty())
-  {
-    return "";
-  }
-  auto text = queue.front();
-  queue.pop();
-  return text;
-}
+};
 
-void RemoveSynthesizerTextQueue(int workerId)
+void StopKeywordWorker(int workerId)
 {
-  std::lock_guard<std::mutex> lock(synthesizerTextMutex);
-  synthesizerTextQueues.erase(workerId);
+  if (auto control = SessionRegistry::Instance().Remove<KeywordControl>(workerId))
+  {
+    control->Post(RuntimeStatus::DISPOSE);
+  }
 }
 
-struct SynthesizerWorkerCallbackResult
+struct KeywordWorkerCallbackResult
 {
   StatusCode status;
   std::string data = "";
+
+  // Milliseconds since the start of the audio, of the keyword and since
+  // the epoch
+  double offset = 0;
+  double duration = 0;
+  double timestamp = 0;
 };
 
-class SynthesizerWorker : public Napi::AsyncProgressQueueWorker<SynthesizerWorkerCallbackResult>
+class KeywordWorker : public SessionWorker<KeywordWorkerCallbackResult>
 {
 public:
   const int id;
 
-  SynthesizerWorker(const std::string &path, const std::string &key, const std::string &model,const  std::string &logsPath, const Napi::Function &callback)
-      : Napi::AsyncProgressQueueWorker<SynthesizerWorkerCallbackResult>(callback), id(synthesizerWorkerIds++), path(path), key(key), model(model), logsPath(logsPath), synthesizing(false)
+  KeywordWorker(const std::string &path, const std::string &audioFile, const std::shared_ptr<AudioHubReader> &hubReader, bool continuous, const Napi::Function &callback)
+      : SessionWorker<KeywordWorkerCallbackResult>(callback, "KeywordWorker"), id(SessionRegistry::Instance().Add(std::make_shared<KeywordControl>())), path(path), audioFile(audioFile), hubReader(hubReader), continuous(continuous)
   {
-    UpdateSynthesizerWorkerStatus(this->id, RuntimeStatus::START);
+    this->metrics = AddSessionMetrics("keyword", this->id);
+    this->SetMetrics(this->metrics);
+    this->control = SessionRegistry::Instance().Get<KeywordControl>(this->id);
+    this->control->Attach([this]
+                          { this->Schedule(); });
   }
 
-  void Execute(const ExecutionProgress &progress)
+  bool Execute(const ExecutionProgress &progress)
   {
     try
     {
-      auto speechConfig = EmbeddedSpeechConfig::FromPath(path);
-      speechConfig->SetSpeechSynthesisVoice(model, key);
-      if (!this->logsPath.empty())
+      if (!this->recognizer)
       {
-        speechConfig->SetProperty(PropertyId::Speech_LogFilename, logsPath);
+        this->Setup(progress);
       }
-      speechConfig->SetSpeechSynthesisOutputFormat(SpeechSynthesisOutputFormat::Riff24Khz16BitMonoPcm);
 
-      auto audioConfig = AudioConfig::FromDefaultSpeakerOutput();
-      auto synthesizer = SpeechSynthesizer::FromConfig(speechConfig, audioConfig);
-
-      // Callback: synthesis started
-      synthesizer->SynthesisStarted += [this, progress](const SpeechSynthesisEventArgs &e)
+      // Only runs once the keyword was recognized or recognition was
+      // canceled from JS
+      RuntimeStatus status;
+      if (!this->control->Poll(this->seen, status) || status != RuntimeStatus::DISPOSE)
+      {
+        // Continuous recognition re-arms the same recognizer and model
+        // once the previous recognition completed
+        if (this->rearm.exchange(false))
+        {
+          this->recognition.get();
+          this->recognition = this->recognizer->RecognizeOnceAsync(this->model);
+          this->metrics->Mark("armed");
+          this->metrics->Measure("rearm", "recognized");
+        }
+        return true;
+      }
+      if (this->hubReader)
       {
-        this->synthesizing = true;
+        this->hubReader->Interrupt();
+      }
+      this->recognizer->StopRecognitionAsync().get();
+    }
+    catch (const std::exception &e)
+    {
+      auto result = KeywordWorkerCallbackResult{StatusCode::ERROR, e.what()};
+      progress.Send(&result, 1);
+    }
 
-        UNUSED(e);
-        auto result = SynthesizerWorkerCallbackResult{StatusCode::STARTED};
-        progress.Send(&result, 1);
-      };
+    this->control->Detach();
+    if (this->hubReader)
+    {
+      this->hubReader->Close();
+    }
+    this->recognizer.reset();
+    StopKeywordWorker(this->id);
+    RemoveSessionMetrics("keyword", this->id);
+    return false;
+  }
 
-      // Callback: synthesis completed
-      synthesizer->SynthesisCompleted += [this, progress](const SpeechSynthesisEventArgs &e)
-      {
-        this->synthesizing = false;
+  void Setup(const ExecutionProgress &progress)
+  {
+    this->metrics->Mark("setup");
+    auto model = KeywordRecognitionModel::FromFile(path);
+    this->metrics->Mark("modelCreated");
+    this->metrics->Measure("modelLoad", "setup");
 
-        UNUSED(e);
-        auto result = SynthesizerWorkerCallbackResult{StatusCode::STOPPED};
-        progress.Send(&result, 1);
-      };
+    std::shared_ptr<AudioConfig> audioConfig;
+    if (this->hubReader)
+    {
+      audioConfig = this->hubReader->CreateAudioConfig(this->hubReader);
+    }
+    else
+    {
+      audioConfig = this->audioFile.empty() ? AudioConfig::FromDefaultMicrophoneInput() : AudioConfig::FromWavFileInput(this->audioFile);
+    }
+    auto recognizer = KeywordRecognizer::FromConfig(audioConfig);
+    this->metrics->Mark("recognizerCreated");
+    this->metrics->Measure("recognizerConstruction", "modelCreated");
 
-      // Callback: synthesis canceled
-      synthesizer->SynthesisCanceled += [this, progress](const SpeechSynthesisEventArgs &e)
-      {
-        this->synthesizing = false;
+    // Callback: keyword recognized
+    recognizer->Recognized += [this, progress](const KeywordRecognitionEventArgs &e)
+    {
+      this->metrics->Mark("recognized");
 
-        auto cancellation = SpeechSynthesisCancellationDetails::FromResult(e.Result);
-        if (cancellation->Reason == CancellationReason::Error)
-        {
-          auto result = SynthesizerWorkerCallbackResult{StatusCode::ERROR, cancellation->ErrorDetails};
-          progress.Send(&result, 1);
-        }
-      };
+      auto result = KeywordWorkerCallbackResult{StatusCode::RECOGNIZED, e.Result->Text};
+      result.offset = e.Result->Offset() / TicksPerMs;
+      result.duration = e.Result->Duration() / TicksPerMs;
+      result.timestamp = std::chrono::duration<double, std::milli>(std::chrono::system_clock::now().time_since_epoch()).count();
+      progress.Send(&result, 1);
 
-      RuntimeStatus status;
-      while ((status = GetSynthesizerWorkerStatus(this->id)) != RuntimeStatus::DISPOSE)
+      // Recognition can not be restarted from its own callback
+      if (this->continuous)
       {
-        if (status == RuntimeStatus::START && !this->synthesizing)
-        {
-          auto text = GetNextTextToSynthesize(this->id);
-          if (!text.empty())
-          {
-            // We need to assign the future to a variable to avoid the
-            // future automatically getting destroyed, which would block
-            // the thread.
-            //
-            // https://stackoverflow.com/questions/23455104/why-is-the-destructor-of-a-future-returned-from-stdasync-blocking
-            auto synthesizerFuture = synthesizer->StartSpeakingTextAsync(text);
-          }
-        }
-        else if (status == RuntimeStatus::STOP && this->synthesizing)
-        {
-          synthesizer->StopSpeakingAsync().get();
-        }
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        this->rearm = true;
+        this->Schedule();
       }
-
-      if (this->synthesizing)
+      else
       {
-        synthesizer->StopSpeakingAsync().get();
+        StopKeywordWorker(this->id);
       }
+    };
 
-      RemoveSynthesizerWorkerStatus(this->id);
-      RemoveSynthesizerTextQueue(this->id);
-    }
-    catch (const std::exception &e)
+    // Callback: errors, after which there is nothing left to wait for
+    recognizer->Canceled += [this, progress](const SpeechRecognitionCanceledEventArgs &e)
     {
-      auto result = SynthesizerWorkerCallbackResult{StatusCode::ERROR, e.what()};
-      progress.Send(&result, 1);
-    }
+      switch (e.Reason)
+      {
+      case CancellationReason::Error:
+      {
+        auto result = KeywordWorkerCallbackResult{StatusCode::ERROR, e.ErrorDetails};
+        progress.Send(&result, 1);
+
+        StopKeywordWorker(this->id);
+        break;
+      }
+
+      // The end of an audio file was reached
+      case CancellationReason::EndOfStream:
+        StopKeywordWorker(this->id);
+        break;
+
+      default:
+        break;
+      }
+    };
+
+    // Starts keyword recognition, which is stopped once the worker is
+    // woken up. The future is kept because its destructor would block
+    // until recognition ended.
+    //
+    // Refs: https://github.com/Azure-Samples/cognitive-services-speech-sdk/issues/2229
+    // https://stackoverflow.com/questions/23455104/why-is-the-destructor-of-a-future-returned-from-stdasync-blocking
+    this->recognition = recognizer->RecognizeOnceAsync(model);
+    this->metrics->Mark("armed");
+    this->recognizer = recognizer;
+    this->model = model;
   }
 
-  void OnProgress(const SynthesizerWorkerCallbackResult *result, size_t /* count */)
+  void OnProgress(const KeywordWorkerCallbackResult *result, size_t /* count */)
   {
     Napi::HandleScope scope(Env());
 
-    auto jsResult = Napi::Object::New(Env());
-    jsResult.Set("status", Napi::Number::New(Env(), result->status));
-    if (!result->data.empty())
+    auto jsResult = AddonData::Get(Env()).CreateResult(Env(), result->status, result->data);
+    if (result->status == StatusCode::RECOGNIZED)
     {
-      jsResult.Set("data", Napi::String::New(Env(), result->data));
+      jsResult.Set("offset", Napi::Number::New(Env(), result->offset));
+      jsResult.Set("duration", Napi::Number::New(Env(), result->duration));
+      jsResult.Set("timestamp", Napi::Number::New(Env(), result->timestamp));
     }
 
     Callback().Call({Env().Undefined(), jsResult});
@@ -575,8 +7571,7 @@ public:
   {
     Napi::HandleScope scope(Env());
 
-    auto jsResult = Napi::Object::New(Env());
-    jsResult.Set("status", Napi::Number::New(Env(), StatusCode::DISPOSED));
+    auto jsResult = AddonData::Get(Env()).CreateResult(Env(), StatusCode::STOPPED);
 
     Callback().Call({Env().Undefined(), jsResult});
   }
@@ -590,41 +7585,49 @@ public:
 
 private:
   const std::string path;
-  const std::string key;
-  const std::string model;
-  const std::string logsPath;
-  bool synthesizing;
+  const std::string audioFile;
+  const std::shared_ptr<AudioHubReader> hubReader;
+  const bool continuous;
+  std::shared_ptr<WorkerControl> control;
+  std::shared_ptr<SessionMetrics> metrics;
+  std::shared_ptr<KeywordRecognitionModel> model;
+  std::shared_ptr<KeywordRecognizer> recognizer;
+  std::future<std::shared_ptr<KeywordRecognitionResult>> recognition;
+  uint64_t seen = 0;
+  std::atomic<bool> rearm{false};
 };
 
-Napi::Value CreateSynthesizer(const Napi::CallbackInfo &info)
+Napi::Value Recognize(const Napi::CallbackInfo &info)
 {
   auto env = info.Env();
 
   // Validate args
-  if (info.Length() != 5)
+  if (info.Length() != 3)
   {
     Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
     return env.Undefined();
   }
-  else if (!info[0].IsString() || !info[1].IsString() || !info[2].IsString() || (!info[3].IsUndefined() && !info[3].IsString()) || !info[4].IsFunction())
+  else if (!info[0].IsString() || !info[1].IsObject() || !info[2].IsFunction())
   {
     Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
     return env.Undefined();
   }
 
   auto modelPath = info[0].As<Napi::String>().Utf8Value();
-  auto modelName = info[1].As<Napi::String>().Utf8Value();
-  auto modelKey = info[2].As<Napi::String>().Utf8Value();
-  std::string logsPath;
-  if (!info[3].IsUndefined())
+  auto options = info[1].As<Napi::Object>();
+  auto callback = info[2].As<Napi::Function>();
+
+  bool continuous = options.Has("continuous") && options.Get("continuous").ToBoolean();
+  std::string audioFile;
+  if (options.Has("audioFile") && options.Get("audioFile").IsString())
   {
-    logsPath = info[3].As<Napi::String>().Utf8Value();
+    audioFile = options.Get("audioFile").As<Napi::String>().Utf8Value();
   }
-  auto callback = info[4].As<Napi::Function>();
 
   try
   {
-    auto *worker = new SynthesizerWorker(modelPath, modelKey, modelName, logsPath, callback);
+    auto hubReader = CreateAudioHubReader(options, "keyword");
+    auto *worker = new KeywordWorker(modelPath, audioFile, hubReader, continuous, callback);
     worker->Queue();
 
     return Napi::Number::New(env, worker->id);
@@ -636,7 +7639,7 @@ Napi::Value CreateSynthesizer(const Napi::CallbackInfo &info)
   }
 }
 
-Napi::Value UpdateSynthesizer(const Napi::CallbackInfo &info, RuntimeStatus status)
+Napi::Value Unrecognize(const Napi::CallbackInfo &info)
 {
   auto env = info.Env();
 
@@ -653,160 +7656,314 @@ Napi::Value UpdateSynthesizer(const Napi::CallbackInfo &info, RuntimeStatus stat
   }
 
   auto workerId = info[0].As<Napi::Number>();
-  UpdateSynthesizerWorkerStatus(workerId.Int32Value(), status);
+  StopKeywordWorker(workerId.Int32Value());
 
   return env.Undefined();
 }
 
-Napi::Value Synthesize(const Napi::CallbackInfo &info)
+#pragma endregion
+
+#pragma region KeywordTranscription
+
+// PCM format the microphone is captured in for keyword transcription. The
+// keyword recognizer is configured to capture it, and the transcriber's
+// push stream is created with it, so that the audio handed over after the
+// keyword is read the way it was captured.
+struct KeywordCaptureFormat
 {
-  auto env = info.Env();
+  uint32_t samplesPerSecond = 16000;
+  uint8_t bitsPerSample = 16;
+  uint8_t channels = 1;
 
-  // Validate args
-  if (info.Length() < 2)
+  std::shared_ptr<AudioConfig> CreateMicrophoneConfig() const
   {
-    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
-    return env.Undefined();
+    auto audioConfig = AudioConfig::FromDefaultMicrophoneInput();
+    audioConfig->SetProperty(PropertyId::AudioConfig_SampleRateForCapture, std::to_string(this->samplesPerSecond));
+    audioConfig->SetProperty(PropertyId::AudioConfig_BitsPerSampleForCapture, std::to_string(this->bitsPerSample));
+    audioConfig->SetProperty(PropertyId::AudioConfig_NumberOfChannelsForCapture, std::to_string(this->channels));
+    return audioConfig;
   }
-  else if (!info[0].IsNumber() || !info[1].IsString())
+
+  std::shared_ptr<PushAudioInputStream> CreatePushStream() const
   {
-    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
-    return env.Undefined();
+    return AudioInputStream::CreatePushStream(AudioStreamFormat::GetWaveFormatPCM(this->samplesPerSecond, this->bitsPerSample, this->channels));
   }
+};
 
-  auto workerId = info[0].As<Napi::Number>();
-  UpdateSynthesizerWorkerStatus(workerId.Int32Value(), RuntimeStatus::START);
+// Waits for a keyword and transcribes the utterance following it with a
+// recognizer built ahead of time. The audio of the keyword recognition,
+// which starts at the keyword and keeps following the microphone, is
+// pumped into the recognizer past the keyword, so nothing spoken right
+// after the keyword is lost. Every utterance gets a fresh recognizer and
+// push stream, so audio left over from one is never transcribed with the
+// next. Once the utterance was recognized, the worker waits for the
+// keyword again.
+class KeywordTranscriptionWorker : public SessionWorker<TranscriptionWorkerCallbackResult>
+{
+public:
+  const int id;
 
-  auto text = info[1].As<Napi::String>().Utf8Value();
-  AddTextToSynthesize(workerId, text);
+  KeywordTranscriptionWorker(const std::string &keywordPath, const std::string &path, const std::string &key, const std::string &model, const std::string &logsPath, const std::vector<std::string> &phrases, const Napi::Function &callback)
+      : SessionWorker<TranscriptionWorkerCallbackResult>(callback, "KeywordTranscriptionWorker"), id(SessionRegistry::Instance().Add(std::make_shared<KeywordControl>())), keywordPath(keywordPath), path(path), key(key), model(model), logsPath(logsPath), phrases(phrases)
+  {
+    this->metrics = AddSessionMetrics("keyword", this->id);
+    this->SetMetrics(this->metrics);
+    this->control = SessionRegistry::Instance().Get<KeywordControl>(this->id);
+    this->control->Attach([this]
+                          { this->Schedule(); });
+  }
 
-  return env.Undefined();
-}
+  bool Execute(const ExecutionProgress &progress)
+  {
+    try
+    {
+      if (!this->keywordRecognizer)
+      {
+        this->Setup(progress);
+      }
 
-Napi::Value StopSynthesizer(const Napi::CallbackInfo &info)
-{
-  return UpdateSynthesizer(info, RuntimeStatus::STOP);
-}
+      RuntimeStatus status;
+      if (this->control->Poll(this->seen, status) && status == RuntimeStatus::DISPOSE)
+      {
+        this->Dispose(progress);
+        return false;
+      }
 
-Napi::Value DisposeSynthesizer(const Napi::CallbackInfo &info)
-{
-  return UpdateSynthesizer(info, RuntimeStatus::DISPOSE);
-}
+      auto keyword = std::atomic_exchange(&this->keyword, std::shared_ptr<KeywordRecognitionResult>());
+      if (keyword)
+      {
+        this->HandOff(keyword);
+      }
 
-#pragma endregion
+      // Stopping a recognizer may still deliver a final result
+      if (this->utteranceDone.exchange(false) && this->handingOff)
+      {
+        this->EndUtterance(progress);
+      }
+    }
+    catch (const std::exception &e)
+    {
+      auto result = TranscriptionWorkerCallbackResult{StatusCode::ERROR, e.what()};
+      progress.Send(&result, 1);
 
-#pragma region KeywordRecognition
+      this->Dispose(progress);
+      return false;
+    }
 
-static int keywordWorkerIds = 0;
-static std::unordered_map<int, std::promise<void>> runningKeywordWorkers;
-static std::mutex runningKeywordWorkersMutex;
+    return true;
+  }
 
-void StopKeywordWorker(int workerId)
-{
-  std::lock_guard<std::mutex> lock(runningKeywordWorkersMutex);
-  auto runningKeywordWorker = runningKeywordWorkers.find(workerId);
-  if (runningKeywordWorker != runningKeywordWorkers.end())
+  void Setup(const ExecutionProgress &progress)
   {
-    runningKeywordWorker->second.set_value();
-    runningKeywordWorkers.erase(runningKeywordWorker);
-  }
-}
+    this->metrics->Mark("setup");
+    this->speechConfig = AcquireTranscriptionConfig(path, model, key, logsPath);
+    this->metrics->Mark("configCreated");
+    this->metrics->Measure("configCreation", "setup");
 
-struct KeywordWorkerCallbackResult
-{
-  StatusCode status;
-  std::string data = "";
-};
+    // Build the recognizer first, so that it is ready by the time the
+    // keyword is heard
+    this->Prepare(progress);
 
-class KeywordWorker : public Napi::AsyncProgressQueueWorker<KeywordWorkerCallbackResult>
-{
-public:
-  const int id;
+    auto keywordModel = KeywordRecognitionModel::FromFile(keywordPath);
+    auto keywordRecognizer = KeywordRecognizer::FromConfig(this->format.CreateMicrophoneConfig());
 
-  KeywordWorker(const std::string &path, const Napi::Function &callback)
-      : Napi::AsyncProgressQueueWorker<KeywordWorkerCallbackResult>(callback), id(keywordWorkerIds++), path(path)
-  {
-    std::lock_guard<std::mutex> lock(runningKeywordWorkersMutex);
-    runningKeywordWorkers[this->id] = std::promise<void>();
+    // Callback: keyword recognized, hand off on the worker
+    keywordRecognizer->Recognized += [this, progress](const KeywordRecognitionEventArgs &e)
+    {
+      this->metrics->Mark("keyword");
+
+      auto result = TranscriptionWorkerCallbackResult{StatusCode::KEYWORD_RECOGNIZED, e.Result->Text};
+      progress.Send(&result, 1);
+
+      std::atomic_store(&this->keyword, e.Result);
+      this->Schedule();
+    };
+
+    // Callback: keyword recognition errors, after which no keyword comes
+    keywordRecognizer->Canceled += [this, progress](const SpeechRecognitionCanceledEventArgs &e)
+    {
+      if (e.Reason == CancellationReason::Error)
+      {
+        auto result = TranscriptionWorkerCallbackResult{StatusCode::ERROR, e.ErrorDetails};
+        progress.Send(&result, 1);
 
-    this->waitingToStop = runningKeywordWorkers[this->id].get_future();
+        StopKeywordWorker(this->id);
+      }
+    };
+
+    this->keywordModel = keywordModel;
+    this->keywordRecognizer = keywordRecognizer;
+    this->recognition = keywordRecognizer->RecognizeOnceAsync(keywordModel);
+    this->metrics->Mark("armed");
+
+    auto result = TranscriptionWorkerCallbackResult{StatusCode::STARTED};
+    progress.Send(&result, 1);
   }
 
-  void Execute(const ExecutionProgress &progress)
+  // Builds the push stream and recognizer for the next utterance.
+  void Prepare(const ExecutionProgress &progress)
   {
-    try
+    this->metrics->Mark("preparing");
+    auto audioStream = this->format.CreatePushStream();
+    auto recognizer = SpeechRecognizer::FromConfig(this->speechConfig, AudioConfig::FromStreamInput(audioStream));
+
+    auto phraseList = PhraseListGrammar::FromRecognizer(recognizer);
+    for (auto phrase : this->phrases)
+    {
+      phraseList->AddPhrase(phrase);
+    }
+
+    // Callback: intermediate transcription results
+    recognizer->Recognizing += [this, progress](const SpeechRecognitionEventArgs &e)
+    {
+      if (e.Result->Reason == ResultReason::RecognizingSpeech)
+      {
+        this->metrics->MarkFirst("firstRecognizing");
+        if (this->metrics->MarkFirst("utteranceRecognizing"))
+        {
+          this->metrics->Measure("firstPartial", "started");
+        }
+
+        auto result = TranscriptionWorkerCallbackResult{StatusCode::RECOGNIZING, e.Result->Text};
+        progress.Send(&result, 1);
+      }
+    };
+
+    // Callback: the utterance after the keyword, which ends the handoff
+    recognizer->Recognized += [this, progress](const SpeechRecognitionEventArgs &e)
     {
-      auto keywordRecognitionConfig = KeywordRecognitionModel::FromFile(path);
+      this->metrics->Mark("recognized");
+      this->metrics->Clear("utteranceRecognizing");
+
+      auto result = TranscriptionWorkerCallbackResult{e.Result->Reason == ResultReason::RecognizedSpeech ? StatusCode::RECOGNIZED : StatusCode::NOT_RECOGNIZED, e.Result->Text};
+      progress.Send(&result, 1);
 
-      auto audioConfig = AudioConfig::FromDefaultMicrophoneInput();
-      auto recognizer = KeywordRecognizer::FromConfig(audioConfig);
+      this->utteranceDone = true;
+      this->Schedule();
+    };
 
-      // Callback: keyword recognized
-      recognizer->Recognized += [this, progress](const KeywordRecognitionEventArgs &e)
+    // Callback: errors
+    recognizer->Canceled += [progress](const SpeechRecognitionCanceledEventArgs &e)
+    {
+      if (e.Reason == CancellationReason::Error)
       {
-        auto result = KeywordWorkerCallbackResult{StatusCode::RECOGNIZED, e.Result->Text};
+        auto result = TranscriptionWorkerCallbackResult{StatusCode::ERROR, e.ErrorDetails};
         progress.Send(&result, 1);
+      }
+    };
 
-        StopKeywordWorker(this->id);
-      };
+    this->audioStream = audioStream;
+    this->recognizer = recognizer;
+    this->metrics->Mark("recognizerCreated");
+    this->metrics->Measure("recognizerConstruction", "preparing");
+  }
 
-      // Callback: errors
-      recognizer->Canceled += [progress](const SpeechRecognitionCanceledEventArgs &e)
+  void HandOff(const std::shared_ptr<KeywordRecognitionResult> &keyword)
+  {
+    this->recognition.get();
+    this->utteranceDone = false;
+    this->handingOff = true;
+    this->recognizer->StartContinuousRecognitionAsync().get();
+    this->metrics->Mark("started");
+    this->metrics->Measure("handOff", "keyword");
+
+    // The keyword audio starts at the keyword, which is skipped so that
+    // it does not end up in the transcript. Whole sample frames are
+    // skipped, as the pushed audio must stay aligned.
+    auto skip = PcmBytes(this->format.samplesPerSecond, this->format.bitsPerSample, this->format.channels, keyword->Duration() / TicksPerMs);
+
+    // Reads block until the microphone delivers more audio, so they get a
+    // thread of their own instead of an executor thread
+    auto keywordAudio = AudioDataStream::FromResult(keyword);
+    auto audioStream = this->audioStream;
+    this->keywordAudio = keywordAudio;
+    this->pump = std::thread([keywordAudio, audioStream, skip]
+                             {
+      std::vector<uint8_t> buffer(3200);
+      auto skipped = uint64_t{0};
+      uint32_t read;
+      while ((read = keywordAudio->ReadData(buffer.data(), static_cast<uint32_t>(buffer.size()))) > 0)
       {
-        switch (e.Reason)
-        {
-        case CancellationReason::Error:
+        auto skipping = static_cast<uint32_t>(std::min<uint64_t>(skip - skipped, read));
+        skipped += skipping;
+        if (read > skipping)
         {
-          auto result = KeywordWorkerCallbackResult{StatusCode::ERROR, e.ErrorDetails};
-          progress.Send(&result, 1);
-          break;
+          audioStream->Write(buffer.data() + skipping, read - skipping);
         }
+      } });
+  }
 
-        default:
-          break;
-        }
-      };
+  // Drops the recognizer and push stream of the utterance, together with
+  // any audio pumped after its end, and waits for the keyword again.
+  void EndUtterance(const ExecutionProgress &progress)
+  {
+    this->StopPump();
+    this->audioStream->Close();
+    this->recognizer->StopContinuousRecognitionAsync().get();
+    this->recognizer.reset();
+    this->audioStream.reset();
+    this->handingOff = false;
+
+    this->recognition = this->keywordRecognizer->RecognizeOnceAsync(this->keywordModel);
+    this->metrics->Mark("armed");
+    this->metrics->Measure("rearm", "recognized");
+
+    this->Prepare(progress);
+  }
+
+  void Dispose(const ExecutionProgress &progress)
+  {
+    this->control->Detach();
 
-      // Starts keyword recognition and wait for end & stopping
-      // We need to assign the future to a variable to avoid the
-      // future automatically getting destroyed, which would block
-      // the thread.
-      //
-      // Refs: https://github.com/Azure-Samples/cognitive-services-speech-sdk/issues/2229
-      // https://stackoverflow.com/questions/23455104/why-is-the-destructor-of-a-future-returned-from-stdasync-blocking
-      auto recognitionFuture = recognizer->RecognizeOnceAsync(keywordRecognitionConfig);
-      this->waitingToStop.get();
-      recognizer->StopRecognitionAsync().get();
+    try
+    {
+      if (this->keywordRecognizer)
+      {
+        this->keywordRecognizer->StopRecognitionAsync().get();
+      }
+      this->StopPump();
+      if (this->handingOff)
+      {
+        this->recognizer->StopContinuousRecognitionAsync().get();
+      }
     }
     catch (const std::exception &e)
     {
-      auto result = KeywordWorkerCallbackResult{StatusCode::ERROR, e.what()};
+      auto result = TranscriptionWorkerCallbackResult{StatusCode::ERROR, e.what()};
       progress.Send(&result, 1);
     }
+
+    // The pump must not outlive the worker, even after a failed stop
+    if (this->pump.joinable())
+    {
+      this->StopPump();
+    }
+    if (this->audioStream)
+    {
+      this->audioStream->Close();
+    }
+    this->keywordRecognizer.reset();
+    this->keywordModel.reset();
+    this->recognizer.reset();
+    this->audioStream.reset();
+    this->speechConfig.reset();
+
+    StopKeywordWorker(this->id);
+    RemoveSessionMetrics("keyword", this->id);
   }
 
-  void OnProgress(const KeywordWorkerCallbackResult *result, size_t /* count */)
+  void OnProgress(const TranscriptionWorkerCallbackResult *result, size_t /* count */)
   {
     Napi::HandleScope scope(Env());
 
-    auto jsResult = Napi::Object::New(Env());
-    jsResult.Set("status", Napi::Number::New(Env(), result->status));
-    if (!result->data.empty())
-    {
-      jsResult.Set("data", Napi::String::New(Env(), result->data));
-    }
-
-    Callback().Call({Env().Undefined(), jsResult});
+    Callback().Call({Env().Undefined(), AddonData::Get(Env()).CreateResult(Env(), result->status, result->data)});
   }
 
   void OnOK()
   {
     Napi::HandleScope scope(Env());
 
-    auto jsResult = Napi::Object::New(Env());
-    jsResult.Set("status", Napi::Number::New(Env(), StatusCode::STOPPED));
-
-    Callback().Call({Env().Undefined(), jsResult});
+    Callback().Call({Env().Undefined(), AddonData::Get(Env()).CreateResult(Env(), StatusCode::DISPOSED)});
   }
 
   void OnError(const Napi::Error &e)
@@ -817,32 +7974,79 @@ public:
   }
 
 private:
+  const std::string keywordPath;
   const std::string path;
-  std::future<void> waitingToStop;
+  const std::string key;
+  const std::string model;
+  const std::string logsPath;
+  const std::vector<std::string> phrases;
+  KeywordCaptureFormat format;
+  std::shared_ptr<WorkerControl> control;
+  std::shared_ptr<SessionMetrics> metrics;
+  std::shared_ptr<EmbeddedSpeechConfig> speechConfig;
+  std::shared_ptr<PushAudioInputStream> audioStream;
+  std::shared_ptr<SpeechRecognizer> recognizer;
+  std::shared_ptr<KeywordRecognitionModel> keywordModel;
+  std::shared_ptr<KeywordRecognizer> keywordRecognizer;
+  std::future<std::shared_ptr<KeywordRecognitionResult>> recognition;
+  std::shared_ptr<KeywordRecognitionResult> keyword;
+  std::shared_ptr<AudioDataStream> keywordAudio;
+  std::thread pump;
+  std::atomic<bool> utteranceDone{false};
+  bool handingOff = false;
+  uint64_t seen = 0;
+
+  // Detaching makes the pending read return, which ends the pump
+  void StopPump()
+  {
+    if (this->keywordAudio)
+    {
+      this->keywordAudio->DetachInput();
+    }
+    if (this->pump.joinable())
+    {
+      this->pump.join();
+    }
+    this->keywordAudio.reset();
+  }
 };
 
-Napi::Value Recognize(const Napi::CallbackInfo &info)
+Napi::Value CreateKeywordTranscriber(const Napi::CallbackInfo &info)
 {
   auto env = info.Env();
 
   // Validate args
-  if (info.Length() != 2)
+  if (info.Length() != 7)
   {
     Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
     return env.Undefined();
   }
-  else if (!info[0].IsString() || !info[1].IsFunction())
+  else if (!info[0].IsString() || !info[1].IsString() || !info[2].IsString() || !info[3].IsString() || (!info[4].IsUndefined() && !info[4].IsString()) || !info[5].IsArray() || !info[6].IsFunction())
   {
     Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
     return env.Undefined();
   }
 
-  auto modelPath = info[0].As<Napi::String>().Utf8Value();
-  auto callback = info[1].As<Napi::Function>();
+  auto keywordModelPath = info[0].As<Napi::String>().Utf8Value();
+  auto modelPath = info[1].As<Napi::String>().Utf8Value();
+  auto modelName = info[2].As<Napi::String>().Utf8Value();
+  auto modelKey = info[3].As<Napi::String>().Utf8Value();
+  std::string logsPath;
+  if (!info[4].IsUndefined())
+  {
+    logsPath = info[4].As<Napi::String>().Utf8Value();
+  }
+  auto phrasesRaw = info[5].As<Napi::Array>();
+  std::vector<std::string> phrases;
+  for (uint32_t i = 0; i < static_cast<uint32_t>(phrasesRaw.Length()); i++)
+  {
+    phrases.push_back(phrasesRaw.Get(i).As<Napi::String>().Utf8Value());
+  }
+  auto callback = info[6].As<Napi::Function>();
 
   try
   {
-    auto *worker = new KeywordWorker(modelPath, callback);
+    auto *worker = new KeywordTranscriptionWorker(keywordModelPath, modelPath, modelKey, modelName, logsPath, phrases, callback);
     worker->Queue();
 
     return Napi::Number::New(env, worker->id);
@@ -854,46 +8058,69 @@ Napi::Value Recognize(const Napi::CallbackInfo &info)
   }
 }
 
-Napi::Value Unrecognize(const Napi::CallbackInfo &info)
-{
-  auto env = info.Env();
-
-  // Validate args
-  if (info.Length() < 1)
-  {
-    Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
-    return env.Undefined();
-  }
-  else if (!info[0].IsNumber())
-  {
-    Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
-    return env.Undefined();
-  }
-
-  auto workerId = info[0].As<Napi::Number>();
-  StopKeywordWorker(workerId.Int32Value());
-
-  return env.Undefined();
-}
-
 #pragma endregion
 
 Napi::Object Init(Napi::Env env, Napi::Object exports)
 {
+  env.SetInstanceData(new AddonData(env));
+
   exports.Set(Napi::String::New(env, "createTranscriber"), Napi::Function::New(env, CreateTranscriber));
   exports.Set(Napi::String::New(env, "startTranscriber"), Napi::Function::New(env, StartTranscriber));
   exports.Set(Napi::String::New(env, "stopTranscriber"), Napi::Function::New(env, StopTranscriber));
   exports.Set(Napi::String::New(env, "disposeTranscriber"), Napi::Function::New(env, DisposeTranscriber));
+  exports.Set(Napi::String::New(env, "pushAudio"), Napi::Function::New(env, PushAudio));
+  exports.Set(Napi::String::New(env, "getAudioGateStats"), Napi::Function::New(env, GetAudioGateStats));
+  exports.Set(Napi::String::New(env, "acknowledgeResults"), Napi::Function::New(env, AcknowledgeResults));
+  exports.Set(Napi::String::New(env, "updatePhrases"), Napi::Function::New(env, UpdatePhrases));
+  exports.Set(Napi::String::New(env, "createMultiModelTranscriber"), Napi::Function::New(env, CreateMultiModelTranscriber));
+
+  exports.Set(Napi::String::New(env, "createAudioHub"), Napi::Function::New(env, CreateAudioHub));
+  exports.Set(Napi::String::New(env, "pushAudioHub"), Napi::Function::New(env, PushAudioHub));
+  exports.Set(Napi::String::New(env, "getAudioHubStats"), Napi::Function::New(env, GetAudioHubStats));
+  exports.Set(Napi::String::New(env, "disposeAudioHub"), Napi::Function::New(env, DisposeAudioHub));
+  exports.Set(Napi::String::New(env, "prewarmTranscriber"), Napi::Function::New(env, PrewarmTranscriber));
+
+  exports.Set(Napi::String::New(env, "transcribeFiles"), Napi::Function::New(env, TranscribeFiles));
+  exports.Set(Napi::String::New(env, "cancelFileTranscription"), Napi::Function::New(env, CancelFileTranscription));
 
   exports.Set(Napi::String::New(env, "createSynthesizer"), Napi::Function::New(env, CreateSynthesizer));
   exports.Set(Napi::String::New(env, "stopSynthesizer"), Napi::Function::New(env, StopSynthesizer));
   exports.Set(Napi::String::New(env, "disposeSynthesizer"), Napi::Function::New(env, DisposeSynthesizer));
   exports.Set(Napi::String::New(env, "synthesize"), Napi::Function::New(env, Synthesize));
+  exports.Set(Napi::String::New(env, "appendText"), Napi::Function::New(env, AppendText));
+  exports.Set(Napi::String::New(env, "prewarmSynthesizer"), Napi::Function::New(env, PrewarmSynthesizer));
 
   exports.Set(Napi::String::New(env, "recognize"), Napi::Function::New(env, Recognize));
   exports.Set(Napi::String::New(env, "unrecognize"), Napi::Function::New(env, Unrecognize));
+  exports.Set(Napi::String::New(env, "createKeywordTranscriber"), Napi::Function::New(env, CreateKeywordTranscriber));
+
+  exports.Set(Napi::String::New(env, "setSessionThreadCount"), Napi::Function::New(env, SetSessionThreadCount));
+  exports.Set(Napi::String::New(env, "getSessionThreadCount"), Napi::Function::New(env, GetSessionThreadCount));
+
+  exports.Set(Napi::String::New(env, "getSessionMetrics"), Napi::Function::New(env, GetSessionMetrics));
+  exports.Set(Napi::String::New(env, "getLatencyHistograms"), Napi::Function::New(env, GetLatencyHistograms));
+  exports.Set(Napi::String::New(env, "resetLatencyHistograms"), Napi::Function::New(env, ResetLatencyHistograms));
+
+  exports.Set(Napi::String::New(env, "getSpeechConfigCacheStats"), Napi::Function::New(env, GetSpeechConfigCacheStats));
+  exports.Set(Napi::String::New(env, "setSpeechConfigCacheIdleTimeout"), Napi::Function::New(env, SetSpeechConfigCacheIdleTimeout));
+  exports.Set(Napi::String::New(env, "getSynthesisCacheStats"), Napi::Function::New(env, GetSynthesisCacheStats));
+  exports.Set(Napi::String::New(env, "configureSynthesisCache"), Napi::Function::New(env, ConfigureSynthesisCache));
+
+#ifdef NODE_SPEECH_TEST_HOOKS
+  // Only in the test binding, see binding.gyp
+  exports.Set(Napi::String::New(env, "benchmarkResults"), Napi::Function::New(env, BenchmarkResults));
+  exports.Set(Napi::String::New(env, "stressSessionRegistry"), Napi::Function::New(env, StressSessionRegistry));
+  exports.Set(Napi::String::New(env, "createCommandProbe"), Napi::Function::New(env, CreateCommandProbe));
+  exports.Set(Napi::String::New(env, "parseJson"), Napi::Function::New(env, ParseJson));
+  exports.Set(Napi::String::New(env, "segmentText"), Napi::Function::New(env, SegmentText));
+  exports.Set(Napi::String::New(env, "testSynthesizerQueue"), Napi::Function::New(env, TestSynthesizerQueue));
+  exports.Set(Napi::String::New(env, "createProsodySsml"), Napi::Function::New(env, CreateProsodySsmlForTest));
+  exports.Set(Napi::String::New(env, "testAudioGate"), Napi::Function::New(env, TestAudioGate));
+  exports.Set(Napi::String::New(env, "arbitrateUtterances"), Napi::Function::New(env, ArbitrateUtterances));
+  exports.Set(Napi::String::New(env, "testPhraseSet"), Napi::Function::New(env, TestPhraseSet));
+#endif
 
   return exports;
 }
 
-NODE_API_MODULE(speechapi, Init)
\ No newline at end of file
+NODE_API_MODULE(NODE_GYP_MODULE_NAME, Init)
\ No newline at end of file
@@ -3,7 +3,8 @@
  *  Licensed under the MIT License. See License.txt in the project root for license information.
  *--------------------------------------------------------------------------------------------*/
 
-import { speechapi } from '../index';
+import { createAudioHub, speechapi } from '../index';
+import { testapi } from './testapi';
 
 describe('Basics', () => {
 
@@ -13,12 +14,366 @@ describe('Basics', () => {
 			startTranscriber: expect.any(Function),
 			stopTranscriber: expect.any(Function),
 			disposeTranscriber: expect.any(Function),
+			pushAudio: expect.any(Function),
+			getAudioGateStats: expect.any(Function),
+			acknowledgeResults: expect.any(Function),
+			updatePhrases: expect.any(Function),
+			createMultiModelTranscriber: expect.any(Function),
+			createAudioHub: expect.any(Function),
+			pushAudioHub: expect.any(Function),
+			getAudioHubStats: expect.any(Function),
+			disposeAudioHub: expect.any(Function),
+			prewarmTranscriber: expect.any(Function),
+			transcribeFiles: expect.any(Function),
+			cancelFileTranscription: expect.any(Function),
 			synthesize: expect.any(Function),
+			appendText: expect.any(Function),
 			createSynthesizer: expect.any(Function),
 			stopSynthesizer: expect.any(Function),
 			disposeSynthesizer: expect.any(Function),
+			prewarmSynthesizer: expect.any(Function),
 			recognize: expect.any(Function),
-			unrecognize: expect.any(Function)
+			unrecognize: expect.any(Function),
+			createKeywordTranscriber: expect.any(Function),
+			setSessionThreadCount: expect.any(Function),
+			getSessionThreadCount: expect.any(Function),
+			getSpeechConfigCacheStats: expect.any(Function),
+			setSpeechConfigCacheIdleTimeout: expect.any(Function),
+			getSynthesisCacheStats: expect.any(Function),
+			configureSynthesisCache: expect.any(Function),
+			getSessionMetrics: expect.any(Function),
+			getLatencyHistograms: expect.any(Function),
+			resetLatencyHistograms: expect.any(Function)
 		}));
 	});
+
+	test('it should only export test hooks from the test binding', () => {
+		for (const hook of ['benchmarkResults', 'stressSessionRegistry', 'createCommandProbe', 'parseJson', 'segmentText', 'testSynthesizerQueue', 'createProsodySsml', 'testAudioGate', 'arbitrateUtterances', 'testPhraseSet']) {
+			expect(speechapi).not.toHaveProperty(hook);
+			expect(testapi).toHaveProperty(hook, expect.any(Function));
+		}
+	});
+
+	test('it should resize the session executor', () => {
+		const count = speechapi.getSessionThreadCount();
+		expect(count).toBeGreaterThanOrEqual(4);
+
+		speechapi.setSessionThreadCount(count + 1);
+		expect(speechapi.getSessionThreadCount()).toBe(count + 1);
+
+		speechapi.setSessionThreadCount(count);
+		expect(speechapi.getSessionThreadCount()).toBe(count);
+	});
+
+	test('it should create and dispose sessions concurrently', () => {
+		expect(testapi.stressSessionRegistry(8, 2000)).toEqual({
+			created: 16000,
+			removed: 16000,
+			failedLookups: 0,
+			staleLookups: 0,
+			errors: 0,
+			remaining: 0
+		});
+	});
+
+	test('it should not reach new sessions through handles of reused slots', () => {
+		// Enough sessions to use up the generations of the slots they cycle through
+		expect(testapi.stressSessionRegistry(1, 1 << 20)).toEqual({
+			created: 1 << 20,
+			removed: 1 << 20,
+			failedLookups: 0,
+			staleLookups: 0,
+			errors: 0,
+			remaining: 0
+		});
+	});
+
+	test('it should report latency histograms', () => {
+		speechapi.resetLatencyHistograms();
+		expect(speechapi.getLatencyHistograms()).toEqual({});
+		expect(speechapi.getSessionMetrics('transcription', -1)).toBeUndefined();
+	});
+
+	test('it should report speech config cache stats', () => {
+		expect(speechapi.getSpeechConfigCacheStats()).toEqual({
+			hits: expect.any(Number),
+			misses: expect.any(Number),
+			evictions: expect.any(Number),
+			entries: expect.any(Number),
+			instances: expect.any(Number)
+		});
+	});
+
+	test('it should parse detailed result JSON like JSON.parse', () => {
+		for (const text of [
+			'{"DisplayText":"Hello","NBest":[{"Confidence":0.93,"Words":[{"Word":"hello","Offset":100000,"Duration":5e5}]}]}',
+			'"tab\\t quote\\" slash\\/ backslash\\\\ e\\u00e9 smile\\ud83d\\ude00"',
+			'[[], [[1, -2.5e-3], [true, false, null]], {"a": {"b": [{}]}}]',
+			' [ 0 , -7 , 1E2 ] '
+		]) {
+			expect(testapi.parseJson(text)).toEqual(JSON.parse(text));
+		}
+	});
+
+	test('it should reject malformed JSON', () => {
+		for (const text of ['', '[1,', '[1,]', '{"a":}', '{"a":1,}', '{a:1}', '"\\u12zz"', '"\\x"', '"open', '[1] 2', '01', '+1', '.5', '1.', 'inf', 'nul', '"a\tb"', '['.repeat(1000)]) {
+			expect(() => testapi.parseJson(text)).toThrow();
+		}
+	});
+
+	test('it should not report audio gate stats for unknown transcribers', () => {
+		expect(speechapi.getAudioGateStats(-1)).toBeUndefined();
+	});
+
+	test('it should pass pushed audio through an audio hub', () => {
+		const id = speechapi.createAudioHub(16000, 16, 1, 3200);
+		expect(speechapi.pushAudioHub(id, Buffer.alloc(320))).toBe(true);
+		expect(speechapi.getAudioHubStats(id)).toEqual({ pushedMs: 10, capacityMs: 100, readers: [] });
+
+		speechapi.disposeAudioHub(id);
+		expect(speechapi.pushAudioHub(id, Buffer.alloc(320))).toBe(false);
+		expect(speechapi.getAudioHubStats(id)).toBeUndefined();
+	});
+
+	test('it should convert audio durations of rates without whole bytes per millisecond', () => {
+		for (const samplesPerSecond of [44100, 22050, 11025]) {
+			const hub = createAudioHub({ samplesPerSecond, channels: 2, capacityMs: 1000 });
+			expect(hub.push(Buffer.alloc(samplesPerSecond / 5 * 4))).toBe(true);
+			expect(hub.getStats()).toEqual({ pushedMs: 200, capacityMs: 1000, readers: [] });
+			hub.dispose();
+		}
+	});
+
+	test('it should need an audio hub to transcribe with several models', () => {
+		const model = { modelPath: 'path', modelName: 'name', modelKey: 'key' };
+		expect(() => speechapi.createMultiModelTranscriber([model, model], undefined, [], {}, () => { })).toThrow(/audio hub/);
+		expect(() => speechapi.createMultiModelTranscriber([], undefined, [], {}, () => { })).toThrow(/No models/);
+	});
+
+	test('it should not update phrases of unknown transcribers', () => {
+		expect(speechapi.updatePhrases(-1, ['a'], [], false)).toBe(false);
+		expect(() => speechapi.updatePhrases(-1, ['a'], [], 'yes' as any)).toThrow(/Wrong arguments/);
+	});
+
+	test('it should not queue text for unknown synthesizers', () => {
+		expect(speechapi.synthesize(-1, 'Hello')).toBe(0);
+		expect(() => speechapi.acknowledgeResults(-1, 1)).not.toThrow();
+	});
+
+	test('it should reject malformed SSML', () => {
+		expect(() => speechapi.synthesize(-1, '<speak><voice name="a">Hello</speak>', { ssml: true })).toThrow(/Invalid SSML/);
+		expect(() => speechapi.synthesize(-1, 'Hello', { ssml: true })).toThrow(/Invalid SSML/);
+		expect(() => speechapi.synthesize(-1, '<speak><voice name="a">Hello &amp; bye</voice></speak>', { ssml: true })).not.toThrow();
+	});
+
+	test('it should accept well-formed SSML', () => {
+		const ssml = [
+			'<?xml version="1.0"?><!-- greeting --><speak version=\'1.0\'>',
+			'<voice name=\'a\'>A &lt; B &#169; &#x263A;<![CDATA[x < y]]><break time=\'1s\'/></voice>',
+			'</speak>'
+		].join('\n');
+		expect(() => speechapi.synthesize(-1, ssml, { ssml: true })).not.toThrow();
+	});
+
+	test('it should clamp prosody of plain text', () => {
+		const voice = 'Microsoft Server Speech Text to Speech Voice (en-GB, RyanNeural)';
+		expect(testapi.createProsodySsml('Hi', voice, { rate: 3, pitch: 30, breakMs: 10000 })).toBe(
+			`<speak version="1.0" xmlns="http://www.w3.org/2001/10/synthesis" xml:lang="en-GB"><voice name="${voice}">` +
+			'<prosody rate="2.00" pitch="+12.0st">Hi</prosody><break time="5000ms"/></voice></speak>');
+		expect(testapi.createProsodySsml('Hi', voice, { rate: 0.1, pitch: -30, breakMs: 250 })).toContain('<prosody rate="0.50" pitch="-12.0st">Hi</prosody><break time="250ms"/>');
+		expect(testapi.createProsodySsml('Hi', voice, { rate: 1.25, pitch: 2.5 })).toContain('<prosody rate="1.25" pitch="+2.5st">Hi</prosody></voice>');
+		expect(testapi.createProsodySsml('Hi', voice, { pitch: NaN, breakMs: -5 })).toContain(`<voice name="${voice}">Hi</voice>`);
+	});
+
+	test('it should escape plain text and voice names in SSML', () => {
+		const ssml = testapi.createProsodySsml('Tom & Jerry <say> "hi" \'there\'', 'a"b', {});
+		expect(ssml).toContain('xml:lang="en-US"><voice name="a&quot;b">Tom &amp; Jerry &lt;say&gt; &quot;hi&quot; &apos;there&apos;</voice>');
+		expect(() => speechapi.synthesize(-1, ssml, { ssml: true })).not.toThrow();
+	});
+
+	// 100 ms buffers of 16 kHz audio, each filled with its index, or with
+	// 10000 plus its index when loud, so that passed buffers can be told apart
+	const gateBuffers = (loud: boolean[]) => loud.map((isLoud, i) => Buffer.from(new Int16Array(1600).fill(isLoud ? 10000 + i : i).buffer));
+	const passedBuffers = (samples: number[]) => samples.map(sample => sample % 10000);
+
+	test('it should hold silence back and pass speech with its pre-roll and hangover', () => {
+		const loud = [false, false, false, false, false, true, false, false, false, false, false];
+		const audioStream = { samplesPerSecond: 16000, vad: { preRollMs: 200, hangoverMs: 300 } };
+
+		// Reads that span buffers must not carry silence past the gate
+		for (const readSize of [1000, 3200, 6400]) {
+			const result = testapi.testAudioGate(audioStream, gateBuffers(loud), readSize);
+			expect(passedBuffers(result.samples)).toEqual([3, 4, 5, 6, 7, 8]);
+			expect(result).toMatchObject({ readBytes: 6 * 3200, pushedBytes: 11 * 3200, gatedBytes: 5 * 3200, openings: 1, open: false });
+		}
+	});
+
+	test('it should reopen the gate for each burst of speech', () => {
+		const loud = [false, true, false, true, false, false, false, false, true, false];
+		const result = testapi.testAudioGate({ vad: { preRollMs: 100, hangoverMs: 100 } }, gateBuffers(loud), 6400);
+		expect(passedBuffers(result.samples)).toEqual([0, 1, 2, 3, 4, 7, 8, 9]);
+		expect(result).toMatchObject({ gatedBytes: 2 * 3200, openings: 3, open: false });
+
+		const silent = testapi.testAudioGate({ vad: true }, gateBuffers([false, false, false, false]), 3200);
+		expect(silent).toMatchObject({ samples: [], readBytes: 0, gatedBytes: 4 * 3200, openings: 0, open: false });
+
+		const ungated = testapi.testAudioGate({}, gateBuffers([false, false]), 3200);
+		expect(ungated).toMatchObject({ samples: [0, 1], readBytes: 2 * 3200, gatedBytes: 0 });
+	});
+
+	test('it should break confidence ties by model order', () => {
+		expect(testapi.arbitrateUtterances(2, [
+			{ op: 'add', model: 1, text: 'hello', confidence: 0.5, offset: 0, end: 1000 },
+			{ op: 'add', model: 0, text: 'hallo', confidence: 0.5, offset: 0, end: 1000 }
+		])).toEqual(['0: hallo']);
+
+		// Models without results in an utterance never win it
+		expect(testapi.arbitrateUtterances(3, [
+			{ op: 'add', model: 2, text: 'hello', confidence: 0.5, offset: 0, end: 1000 },
+			{ op: 'add', model: 1, text: 'hallo', confidence: 0.5, offset: 0, end: 1000 },
+			{ op: 'advance', model: 0, position: 1000 }
+		])).toEqual(['1: hallo']);
+	});
+
+	test('it should hold an utterance until every model reported past it', () => {
+		const hi = { op: 'add', model: 0, text: 'hi', confidence: 0.9, offset: 0, end: 1000 } as const;
+		expect(testapi.arbitrateUtterances(2, [hi, { op: 'advance', model: 0, position: 3000 }])).toEqual([]);
+		expect(testapi.arbitrateUtterances(2, [hi, { op: 'advance', model: 1, position: 999 }])).toEqual([]);
+		expect(testapi.arbitrateUtterances(2, [hi, { op: 'advance', model: 1, position: 1000 }])).toEqual(['0: hi']);
+
+		// A model that stopped reporting no longer holds anything up
+		expect(testapi.arbitrateUtterances(2, [hi, { op: 'finish', model: 1 }])).toEqual(['0: hi']);
+
+		// A late result can still win
+		expect(testapi.arbitrateUtterances(2, [
+			hi,
+			{ op: 'add', model: 1, text: 'hey', confidence: 0.95, offset: 200, end: 900 },
+			{ op: 'advance', model: 1, position: 1000 }
+		])).toEqual(['1: hey']);
+	});
+
+	test('it should pick one model per utterance when models disagree', () => {
+		// Differently segmented finals are weighted by duration
+		expect(testapi.arbitrateUtterances(2, [
+			{ op: 'add', model: 0, text: 'hello there', confidence: 0.8, offset: 0, end: 2000 },
+			{ op: 'add', model: 1, text: 'hel', confidence: 0.6, offset: 0, end: 500 },
+			{ op: 'add', model: 1, text: 'lo there', confidence: 0.9, offset: 500, end: 2000 }
+		])).toEqual(['1: hel lo there']);
+
+		expect(testapi.arbitrateUtterances(2, [
+			{ op: 'add', model: 0, text: 'one', confidence: 0.9, offset: 0, end: 1000 },
+			{ op: 'add', model: 1, text: 'won', confidence: 0.5, offset: 0, end: 1000 },
+			{ op: 'add', model: 0, text: 'too', confidence: 0.4, offset: 2000, end: 3000 },
+			{ op: 'add', model: 1, text: 'two', confidence: 0.7, offset: 2000, end: 3000 }
+		])).toEqual(['0: one', '1: two']);
+		expect(() => testapi.arbitrateUtterances(2, [{ op: 'finish', model: 2 }])).toThrow(/Wrong arguments/);
+	});
+
+	test('it should dedupe phrases ignoring case and whitespace', () => {
+		expect(testapi.testPhraseSet(['foo', ' Foo ', 'bar  baz', 'BAR baz', '', '  '], [
+			{ add: ['qux', 'FOO', '\tqux\n'] },
+			{}
+		])).toEqual([['add foo', 'add bar baz'], ['add qux'], []]);
+	});
+
+	test('it should add phrases as they come and rebuild the list on removal', () => {
+		expect(testapi.testPhraseSet(['foo', 'bar baz'], [
+			{ add: ['qux'] },
+			{ remove: ['Bar Baz'] },
+			{ remove: ['missing'] },
+			// Removing and adding a phrase at once takes the new casing
+			{ add: ['FOO'], remove: ['foo'] },
+			{ add: ['bar baz'], remove: ['qux'] }
+		])).toEqual([
+			['add foo', 'add bar baz'],
+			['add qux'],
+			['clear', 'add foo', 'add qux'],
+			[],
+			['clear', 'add qux', 'add FOO'],
+			['clear', 'add FOO', 'add bar baz']
+		]);
+	});
+
+	test('it should clear phrases before adding new ones', () => {
+		expect(testapi.testPhraseSet(['foo'], [
+			{ add: ['x'], clear: true },
+			{ remove: ['x'] },
+			{ clear: true },
+			{ add: ['foo'], clear: true }
+		])).toEqual([['add foo'], ['clear', 'add x'], ['clear'], [], ['add foo']]);
+	});
+
+	test('it should not cut sentences at abbreviations or decimals', () => {
+		expect(testapi.segmentText(['We went to see Dr. Smith today. He was fine.'], true)).toEqual(['We went to see Dr. Smith today.', 'He was fine.']);
+		expect(testapi.segmentText(['The book by J. R. R. Tolkien is long. It has maps, e.g. of Middle-earth.'], true)).toEqual(['The book by J. R. R. Tolkien is long.', 'It has maps, e.g. of Middle-earth.']);
+		expect(testapi.segmentText(['Pi is roughly 3.14 and e is 2.72 today. Next sentence here.'], true)).toEqual(['Pi is roughly 3.14 and e is 2.72 today.', 'Next sentence here.']);
+		expect(testapi.segmentText(['Yes. I agree with you. And more'], false)).toEqual(['Yes. I agree with you.']);
+	});
+
+	test('it should cut long clauses and CJK sentences', () => {
+		const clause = 'This sentence keeps going for a while, and it does not stop here at all, because it has more to say';
+		expect(testapi.segmentText([clause], false)).toEqual(['This sentence keeps going for a while, and it does not stop here at all,']);
+		expect(testapi.segmentText(['你好。再见。'], false)).toEqual(['你好。', '再见。']);
+	});
+
+	test('it should wait for the next chunk or a flush to end a segment', () => {
+		expect(testapi.segmentText(['It is done here.'], false)).toEqual([]);
+		expect(testapi.segmentText(['It is done here.', ' Next'], false)).toEqual(['It is done here.']);
+		expect(testapi.segmentText(['It is done ', 'here.', ' Next'], true)).toEqual(['It is done here.', 'Next']);
+		expect(testapi.segmentText(['Trailing text without an end'], true)).toEqual(['Trailing text without an end']);
+		expect(testapi.segmentText(['  ', '\n'], true)).toEqual([]);
+	});
+
+	test('it should dispatch queued text by priority, then in order', () => {
+		const next = { op: 'next' } as const;
+		const done = { op: 'done' } as const;
+		expect(testapi.testSynthesizerQueue([
+			{ op: 'push', text: 'a' },
+			{ op: 'push', text: 'b', priority: 1 },
+			{ op: 'push', text: 'c' },
+			{ op: 'push', text: 'd', priority: 1 },
+			{ op: 'push', text: 'e', priority: 2 },
+			next, next, next, done, next, done, next, done, next
+		])).toEqual(['start e', 'start b', 'idle', 'done e', 'start d', 'done b', 'start a', 'done d', 'start c']);
+
+		// Streamed segments are queued with priority 0 as they complete
+		expect(testapi.testSynthesizerQueue([
+			{ op: 'append', text: 'First sentence here. Second one' },
+			{ op: 'push', text: 'urgent', priority: 1 },
+			next, next, { op: 'flush' }, done, next
+		])).toEqual(['start urgent', 'start First sentence here.', 'done urgent', 'start Second one']);
+	});
+
+	test('it should interrupt and flush queued text', () => {
+		const next = { op: 'next' } as const;
+		const done = { op: 'done' } as const;
+		const queued = [{ op: 'push', text: 'a' }, { op: 'push', text: 'b' }, { op: 'push', text: 'c' }, next, next] as const;
+
+		// Interrupting stops the playing utterance and queues the next one again
+		expect(testapi.testSynthesizerQueue([...queued, { op: 'push', text: 'x', priority: 1, interrupt: true }, next, next, next, done, done, next]))
+			.toEqual(['start a', 'start b', 'stop', 'canceled 1', 'start x', 'start b', 'done x', 'done b', 'start c']);
+
+		// Flushing drops queued text but lets submitted text finish
+		expect(testapi.testSynthesizerQueue([...queued, { op: 'push', text: 'x', flush: true }, next, done, next]))
+			.toEqual(['start a', 'start b', 'canceled 3', 'idle', 'done a', 'start x']);
+
+		// Both, as stop does, drop everything
+		expect(testapi.testSynthesizerQueue([...queued, { op: 'push', text: '', interrupt: true, flush: true }, next, next]))
+			.toEqual(['start a', 'start b', 'canceled 3', 'stop', 'canceled 1', 'canceled 2', 'idle']);
+	});
+
+	test('it should report synthesis cache stats', () => {
+		speechapi.configureSynthesisCache(1024, undefined);
+		expect(speechapi.getSynthesisCacheStats()).toEqual({
+			hits: 0,
+			diskHits: 0,
+			misses: 0,
+			hitRate: 0,
+			evictions: 0,
+			entries: 0,
+			bytes: 0,
+			maxBytes: 1024
+		});
+		speechapi.configureSynthesisCache(0, undefined);
+	});
 });
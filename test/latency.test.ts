@@ -0,0 +1,151 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+import * as fs from 'fs';
+import * as path from 'path';
+import { createTranscriber, createTranscriptionStream, getSpeechConfigCacheStats, IFileTranscriptionResult, ITranscriptionResult, transcribeFiles, TranscriptionStatusCode } from '../index';
+import { testapi } from './testapi';
+
+// Tests of real sessions need an embedded speech model and a microphone,
+// so they only run when a model is configured through the environment.
+const modelPath = process.env['NODE_SPEECH_MODEL_PATH'];
+const modelName = process.env['NODE_SPEECH_MODEL_NAME'];
+const modelKey = process.env['NODE_SPEECH_MODEL_KEY'];
+const testWithModel = modelPath && modelName && modelKey ? test : test.skip;
+
+// Recordings of speech, the transcription fixtures of the benchmarks
+const recordingsPath = path.join(process.env['NODE_SPEECH_BENCH_FIXTURES'] ?? path.join(__dirname, '..', 'bench', 'fixtures'), 'transcription');
+const recordings = fs.existsSync(recordingsPath) ? fs.readdirSync(recordingsPath).filter(file => file.endsWith('.wav')).sort().map(file => path.join(recordingsPath, file)) : [];
+const testWithRecordings = modelPath && modelName && modelKey && recordings.length >= 2 ? test : test.skip;
+
+// Times commands from the call until the transcriber reports the status
+// they lead to.
+function createCommandTimer() {
+	const waiting: { status: TranscriptionStatusCode; resolve: () => void }[] = [];
+	const waitFor = (status: TranscriptionStatusCode) => new Promise<void>(resolve => waiting.push({ status, resolve }));
+	const measure = async (status: TranscriptionStatusCode, command: () => void) => {
+		const reacted = waitFor(status);
+		const start = performance.now();
+		command();
+		await reacted;
+		return performance.now() - start;
+	};
+	const callback = (error: Error | undefined, result: ITranscriptionResult) => {
+		expect(error).toBeUndefined();
+
+		const index = waiting.findIndex(w => w.status === result.status);
+		if (index >= 0) {
+			waiting.splice(index, 1)[0].resolve();
+		}
+	};
+	return { waitFor, measure, callback };
+}
+
+describe('Latency', () => {
+
+	test('transcriber commands should reach the worker without polling delay', async () => {
+		const timer = createCommandTimer();
+		const started = timer.waitFor(TranscriptionStatusCode.STARTED);
+		const id = testapi.createCommandProbe(timer.callback);
+		await started;
+
+		const latencies: number[] = [];
+		for (let i = 0; i < 100; i++) {
+			latencies.push(await timer.measure(TranscriptionStatusCode.STOPPED, () => testapi.stopTranscriber(id)));
+			latencies.push(await timer.measure(TranscriptionStatusCode.STARTED, () => testapi.startTranscriber(id)));
+		}
+		latencies.push(await timer.measure(TranscriptionStatusCode.DISPOSED, () => testapi.disposeTranscriber(id)));
+		latencies.sort((a, b) => a - b);
+
+		// The old poll took up to 100ms to notice a command
+		expect(latencies[Math.floor(latencies.length / 2)]).toBeLessThan(10);
+		expect(latencies[latencies.length - 1]).toBeLessThan(100);
+	});
+
+	testWithModel('transcriber should react to commands without polling delay', async () => {
+		const timer = createCommandTimer();
+		const started = timer.waitFor(TranscriptionStatusCode.STARTED);
+		const transcriber = createTranscriber({ modelPath: modelPath!, modelName: modelName!, modelKey: modelKey! }, timer.callback);
+		await started;
+
+		const stopLatency = await timer.measure(TranscriptionStatusCode.STOPPED, () => transcriber.stop());
+		const startLatency = await timer.measure(TranscriptionStatusCode.STARTED, () => transcriber.start());
+		await timer.measure(TranscriptionStatusCode.STOPPED, () => transcriber.stop());
+		const disposeLatency = await timer.measure(TranscriptionStatusCode.DISPOSED, () => transcriber.dispose());
+
+		// Disposing a stopped transcriber does no recognizer work, so this
+		// is the command round trip alone and must beat the old 100ms poll.
+		expect(disposeLatency).toBeLessThan(50);
+
+		// Starting and stopping add the recognizer's own work, which must
+		// still leave push-to-talk responsive.
+		expect(stopLatency).toBeLessThan(150);
+		expect(startLatency).toBeLessThan(250);
+	}, 30000);
+
+	testWithModel('transcriber should reuse the recognizer of a disposed session', async () => {
+		const options = { modelPath: modelPath!, modelName: modelName!, modelKey: modelKey!, audioStream: { samplesPerSecond: 16000 } };
+		const runSession = async () => {
+			const timer = createCommandTimer();
+			const started = timer.waitFor(TranscriptionStatusCode.STARTED);
+			const transcriber = createTranscriber(options, timer.callback);
+			await started;
+			return timer.measure(TranscriptionStatusCode.DISPOSED, () => transcriber.dispose());
+		};
+
+		await runSession();
+		const left = getSpeechConfigCacheStats();
+		expect(left.instances).toBeGreaterThan(0);
+
+		await runSession();
+		const reused = getSpeechConfigCacheStats();
+		expect(reused.hits).toBe(left.hits + 1);
+		expect(reused.misses).toBe(left.misses);
+	}, 30000);
+
+	testWithRecordings('file transcription should restart one recognizer on every file', async () => {
+		const results: IFileTranscriptionResult[] = [];
+		const stats = await transcribeFiles(recordings, { modelPath: modelPath!, modelName: modelName!, modelKey: modelKey!, concurrency: 1, onResult: result => results.push(result) });
+
+		expect(stats.recognizers).toBe(1);
+		expect(stats.files).toBe(recordings.length);
+		expect(results.map(result => result.path)).toEqual(recordings);
+		for (const result of results) {
+			expect(result.error).toBeUndefined();
+			expect(result.text?.trim()).toBeTruthy();
+		}
+	}, 120000);
+
+	testWithModel('transcription stream should deliver results until left', async () => {
+		const transcriber = createTranscriptionStream({ modelPath: modelPath!, modelName: modelName!, modelKey: modelKey!, audioStream: { samplesPerSecond: 16000 }, maxPending: 2 });
+
+		const statuses: TranscriptionStatusCode[] = [];
+		for await (const result of transcriber) {
+			statuses.push(result.status);
+			if (result.status === TranscriptionStatusCode.STARTED) {
+				transcriber.stop();
+			} else if (result.status === TranscriptionStatusCode.STOPPED) {
+				break;
+			}
+		}
+
+		expect(statuses).toEqual([TranscriptionStatusCode.STARTED, TranscriptionStatusCode.STOPPED]);
+		expect(await transcriber.next()).toEqual({ value: undefined, done: true });
+	}, 30000);
+
+	testWithModel('transcription stream should settle every pending next call', async () => {
+		const transcriber = createTranscriptionStream({ modelPath: modelPath!, modelName: modelName!, modelKey: modelKey!, audioStream: { samplesPerSecond: 16000 } });
+
+		const first = transcriber.next();
+		const second = transcriber.next();
+		expect((await first).value?.status).toBe(TranscriptionStatusCode.STARTED);
+		transcriber.stop();
+		expect((await second).value?.status).toBe(TranscriptionStatusCode.STOPPED);
+
+		const left = transcriber.next();
+		await transcriber.return!();
+		expect(await left).toEqual({ value: undefined, done: true });
+	}, 30000);
+});
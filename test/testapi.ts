@@ -0,0 +1,33 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+import { IAudioStreamOptions, ITranscriptionResult } from '../index';
+
+// The test binding is the addon built with hooks that drive its internals
+// without a model, which the release binding doesn't export. It is built
+// by `npm run build:test`, and has sessions of its own.
+export const testapi = require('bindings')('speechapi_test.node') as TestLib;
+
+interface TestLib {
+
+	// Transcription
+	startTranscriber: (id: number) => void,
+	stopTranscriber: (id: number) => void,
+	disposeTranscriber: (id: number) => void,
+
+	// Benchmarks
+	benchmarkResults: (count: number, cached: boolean, callback: (error: Error | undefined, result: ITranscriptionResult) => void) => void,
+	stressSessionRegistry: (threads: number, sessionsPerThread: number) => { created: number; removed: number; failedLookups: number; staleLookups: number; errors: number; remaining: number },
+	createCommandProbe: (callback: (error: Error | undefined, result: ITranscriptionResult) => void) => number,
+
+	// Internals
+	parseJson: (text: string) => unknown,
+	segmentText: (chunks: string[], flush: boolean) => string[],
+	testSynthesizerQueue: (operations: { op: 'push' | 'append' | 'flush' | 'next' | 'done'; text?: string; priority?: number; interrupt?: boolean; flush?: boolean }[]) => string[],
+	createProsodySsml: (text: string, voice: string, options: { rate?: number; pitch?: number; breakMs?: number }) => string,
+	testAudioGate: (audioStream: IAudioStreamOptions, buffers: Buffer[], readSize: number) => { samples: number[]; readBytes: number; pushedBytes: number; gatedBytes: number; openings: number; open: boolean },
+	arbitrateUtterances: (models: number, events: ({ op: 'add'; model: number; text: string; confidence: number; offset: number; end: number } | { op: 'advance'; model: number; position: number } | { op: 'finish'; model: number })[]) => string[],
+	testPhraseSet: (initial: string[], updates: { add?: string[]; remove?: string[]; clear?: boolean }[]) => string[][]
+}